@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "modbus_parking.h"
+#include "modbus_manager.h"
+#include "modbus_ctx.h"
+#include "metrics.h"
+#include "uart.h"
+#include "crc16.h"
+#include "trace.h"
+#include "sim_device.h"
+#include "lpr_capture.h"
+
+/*
+ * Benchmark da pilha completa (make bench): a biblioteca conversa com os
+ * escravos simulados (sim_device) num pseudo-terminal do próprio processo.
+ * Cada API é medida com o barramento limpo e com falhas injetadas; o texto
+ * vai para o stdout e uma linha JSON por cenário para o arquivo de resultados,
+ * para comparar builds. Depois vêm os cenários com duas threads disputando o
+ * barramento (gerente de portas, fd e contexto compartilhados).
+ */
+
+#define MATRICULA "6383"
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_DEFAULT_OUTPUT "bench_bus.json"
+
+typedef int (*bench_op_fn)(int uart_fd, int iteration);
+
+typedef struct {
+    const char *name;
+    bench_op_fn op;
+    int divisor;       // Iterações = total / divisor (operações mais longas rodam menos)
+    bench_op_fn idle;  // Trabalho fora do caminho crítico após cada operação (não medido)
+} bench_op_t;
+
+typedef struct {
+    const char *name;
+    double drop_rate;
+    double exception_rate;
+    double bit_error_rate;
+    int response_timeout_ms;
+} bench_condition_t;
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int op_read_status(int uart_fd, int iteration) {
+    uint8_t status;
+    (void)iteration;
+    return lpr_read_status(uart_fd, CAMERA_ENTRADA_ADDR, MATRICULA, &status);
+}
+
+static int op_read_data(int uart_fd, int iteration) {
+    lpr_data_t data;
+    (void)iteration;
+    return lpr_read_data(uart_fd, CAMERA_ENTRADA_ADDR, MATRICULA, &data);
+}
+
+// Muda um contador por iteração, como a entrada de um carro
+static int op_placar_update(int uart_fd, int iteration) {
+    placar_data_t placar = {
+        .vagas_terreo_comuns = 10,
+        .vagas_1andar_comuns = 8,
+        .vagas_2andar_comuns = 5,
+        .carros_terreo = (uint16_t)iteration,
+    };
+    return placar_update(uart_fd, MATRICULA, &placar);
+}
+
+static int op_capture_plate(int uart_fd, int iteration) {
+    lpr_data_t data;
+    uint8_t camera = iteration % 2 ? CAMERA_SAIDA_ADDR : CAMERA_ENTRADA_ADDR;
+    return lpr_capture_plate(uart_fd, camera, MATRICULA, &data, 3, 2000);
+}
+
+static int op_capture_plate_fast(int uart_fd, int iteration) {
+    lpr_data_t data;
+    uint8_t camera = iteration % 2 ? CAMERA_SAIDA_ADDR : CAMERA_ENTRADA_ADDR;
+    return lpr_capture_plate_fast(uart_fd, camera, MATRICULA, &data, 3, 2000);
+}
+
+// Resets adiados pelo modo rápido, feitos com o barramento ocioso
+static int idle_flush_resets(int uart_fd, int iteration) {
+    (void)iteration;
+    return lpr_capture_flush_resets(uart_fd, MATRICULA);
+}
+
+static const bench_op_t ops[] = {
+    { "lpr_read_status", op_read_status, 1, NULL },
+    { "lpr_read_data", op_read_data, 1, NULL },
+    { "placar_update", op_placar_update, 1, NULL },
+    { "lpr_capture_plate", op_capture_plate, 10, NULL },
+    { "lpr_capture_fast", op_capture_plate_fast, 10, idle_flush_resets },
+};
+
+static const bench_condition_t conditions[] = {
+    { "limpo", 0, 0, 0, 500 },
+    { "falhas", 0.02, 0.01, 1e-4, 20 },
+};
+
+static int compare_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int64_t percentile(const int64_t *sorted, int count, double p) {
+    int index = (int)(p / 100.0 * count + 0.999999) - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    if (index >= count) {
+        index = count - 1;
+    }
+    return sorted[index];
+}
+
+// Taxa simulada da linha (0 = sem limite: mede só o custo de software da pilha)
+static int line_baudrate;
+
+// Escravos simulados num PTY e a UART do mestre aberta sobre ele
+static sim_device_t *start_sim(const bench_condition_t *cond, int processing_ms, int baudrate, int *uart_fd) {
+    sim_config_t sim_config;
+    uart_config_t uart_config;
+    char slave_path[128];
+
+    sim_config_default(&sim_config);
+    sim_config.processing_ms = processing_ms;
+    snprintf(sim_config.matricula, sizeof(sim_config.matricula), "%s", MATRICULA);
+    sim_config.drop_rate = cond->drop_rate;
+    sim_config.exception_rate = cond->exception_rate;
+    sim_config.bit_error_rate = cond->bit_error_rate;
+    sim_config.baudrate = baudrate;
+
+    sim_device_t *sim = sim_create(&sim_config);
+    if (sim == NULL || sim_open_pty(sim, slave_path, sizeof(slave_path)) != 0 || sim_start(sim) != 0) {
+        fprintf(stderr, "Erro ao iniciar o simulador\n");
+        sim_destroy(sim);
+        return NULL;
+    }
+
+    uart_config_default(&uart_config);
+    uart_config.baudrate = 115200;
+    *uart_fd = open_uart_config(slave_path, &uart_config);
+    if (*uart_fd < 0) {
+        sim_destroy(sim);
+        return NULL;
+    }
+
+    return sim;
+}
+
+// Com a linha limitada, o timeout cobre também o tempo de transmissão do maior quadro
+static void set_timing(const bench_condition_t *cond, int baudrate) {
+    modbus_timing_t timing = { .turnaround_us = 0, .response_timeout_ms = cond->response_timeout_ms };
+    if (baudrate > 0) {
+        timing.response_timeout_ms += MODBUS_MAX_FRAME * 11 * 1000 / baudrate;
+    }
+    modbus_set_default_timing(&timing);
+    placar_invalidate_cache();
+}
+
+// Erros vistos pelo mestre (timeouts, CRC, exceções, respostas trocadas) desde o último metrics_reset
+static uint64_t bus_errors(void) {
+    static metrics_snapshot_t snapshot;  // Estrutura grande: fora da pilha
+    uint64_t errors = 0;
+
+    metrics_snapshot(&snapshot);
+    for (int i = 0; i < snapshot.num_devices; i++) {
+        for (int j = 0; j < METRICS_ERR_COUNT; j++) {
+            errors += snapshot.devices[i].errors[j];
+        }
+    }
+    return errors;
+}
+
+// Ordena as latências e escreve a linha de texto e a linha JSON do cenário
+static void report(const char *name, const bench_condition_t *cond, int iterations, int ok,
+                   int64_t *latency, int64_t wall_ns, int64_t cpu_ns, uint64_t frames, int baudrate,
+                   FILE *json) {
+    qsort(latency, iterations, sizeof(int64_t), compare_i64);
+
+    double seconds = wall_ns / 1e9;
+    double ops_per_s = iterations / seconds;
+    double tx_per_s = frames / seconds;
+    double p50 = percentile(latency, iterations, 50) / 1e3;
+    double p99 = percentile(latency, iterations, 99) / 1e3;
+    double p999 = percentile(latency, iterations, 99.9) / 1e3;
+    double max = latency[iterations - 1] / 1e3;
+    double cpu_us = cpu_ns / 1e3 / iterations;
+    uint64_t errors = bus_errors();
+
+    printf("%-18s %-7s %6d %6.1f%% %9.0f %9.0f %9.1f %9.1f %9.1f %9.1f %8.1f %6llu\n",
+           name, cond->name, iterations, 100.0 * ok / iterations, ops_per_s, tx_per_s,
+           p50, p99, p999, max, cpu_us, (unsigned long long)errors);
+    fflush(stdout);
+
+    fprintf(json, "{\"op\":\"%s\",\"condition\":\"%s\",\"iterations\":%d,\"ok\":%d,"
+            "\"ops_per_s\":%.1f,\"tx_per_s\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+            "\"max_us\":%.1f,\"cpu_us_per_op\":%.2f,\"bus_frames\":%llu,\"bus_errors\":%llu,\"line_baud\":%d,\"crc\":\"%s\",\"build\":\"%s %s\"}\n",
+            name, cond->name, iterations, ok, ops_per_s, tx_per_s, p50, p99, p999, max, cpu_us,
+            (unsigned long long)frames, (unsigned long long)errors, baudrate, crc16_backend_name(crc16_get_backend()), __DATE__, __TIME__);
+}
+
+static int run_scenario(const bench_op_t *op, const bench_condition_t *cond, int iterations, FILE *json) {
+    sim_stats_t stats;
+    int uart_fd;
+
+    // Câmeras sem tempo de processamento: mede a pilha, não a câmera
+    sim_device_t *sim = start_sim(cond, 0, line_baudrate, &uart_fd);
+    if (sim == NULL) {
+        return -1;
+    }
+    set_timing(cond, line_baudrate);
+    metrics_reset();
+
+    int64_t *latency = malloc(sizeof(int64_t) * iterations);
+    if (latency == NULL) {
+        close_uart(uart_fd);
+        sim_destroy(sim);
+        return -1;
+    }
+
+    int ok = 0;
+    int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+
+    for (int i = 0; i < iterations; i++) {
+        int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        if (op->op(uart_fd, i) == 0) {
+            ok++;
+        }
+        latency[i] = clock_ns(CLOCK_MONOTONIC) - t0;
+
+        if (op->idle != NULL) {
+            op->idle(uart_fd, i);
+        }
+    }
+
+    int64_t wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+    int64_t cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    sim_get_stats(sim, &stats);
+
+    report(op->name, cond, iterations, ok, latency, wall_ns, cpu_ns, stats.frames, line_baudrate, json);
+
+    free(latency);
+    close_uart(uart_fd);
+    sim_destroy(sim);
+    return 0;
+}
+
+/*
+ * Cenários com duas threads, uma por câmera, disputando o barramento. A linha
+ * é limitada (-b, ou BENCH_MT_BAUDRATE): sem isso a porta não é o gargalo.
+ * "cpu us" soma só as threads chamadoras; "erros" conta as falhas vistas pelo
+ * mestre, inclusive as respostas que uma thread descartou da outra no mesmo fd.
+ */
+#define BENCH_MT_THREADS 2
+#define BENCH_MT_BAUDRATE 19200
+#define BENCH_MT_MAX_PORTS 2
+
+// Por onde as threads chegam ao barramento
+typedef enum {
+    BENCH_TARGET_MANAGER,  // modbus_manager (uma thread de E/S por porta)
+    BENCH_TARGET_CTX,      // modbus_ctx sobre o fd da porta 0
+    BENCH_TARGET_FD        // API por fd, as duas threads no mesmo fd sem coordenação
+} bench_target_kind_t;
+
+typedef struct {
+    modbus_manager_t *mgr;
+    modbus_ctx_t *ctx;
+    int uart_fd;
+} bench_target_t;
+
+typedef int (*bench_mt_fn)(bench_target_t *target, uint8_t camera, int iteration);
+
+typedef struct {
+    const char *name;
+    bench_mt_fn op;
+    bench_target_kind_t target;
+    int ports;          // Portas, cada uma com os seus escravos simulados
+    int processing_ms;  // Processamento das câmeras
+    int divisor;
+} bench_mt_t;
+
+static int mt_manager_read_status(bench_target_t *target, uint8_t camera, int iteration) {
+    uint8_t status;
+    (void)iteration;
+    return modbus_manager_read_status(target->mgr, camera, &status);
+}
+
+static int mt_manager_capture(bench_target_t *target, uint8_t camera, int iteration) {
+    lpr_data_t data;
+    (void)iteration;
+    return modbus_manager_capture_plate(target->mgr, camera, &data, 3, 2000);
+}
+
+static int mt_fd_read_data(bench_target_t *target, uint8_t camera, int iteration) {
+    lpr_data_t data;
+    (void)iteration;
+    return lpr_read_data(target->uart_fd, camera, MATRICULA, &data);
+}
+
+static int mt_ctx_read_data(bench_target_t *target, uint8_t camera, int iteration) {
+    lpr_data_t data;
+    (void)iteration;
+    return modbus_ctx_read_data(target->ctx, camera, &data);
+}
+
+/*
+ * Gerente com as duas câmeras na mesma porta e cada uma na sua; a captura pelo
+ * gerente ocupa a porta só a cada passo, então as duas câmeras processam ao
+ * mesmo tempo. Por último, as duas threads no mesmo fd sem e com modbus_ctx:
+ * sem o contexto, o descarte antes de cada envio joga fora a resposta da
+ * outra thread.
+ */
+static const bench_mt_t mt_ops[] = {
+    { "manager_1_porta", mt_manager_read_status, BENCH_TARGET_MANAGER, 1, 0, 4 },
+    { "manager_2_portas", mt_manager_read_status, BENCH_TARGET_MANAGER, 2, 0, 4 },
+    { "manager_captura", mt_manager_capture, BENCH_TARGET_MANAGER, 1, 100, 40 },
+    { "fd_compartilhado", mt_fd_read_data, BENCH_TARGET_FD, 1, 0, 20 },
+    { "ctx_compartilhado", mt_ctx_read_data, BENCH_TARGET_CTX, 1, 0, 20 },
+};
+
+typedef struct {
+    const bench_mt_t *op;
+    bench_target_t *target;
+    uint8_t camera;
+    int iterations;
+    int64_t *latency;
+    int ok;
+    int64_t cpu_ns;
+} bench_worker_t;
+
+static void *mt_worker(void *arg) {
+    bench_worker_t *worker = arg;
+    int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    for (int i = 0; i < worker->iterations; i++) {
+        int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+        if (worker->op->op(worker->target, worker->camera, i) == 0) {
+            worker->ok++;
+        }
+        worker->latency[i] = clock_ns(CLOCK_MONOTONIC) - t0;
+    }
+
+    worker->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    return NULL;
+}
+
+static int run_mt_scenario(const bench_mt_t *op, const bench_condition_t *cond, int iterations, FILE *json) {
+    static const uint8_t cameras[BENCH_MT_THREADS] = { CAMERA_ENTRADA_ADDR, CAMERA_SAIDA_ADDR };
+    sim_device_t *sims[BENCH_MT_MAX_PORTS] = { NULL };
+    int fds[BENCH_MT_MAX_PORTS] = { 0 };
+    bench_worker_t workers[BENCH_MT_THREADS];
+    pthread_t threads[BENCH_MT_THREADS];
+    bench_target_t target = { 0 };
+    int baudrate = line_baudrate > 0 ? line_baudrate : BENCH_MT_BAUDRATE;
+    int per_thread = iterations / BENCH_MT_THREADS;
+    int ports = 0;
+    int ret = -1;
+
+    int64_t *latency = malloc(sizeof(int64_t) * per_thread * BENCH_MT_THREADS);
+    if (latency == NULL) {
+        goto out;
+    }
+    if (op->target == BENCH_TARGET_MANAGER && (target.mgr = modbus_manager_create(MATRICULA)) == NULL) {
+        goto out;
+    }
+
+    for (ports = 0; ports < op->ports; ports++) {
+        sims[ports] = start_sim(cond, op->processing_ms, baudrate, &fds[ports]);
+        if (sims[ports] == NULL || (target.mgr != NULL && modbus_manager_add_fd(target.mgr, fds[ports]) < 0)) {
+            goto out;
+        }
+    }
+    if (target.mgr != NULL && op->ports > 1) {
+        modbus_manager_map(target.mgr, CAMERA_SAIDA_ADDR, 1);
+    }
+    target.uart_fd = fds[0];
+    if (op->target == BENCH_TARGET_CTX && (target.ctx = modbus_ctx_create(fds[0], MATRICULA)) == NULL) {
+        goto out;
+    }
+    set_timing(cond, baudrate);
+    metrics_reset();
+
+    int64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+    for (int t = 0; t < BENCH_MT_THREADS; t++) {
+        workers[t] = (bench_worker_t){ .op = op, .target = &target, .camera = cameras[t],
+                                       .iterations = per_thread, .latency = latency + t * per_thread };
+        pthread_create(&threads[t], NULL, mt_worker, &workers[t]);
+    }
+
+    int ok = 0;
+    int64_t cpu_ns = 0;
+    for (int t = 0; t < BENCH_MT_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        ok += workers[t].ok;
+        cpu_ns += workers[t].cpu_ns;
+    }
+    int64_t wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+
+    uint64_t frames = 0;
+    for (int i = 0; i < ports; i++) {
+        sim_stats_t stats;
+        sim_get_stats(sims[i], &stats);
+        frames += stats.frames;
+    }
+
+    report(op->name, cond, per_thread * BENCH_MT_THREADS, ok, latency, wall_ns, cpu_ns, frames, baudrate, json);
+    ret = 0;
+
+out:
+    modbus_manager_destroy(target.mgr);
+    modbus_ctx_destroy(target.ctx);
+    for (int i = 0; i < BENCH_MT_MAX_PORTS; i++) {
+        if (sims[i] != NULL) {
+            close_uart(fds[i]);
+            sim_destroy(sims[i]);
+        }
+    }
+    free(latency);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    const char *output = BENCH_DEFAULT_OUTPUT;
+    const char *only = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:o:f:b:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'f':
+                only = optarg;
+                break;
+            case 'b':
+                line_baudrate = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Uso: %s [-n iterações] [-o resultados.json] [-f operação] [-b baud da linha]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (iterations < 10) {
+        iterations = 10;
+    }
+
+    FILE *json = fopen(output, "w");
+    if (json == NULL) {
+        perror("Erro ao criar o arquivo de resultados");
+        return 1;
+    }
+
+    // Sem trace: só a pilha de comunicação entra na medida
+    trace_set_level(TRACE_LEVEL_OFF);
+
+    printf("Benchmark do barramento (PTY + escravos simulados, CRC: %s)\n\n",
+           crc16_backend_name(crc16_get_backend()));
+    printf("%-18s %-7s %6s %7s %9s %9s %9s %9s %9s %9s %8s %6s\n", "operação", "cenário", "n", "ok",
+           "op/s", "tx/s", "p50 us", "p99 us", "p999 us", "max us", "cpu us", "erros");
+
+    for (size_t c = 0; c < sizeof(conditions) / sizeof(conditions[0]); c++) {
+        for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+            if (only != NULL && strcmp(only, ops[o].name) != 0) {
+                continue;
+            }
+            int n = iterations / ops[o].divisor;
+            if (run_scenario(&ops[o], &conditions[c], n < 10 ? 10 : n, json) != 0) {
+                fclose(json);
+                return 1;
+            }
+        }
+    }
+
+    for (size_t c = 0; c < sizeof(conditions) / sizeof(conditions[0]); c++) {
+        for (size_t o = 0; o < sizeof(mt_ops) / sizeof(mt_ops[0]); o++) {
+            if (only != NULL && strcmp(only, mt_ops[o].name) != 0) {
+                continue;
+            }
+            int n = iterations / mt_ops[o].divisor;
+            if (run_mt_scenario(&mt_ops[o], &conditions[c], n < 10 ? 10 : n, json) != 0) {
+                fclose(json);
+                return 1;
+            }
+        }
+    }
+
+    fclose(json);
+    printf("\nResultados em %s\n", output);
+    return 0;
+}
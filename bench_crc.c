@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "crc16.h"
+
+// Micro-benchmark das implementações de CRC16 (make bench-crc)
+
+#define BENCH_MIN_NS 200000000LL  // ~200 ms por medição
+
+// Impede que o compilador descarte os cálculos
+static volatile uint16_t bench_sink;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double measure(crc16_backend_t backend, const uint8_t *buf, int len) {
+    long iterations = 1;
+    int64_t elapsed;
+
+    for (;;) {
+        uint16_t crc = 0;
+        int64_t start = now_ns();
+        for (long i = 0; i < iterations; i++) {
+            crc ^= crc16_modbus_with(backend, CRC16_MODBUS_INIT, buf, len);
+        }
+        elapsed = now_ns() - start;
+        bench_sink ^= crc;
+
+        if (elapsed >= BENCH_MIN_NS)
+            break;
+        iterations *= 2;
+    }
+
+    return (double)len * (double)iterations * 1e9 / (double)elapsed;
+}
+
+int main(void) {
+    static const int sizes[] = { 8, 15, 31, 64, 256, 4096, 1 << 20 };
+    const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    uint8_t *buf = malloc(1 << 20);
+
+    if (buf == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    for (int i = 0; i < (1 << 20); i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    printf("CRC16 MODBUS - implementação em uso: %s\n\n", crc16_backend_name(crc16_get_backend()));
+    printf("%-10s", "bytes");
+    for (int b = 0; b < CRC16_BACKEND_COUNT; b++) {
+        printf("%14s", crc16_backend_name((crc16_backend_t)b));
+    }
+    printf("   (MB/s)\n");
+
+    for (int s = 0; s < n_sizes; s++) {
+        printf("%-10d", sizes[s]);
+        for (int b = 0; b < CRC16_BACKEND_COUNT; b++) {
+            if (!crc16_backend_available((crc16_backend_t)b)) {
+                printf("%14s", "n/d");
+                continue;
+            }
+            double rate = measure((crc16_backend_t)b, buf, sizes[s]);
+            printf("%14.1f", rate / 1e6);
+        }
+        printf("\n");
+    }
+
+    free(buf);
+    return 0;
+}
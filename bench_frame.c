@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "crc16.h"
+#include "modbus_frame.h"
+
+/*
+ * Custo de CPU por transação na montagem e emissão do quadro (make bench-frame):
+ * o caminho original (vetor temporário + memcpy + CRC bit a bit no final +
+ * write) contra o codificador no próprio buffer com CRC acumulado por trechos
+ * e uma única escrita. A linha "antigo, CRC rápido" usa o caminho original com
+ * a implementação de CRC em uso, para separar o ganho do CRC do ganho da
+ * montagem. A emissão vai para /dev/null para medir só o custo do lado da CPU.
+ */
+
+#define BENCH_ITERATIONS 500000
+#define BENCH_ROUNDS 5  // Só montagem: melhor de 5 rodadas (quadros curtos oscilam muito)
+#define MATRICULA "6383"
+
+static volatile uint16_t bench_sink;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// CRC do caminho original; trocado pela implementação em uso em "antigo, CRC rápido"
+static crc16_backend_t legacy_crc = CRC16_BACKEND_BITWISE;
+
+// Montagem antiga (build_modbus_message), mantida aqui para comparação
+static int legacy_build_message(uint8_t *buffer, uint8_t addr, uint8_t func,
+                                const uint8_t *data, int data_len, const char *matricula) {
+    uint8_t *ptr = buffer;
+
+    *ptr++ = addr;
+    *ptr++ = func;
+
+    if (data != NULL && data_len > 0) {
+        memcpy(ptr, data, data_len);
+        ptr += data_len;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        *ptr++ = (uint8_t)matricula[i];
+    }
+
+    int msg_len = ptr - buffer;
+    uint16_t crc = crc16_modbus_with(legacy_crc, CRC16_MODBUS_INIT, buffer, msg_len);
+    *ptr++ = crc & 0xFF;
+    *ptr++ = (crc >> 8) & 0xFF;
+
+    return ptr - buffer;
+}
+
+static int legacy_placar(uint8_t *tx_buffer, const uint16_t *regs) {
+    uint8_t req_data[31];
+    int idx = 0;
+
+    req_data[idx++] = 0x00;
+    req_data[idx++] = 0x00;
+    req_data[idx++] = 0x0D;
+    req_data[idx++] = 0x00;
+    req_data[idx++] = 0x1A;
+    for (int i = 0; i < 13; i++) {
+        req_data[idx++] = regs[i] & 0xFF;
+        req_data[idx++] = (regs[i] >> 8) & 0xFF;
+    }
+
+    return legacy_build_message(tx_buffer, 0x20, 0x10, req_data, sizeof(req_data), MATRICULA);
+}
+
+static int legacy_status(uint8_t *tx_buffer) {
+    uint8_t data[] = { 0x00, 0x00, 0x01, 0x00 };
+
+    return legacy_build_message(tx_buffer, 0x11, 0x03, data, sizeof(data), MATRICULA);
+}
+
+static int inplace_placar(modbus_frame_t *frame, const uint16_t *regs) {
+    modbus_frame_begin(frame, 0x20, 0x10);
+    modbus_frame_put_u16(frame, 0);
+    modbus_frame_put_u16(frame, 13);
+    modbus_frame_put_u8(frame, 26);
+    for (int i = 0; i < 13; i++) {
+        modbus_frame_put_u16(frame, regs[i]);
+    }
+
+    return modbus_frame_finish(frame, MATRICULA);
+}
+
+static int inplace_status(modbus_frame_t *frame) {
+    modbus_frame_begin(frame, 0x11, 0x03);
+    modbus_frame_put_u16(frame, 0);
+    modbus_frame_put_u16(frame, 1);
+
+    return modbus_frame_finish(frame, MATRICULA);
+}
+
+static int64_t time_legacy_placar(uint16_t *regs) {
+    uint8_t buffer[64];
+    int64_t start = now_ns();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        regs[0] = (uint16_t)i;
+        int len = legacy_placar(buffer, regs);
+        bench_sink ^= buffer[len - 1];
+    }
+    return now_ns() - start;
+}
+
+static int64_t time_legacy_status(uint16_t *regs) {
+    uint8_t buffer[64];
+    int64_t start = now_ns();
+
+    (void)regs;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        legacy_status(buffer);
+        bench_sink ^= buffer[11];
+    }
+    return now_ns() - start;
+}
+
+static int64_t time_inplace_placar(uint16_t *regs) {
+    static modbus_frame_t frame;
+    int64_t start = now_ns();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        regs[0] = (uint16_t)i;
+        inplace_placar(&frame, regs);
+        bench_sink ^= frame.buf[frame.len - 1];
+    }
+    return now_ns() - start;
+}
+
+static int64_t time_inplace_status(uint16_t *regs) {
+    static modbus_frame_t frame;
+    int64_t start = now_ns();
+
+    (void)regs;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        inplace_status(&frame);
+        bench_sink ^= frame.buf[11];
+    }
+    return now_ns() - start;
+}
+
+static int64_t best_of(int64_t (*fn)(uint16_t *), uint16_t *regs) {
+    int64_t best = INT64_MAX;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        int64_t elapsed = fn(regs);
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+static void report(const char *name, int64_t elapsed_ns) {
+    printf("  %-40s %8.1f ns/quadro\n", name, (double)elapsed_ns / BENCH_ITERATIONS);
+}
+
+int main(void) {
+    static modbus_frame_t frame;
+    uint8_t legacy_buffer[64];
+    uint16_t regs[13];
+    int null_fd = open("/dev/null", O_WRONLY);
+    int64_t start;
+
+    if (null_fd < 0) {
+        perror("Erro ao abrir /dev/null");
+        return 1;
+    }
+
+    for (int i = 0; i < 13; i++) {
+        regs[i] = (uint16_t)(i * 3 + 1);
+    }
+
+    // Os dois caminhos precisam produzir exatamente os mesmos bytes
+    int legacy_len = legacy_placar(legacy_buffer, regs);
+    int inplace_len = inplace_placar(&frame, regs);
+    if (legacy_len != inplace_len || memcmp(legacy_buffer, frame.buf, legacy_len) != 0) {
+        fprintf(stderr, "Quadros divergentes entre os dois codificadores\n");
+        return 1;
+    }
+
+    printf("Montagem de quadros (%d iterações, melhor de %d rodadas, CRC: %s)\n", BENCH_ITERATIONS,
+           BENCH_ROUNDS, crc16_backend_name(crc16_get_backend()));
+
+    int64_t placar_ns[3];
+    int64_t status_ns[3];
+
+    for (int variant = 0; variant < 2; variant++) {
+        legacy_crc = variant == 0 ? CRC16_BACKEND_BITWISE : crc16_get_backend();
+        placar_ns[variant] = best_of(time_legacy_placar, regs);
+        status_ns[variant] = best_of(time_legacy_status, regs);
+    }
+    placar_ns[2] = best_of(time_inplace_placar, regs);
+    status_ns[2] = best_of(time_inplace_status, regs);
+
+    report("placar 13 regs, antigo", placar_ns[0]);
+    report("placar 13 regs, antigo, CRC rápido", placar_ns[1]);
+    report("placar 13 regs, no buffer", placar_ns[2]);
+    report("leitura de status, antigo", status_ns[0]);
+    report("leitura de status, antigo, CRC rápido", status_ns[1]);
+    report("leitura de status, no buffer", status_ns[2]);
+
+    // Quadros curtos: a chamada indireta do CRC e o fechamento do quadro pesam mais que os bytes
+    if (status_ns[2] > status_ns[1]) {
+        printf("  Atenção: leitura de status %.0f%% mais lenta no buffer que no caminho antigo com o mesmo CRC\n",
+               100.0 * (status_ns[2] - status_ns[1]) / status_ns[1]);
+    }
+
+    printf("Montagem + emissão (write para /dev/null)\n");
+    legacy_crc = CRC16_BACKEND_BITWISE;
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        regs[0] = (uint16_t)i;
+        int len = legacy_placar(legacy_buffer, regs);
+        int total = 0;
+        while (total < len) {
+            int written = write(null_fd, legacy_buffer + total, len - total);
+            if (written < 0) {
+                break;
+            }
+            total += written;
+        }
+    }
+    report("placar 13 regs, antigo", now_ns() - start);
+
+    start = now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        regs[0] = (uint16_t)i;
+        if (write(null_fd, frame.buf, inplace_placar(&frame, regs)) < 0) {
+            break;
+        }
+    }
+    report("placar 13 regs, no buffer", now_ns() - start);
+
+    close(null_fd);
+    return 0;
+}
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bus_capture.h"
+#include "config.h"
+#include "uart.h"
+
+_Static_assert(sizeof(bus_capture_header_t) == 32, "cabeçalho da gravação deve ter 32 bytes");
+_Static_assert(sizeof(bus_capture_record_t) == 24, "registro da gravação deve ter 24 bytes");
+
+#define RECORD_ALIGN 8
+
+static struct {
+    int fd;
+    uint8_t *base;
+    size_t size;
+    uint64_t start_ns;
+    _Atomic size_t offset;
+    atomic_int active;
+    atomic_int writers;  // Gravações em andamento (o fechamento espera por elas)
+    _Atomic uint64_t records;
+    _Atomic uint64_t dropped;
+} cap = {
+    .fd = -1,
+};
+
+/*
+ * Baudrate por porta, lido uma vez. Cada posição guarda o fd nos 32 bits altos
+ * e o baudrate nos baixos (0 = vazia, UINT32_MAX = desconhecido): dois fds na
+ * mesma posição só fazem o baudrate ser lido de novo, nunca o da outra porta.
+ */
+#define PORT_BAUD_SLOTS 256
+static _Atomic uint64_t port_baud[PORT_BAUD_SLOTS];
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static size_t record_size(int len) {
+    return sizeof(bus_capture_record_t) + (((size_t)len + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1));
+}
+
+int bus_capture_open(const char *path, size_t max_bytes) {
+    struct timespec now;
+
+    if (atomic_load(&cap.active)) {
+        fprintf(stderr, "Gravação do barramento já em andamento\n");
+        return -1;
+    }
+    if (max_bytes < sizeof(bus_capture_header_t) + record_size(0)) {
+        fprintf(stderr, "Tamanho da gravação muito pequeno\n");
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Erro ao criar o arquivo de gravação");
+        return -1;
+    }
+
+    // Arquivo esparso: só as páginas escritas ocupam disco
+    if (ftruncate(fd, (off_t)max_bytes) != 0) {
+        perror("Erro ao reservar o arquivo de gravação");
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *base = mmap(NULL, max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("Erro ao mapear o arquivo de gravação");
+        close(fd);
+        return -1;
+    }
+
+    bus_capture_header_t *header = (bus_capture_header_t *)base;
+    memcpy(header->magic, BUS_CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = BUS_CAPTURE_VERSION;
+    header->header_size = sizeof(bus_capture_header_t);
+    clock_gettime(CLOCK_REALTIME, &now);
+    header->start_realtime_ns = (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec;
+
+    cap.fd = fd;
+    cap.base = base;
+    cap.size = max_bytes;
+    cap.start_ns = monotonic_ns();
+    atomic_store(&cap.offset, sizeof(bus_capture_header_t));
+    atomic_store(&cap.records, 0);
+    atomic_store(&cap.dropped, 0);
+    atomic_store(&cap.active, 1);
+    return 0;
+}
+
+void bus_capture_close(void) {
+    if (!atomic_exchange(&cap.active, 0)) {
+        return;
+    }
+
+    // Espera as gravações que já passaram pela verificação de cap.active
+    while (atomic_load(&cap.writers) > 0) {
+        sched_yield();
+    }
+
+    size_t used = atomic_load(&cap.offset);
+    if (used > cap.size) {
+        used = cap.size;
+    }
+
+    munmap(cap.base, cap.size);
+    if (ftruncate(cap.fd, (off_t)used) != 0) {
+        perror("Erro ao ajustar o tamanho da gravação");
+    }
+    close(cap.fd);
+    cap.fd = -1;
+    cap.base = NULL;
+}
+
+int bus_capture_active(void) {
+    return atomic_load_explicit(&cap.active, memory_order_relaxed);
+}
+
+static uint32_t baudrate_of(int port) {
+    _Atomic uint64_t *slot = &port_baud[(unsigned)port % PORT_BAUD_SLOTS];
+    uint64_t entry = atomic_load_explicit(slot, memory_order_relaxed);
+    uint32_t baud = (uint32_t)entry;
+
+    if (baud == 0 || (uint32_t)(entry >> 32) != (uint32_t)port) {
+        int read = uart_get_baudrate(port);
+        baud = read > 0 ? (uint32_t)read : UINT32_MAX;
+        atomic_store_explicit(slot, (uint64_t)(uint32_t)port << 32 | baud, memory_order_relaxed);
+    }
+    return baud != UINT32_MAX ? baud : 0;
+}
+
+void bus_capture_frame(int port, bus_capture_dir_t dir, const uint8_t *data, int len) {
+    if (!atomic_load_explicit(&cap.active, memory_order_relaxed) || len <= 0) {
+        return;
+    }
+
+    atomic_fetch_add(&cap.writers, 1);
+    if (!atomic_load(&cap.active)) {
+        atomic_fetch_sub(&cap.writers, 1);
+        return;
+    }
+
+    if (len > UINT16_MAX) {
+        len = UINT16_MAX;
+    }
+
+    size_t need = record_size(len);
+    size_t at = atomic_fetch_add_explicit(&cap.offset, need, memory_order_relaxed);
+    if (at + need > cap.size) {
+        atomic_fetch_add_explicit(&cap.dropped, 1, memory_order_relaxed);
+        atomic_fetch_sub(&cap.writers, 1);
+        return;
+    }
+
+    bus_capture_record_t *rec = (bus_capture_record_t *)(cap.base + at);
+    rec->timestamp_ns = monotonic_ns() - cap.start_ns;
+    rec->baudrate = baudrate_of(port);
+    rec->port = port;
+    rec->len = (uint16_t)len;
+    memcpy(rec + 1, data, len);
+
+    // dir por último: marca o registro como completo
+    __atomic_store_n(&rec->dir, (uint8_t)dir, __ATOMIC_RELEASE);
+
+    atomic_fetch_add_explicit(&cap.records, 1, memory_order_relaxed);
+    atomic_fetch_sub(&cap.writers, 1);
+}
+
+void bus_capture_port_closed(int port) {
+    _Atomic uint64_t *slot = &port_baud[(unsigned)port % PORT_BAUD_SLOTS];
+    uint64_t entry = atomic_load_explicit(slot, memory_order_relaxed);
+
+    // Só esquece a entrada desta porta; outra que divide a posição fica
+    if ((uint32_t)(entry >> 32) == (uint32_t)port) {
+        atomic_compare_exchange_strong(slot, &entry, 0);
+    }
+}
+
+void bus_capture_get_stats(bus_capture_stats_t *stats) {
+    size_t used = atomic_load(&cap.offset);
+
+    stats->records = atomic_load(&cap.records);
+    stats->dropped = atomic_load(&cap.dropped);
+    stats->bytes = used > cap.size ? cap.size : used;
+}
+
+int bus_capture_load_config(void) {
+    const char *path = config_get("BUS_CAPTURE_FILE");
+    int max_mb = config_get_int("BUS_CAPTURE_MAX_MB", BUS_CAPTURE_DEFAULT_MAX_MB);
+
+    if (path == NULL || path[0] == '\0') {
+        return 0;
+    }
+    if (max_mb <= 0) {
+        max_mb = BUS_CAPTURE_DEFAULT_MAX_MB;
+    }
+
+    return bus_capture_open(path, (size_t)max_mb * 1024 * 1024) == 0 ? 1 : -1;
+}
+
+int bus_capture_reader_open(bus_capture_reader_t *reader, const char *path) {
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Erro ao abrir a gravação");
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(bus_capture_header_t)) {
+        fprintf(stderr, "%s não é uma gravação do barramento\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("Erro ao mapear a gravação");
+        return -1;
+    }
+
+    memcpy(&reader->header, base, sizeof(reader->header));
+    if (memcmp(reader->header.magic, BUS_CAPTURE_MAGIC, sizeof(reader->header.magic)) != 0 ||
+        reader->header.version != BUS_CAPTURE_VERSION ||
+        reader->header.header_size < sizeof(bus_capture_header_t) ||
+        reader->header.header_size > (uint32_t)st.st_size) {
+        fprintf(stderr, "%s não é uma gravação do barramento (versão %d)\n", path, BUS_CAPTURE_VERSION);
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    reader->base = base;
+    reader->size = st.st_size;
+    reader->offset = reader->header.header_size;
+    return 0;
+}
+
+int bus_capture_reader_next(bus_capture_reader_t *reader, bus_capture_record_t *record, const uint8_t **data) {
+    if (reader->offset + sizeof(bus_capture_record_t) > reader->size) {
+        return 0;
+    }
+
+    memcpy(record, reader->base + reader->offset, sizeof(*record));
+    size_t need = record_size(record->len);
+    if (record->dir == BUS_CAPTURE_END || reader->offset + need > reader->size) {
+        return 0;
+    }
+
+    *data = reader->base + reader->offset + sizeof(bus_capture_record_t);
+    reader->offset += need;
+    return 1;
+}
+
+void bus_capture_reader_rewind(bus_capture_reader_t *reader) {
+    reader->offset = reader->header.header_size;
+}
+
+void bus_capture_reader_close(bus_capture_reader_t *reader) {
+    if (reader->base != NULL) {
+        munmap((void *)reader->base, reader->size);
+        reader->base = NULL;
+    }
+}
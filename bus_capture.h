@@ -0,0 +1,141 @@
+#ifndef BUS_CAPTURE_H
+#define BUS_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Gravação do tráfego do barramento em arquivo binário: cada bloco enviado ou
+ * lido da UART vira um registro com instante, direção, porta e baudrate. Os
+ * bytes recebidos são gravados como chegaram (eco, ruído e respostas atrasadas
+ * incluídos), então a gravação pode ser reproduzida pelo modbus_replay contra
+ * a própria biblioteca.
+ *
+ * Formato (little-endian, nativo das plataformas suportadas):
+ *
+ *   bus_capture_header_t                      32 bytes
+ *   bus_capture_record_t + dados              24 bytes + len, alinhado em 8
+ *   ...
+ *   registro com dir = 0                      fim (resto do arquivo zerado)
+ *
+ * A escrita é feita num arquivo mapeado em memória, de tamanho fixo reservado
+ * na abertura: cada registro reserva seu espaço com um incremento atômico e é
+ * copiado direto no mapeamento, sem lock e sem chamada de sistema. O campo dir
+ * é escrito por último, então um processo interrompido deixa no máximo um
+ * registro incompleto, ignorado na leitura. Com o arquivo cheio, os registros
+ * seguintes são descartados e contados.
+ */
+
+#define BUS_CAPTURE_MAGIC "MBUSCAP"
+#define BUS_CAPTURE_VERSION 2
+
+// Tamanho padrão do arquivo (BUS_CAPTURE_MAX_MB)
+#define BUS_CAPTURE_DEFAULT_MAX_MB 64
+
+typedef enum {
+    BUS_CAPTURE_END = 0,  // Sem registro (fim da gravação)
+    BUS_CAPTURE_TX,       // Bytes enviados pela UART
+    BUS_CAPTURE_RX        // Bytes lidos da UART
+} bus_capture_dir_t;
+
+typedef struct {
+    char magic[8];              // BUS_CAPTURE_MAGIC
+    uint32_t version;           // BUS_CAPTURE_VERSION
+    uint32_t header_size;       // sizeof(bus_capture_header_t)
+    int64_t start_realtime_ns;  // Relógio de parede no início da gravação
+    uint64_t reserved;
+} bus_capture_header_t;
+
+typedef struct {
+    uint64_t timestamp_ns;  // Desde o início da gravação (CLOCK_MONOTONIC)
+    uint32_t baudrate;      // Baudrate da porta (0 = desconhecido)
+    int32_t port;           // fd da UART (inteiro: processos com muitos fds abertos passam de 255)
+    uint16_t len;           // Bytes de dados após o registro
+    uint8_t dir;            // bus_capture_dir_t
+    uint8_t reserved[5];
+} bus_capture_record_t;
+
+// Contadores da gravação
+typedef struct {
+    uint64_t records;  // Registros gravados
+    uint64_t bytes;    // Bytes do arquivo em uso
+    uint64_t dropped;  // Registros descartados com o arquivo cheio
+} bus_capture_stats_t;
+
+/**
+ * @brief Inicia a gravação (substitui o arquivo, se existir)
+ * @param path Caminho do arquivo
+ * @param max_bytes Tamanho reservado para a gravação
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int bus_capture_open(const char *path, size_t max_bytes);
+
+/**
+ * @brief Encerra a gravação e reduz o arquivo ao tamanho usado
+ */
+void bus_capture_close(void);
+
+/**
+ * @brief Indica se há gravação em andamento
+ */
+int bus_capture_active(void);
+
+/**
+ * @brief Grava um bloco enviado ou recebido (sem efeito fora de uma gravação)
+ * @param port fd da UART
+ * @param dir BUS_CAPTURE_TX ou BUS_CAPTURE_RX
+ * @param data Bytes do bloco
+ * @param len Tamanho do bloco
+ */
+void bus_capture_frame(int port, bus_capture_dir_t dir, const uint8_t *data, int len);
+
+/**
+ * @brief Esquece o baudrate guardado de uma porta (chamada ao fechar a UART)
+ */
+void bus_capture_port_closed(int port);
+
+/**
+ * @brief Lê os contadores da gravação atual
+ */
+void bus_capture_get_stats(bus_capture_stats_t *stats);
+
+/**
+ * @brief Inicia a gravação conforme BUS_CAPTURE_FILE e BUS_CAPTURE_MAX_MB
+ * @return 1 se a gravação foi iniciada, 0 se desabilitada, -1 em caso de erro
+ */
+int bus_capture_load_config(void);
+
+// Leitura de uma gravação (arquivo mapeado só para leitura)
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    size_t offset;
+    bus_capture_header_t header;
+} bus_capture_reader_t;
+
+/**
+ * @brief Abre uma gravação para leitura
+ * @return 0 em caso de sucesso, -1 se o arquivo não existe ou não é uma gravação
+ *         desta versão do formato
+ */
+int bus_capture_reader_open(bus_capture_reader_t *reader, const char *path);
+
+/**
+ * @brief Próximo registro
+ * @param record Cabeçalho do registro
+ * @param data Ponteiro para os bytes do registro (dentro do mapeamento)
+ * @return 1 se há registro, 0 no fim da gravação
+ */
+int bus_capture_reader_next(bus_capture_reader_t *reader, bus_capture_record_t *record, const uint8_t **data);
+
+/**
+ * @brief Volta ao primeiro registro
+ */
+void bus_capture_reader_rewind(bus_capture_reader_t *reader);
+
+/**
+ * @brief Fecha a gravação aberta para leitura
+ */
+void bus_capture_reader_close(bus_capture_reader_t *reader);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+
+#define CONFIG_MAX_ENTRIES 128
+#define CONFIG_KEY_LEN     64
+#define CONFIG_VALUE_LEN   128
+
+typedef struct {
+    char key[CONFIG_KEY_LEN];
+    char value[CONFIG_VALUE_LEN];
+} config_entry_t;
+
+static config_entry_t entries[CONFIG_MAX_ENTRIES];
+static int num_entries = 0;
+
+static char *trim(char *str) {
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+
+    return str;
+}
+
+int config_set(const char *key, const char *value) {
+    for (int i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].key, key) == 0) {
+            snprintf(entries[i].value, CONFIG_VALUE_LEN, "%s", value);
+            return 0;
+        }
+    }
+
+    if (num_entries >= CONFIG_MAX_ENTRIES) {
+        fprintf(stderr, "Configuração: limite de %d chaves atingido\n", CONFIG_MAX_ENTRIES);
+        return -1;
+    }
+
+    snprintf(entries[num_entries].key, CONFIG_KEY_LEN, "%s", key);
+    snprintf(entries[num_entries].value, CONFIG_VALUE_LEN, "%s", value);
+    num_entries++;
+
+    return 0;
+}
+
+int config_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    char line[256];
+    int count = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+
+        char *eq = strchr(line, '=');
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+
+        char *key = trim(line);
+        char *value = trim(eq + 1);
+        size_t value_len = strlen(value);
+
+        if (value_len >= 2 && (value[0] == '"' || value[0] == '\'') && value[value_len - 1] == value[0]) {
+            value[value_len - 1] = '\0';
+            value++;
+        }
+
+        if (*key == '\0') {
+            continue;
+        }
+
+        if (config_set(key, value) == 0) {
+            count++;
+        }
+    }
+
+    fclose(fp);
+    return count;
+}
+
+const char *config_get(const char *key) {
+    const char *env = getenv(key);
+    if (env != NULL) {
+        return env;
+    }
+
+    for (int i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].key, key) == 0) {
+            return entries[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+long config_get_int(const char *key, long default_value) {
+    const char *value = config_get(key);
+    if (value == NULL || *value == '\0') {
+        return default_value;
+    }
+
+    char *end;
+    long result = strtol(value, &end, 0);
+    if (*end != '\0') {
+        return default_value;
+    }
+
+    return result;
+}
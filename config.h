@@ -0,0 +1,41 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**
+ * @brief Carrega um arquivo de configuração no formato .env (CHAVE=VALOR)
+ *
+ * Linhas vazias e comentários (#) são ignorados. Valores podem estar entre
+ * aspas. Chaves repetidas sobrescrevem as anteriores.
+ *
+ * @param path Caminho do arquivo (ex: ".env")
+ * @return Número de chaves lidas ou -1 em caso de erro
+ */
+int config_load(const char *path);
+
+/**
+ * @brief Lê o valor de uma chave
+ *
+ * Variáveis de ambiente têm precedência sobre o arquivo carregado.
+ *
+ * @param key Nome da chave
+ * @return Valor da chave ou NULL se não definida
+ */
+const char *config_get(const char *key);
+
+/**
+ * @brief Lê o valor inteiro de uma chave (aceita decimal e 0x hexadecimal)
+ * @param key Nome da chave
+ * @param default_value Valor retornado se a chave não existir ou for inválida
+ * @return Valor da chave ou default_value
+ */
+long config_get_int(const char *key, long default_value);
+
+/**
+ * @brief Define (ou sobrescreve) o valor de uma chave
+ * @param key Nome da chave
+ * @param value Valor
+ * @return 0 em caso de sucesso, -1 se a tabela estiver cheia
+ */
+int config_set(const char *key, const char *value);
+
+#endif
@@ -3,6 +3,21 @@
 
 #include <stdint.h>
 
+// Valor inicial do CRC16 MODBUS
+#define CRC16_MODBUS_INIT 0xFFFF
+
+// Implementações disponíveis do CRC16
+typedef enum {
+    CRC16_BACKEND_BITWISE = 0,  // Referência: 8 passos shift/xor por byte
+    CRC16_BACKEND_TABLE,        // Tabela de 256 entradas (1 byte por passo)
+    CRC16_BACKEND_SLICE8,       // Slicing-by-8 (8 bytes por passo)
+    CRC16_BACKEND_CLMUL,        // Folding com multiplicação sem carry (PCLMUL/PMULL)
+    CRC16_BACKEND_COUNT
+} crc16_backend_t;
+
+// Tabela de 256 entradas (preenchida por crc16_init)
+extern uint16_t crc16_table[256];
+
 /**
  * @brief Calcula o CRC16 MODBUS
  * @param data Ponteiro para os dados
@@ -11,4 +26,66 @@
  */
 uint16_t crc16_modbus(const uint8_t *data, int len);
 
+/**
+ * @brief Continua um cálculo de CRC16 MODBUS a partir de um valor parcial
+ * @param crc CRC parcial (CRC16_MODBUS_INIT no início da mensagem)
+ * @param data Ponteiro para os dados
+ * @param len Tamanho dos dados em bytes
+ * @return CRC16 atualizado
+ */
+uint16_t crc16_modbus_update(uint16_t crc, const uint8_t *data, int len);
+
+/**
+ * @brief Atualiza o CRC16 MODBUS com um único byte (via tabela)
+ * @param crc CRC parcial
+ * @param byte Byte a acumular
+ * @return CRC16 atualizado
+ */
+static inline uint16_t crc16_modbus_byte(uint16_t crc, uint8_t byte) {
+    return (uint16_t)((crc >> 8) ^ crc16_table[(crc ^ byte) & 0xFF]);
+}
+
+/**
+ * @brief Inicializa as tabelas, verifica cada implementação contra a
+ *        referência bit a bit e seleciona a mais rápida aprovada, medida
+ *        em quadros de 8 a 256 bytes.
+ *        Chamada automaticamente na carga do programa; pode ser chamada
+ *        novamente sem efeito. A variável de ambiente CRC16_BACKEND
+ *        (bitwise, table, slice8, clmul) força uma implementação.
+ */
+void crc16_init(void);
+
+/**
+ * @brief Calcula o CRC com uma implementação específica
+ * @param backend Implementação a usar
+ * @param crc CRC parcial (CRC16_MODBUS_INIT no início da mensagem)
+ * @param data Ponteiro para os dados
+ * @param len Tamanho dos dados em bytes
+ * @return CRC16 atualizado
+ */
+uint16_t crc16_modbus_with(crc16_backend_t backend, uint16_t crc, const uint8_t *data, int len);
+
+/**
+ * @brief Seleciona a implementação usada por crc16_modbus()
+ * @param backend Implementação desejada
+ * @return 0 em caso de sucesso, -1 se indisponível ou reprovada na verificação
+ */
+int crc16_set_backend(crc16_backend_t backend);
+
+/**
+ * @brief Retorna a implementação em uso
+ */
+crc16_backend_t crc16_get_backend(void);
+
+/**
+ * @brief Indica se a implementação é suportada pela CPU e passou na verificação
+ * @return 1 se disponível, 0 caso contrário
+ */
+int crc16_backend_available(crc16_backend_t backend);
+
+/**
+ * @brief Nome textual da implementação
+ */
+const char *crc16_backend_name(crc16_backend_t backend);
+
 #endif
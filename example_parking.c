@@ -4,6 +4,12 @@
 #include <unistd.h>
 #include "modbus_parking.h"
 #include "uart.h"
+#include "config.h"
+#include "lpr_capture.h"
+#include "trace.h"
+#include "metrics.h"
+#include "retry.h"
+#include "bus_capture.h"
 
 // Matrícula do aluno (últimos 4 dígitos)
 #define MATRICULA "6383"
@@ -14,7 +20,10 @@ void test_camera_entrada(int uart_fd) {
     lpr_data_t data;
     
     // Captura placa com retry (máx 3 tentativas, timeout 2000ms)
-    if (lpr_capture_plate(uart_fd, CAMERA_ENTRADA_ADDR, MATRICULA, &data, 3, 2000) == 0) {
+    int ret = lpr_capture_plate(uart_fd, CAMERA_ENTRADA_ADDR, MATRICULA, &data, 3, 2000);
+    trace_drain(stdout);
+    
+    if (ret == 0) {
         printf("\n✓ Captura bem-sucedida!\n");
         printf("  Placa: %s\n", data.placa);
         printf("  Confiança: %d%%\n", data.confianca);
@@ -31,7 +40,10 @@ void test_camera_saida(int uart_fd) {
     lpr_data_t data;
     
     // Captura placa com retry (máx 3 tentativas, timeout 2000ms)
-    if (lpr_capture_plate(uart_fd, CAMERA_SAIDA_ADDR, MATRICULA, &data, 3, 2000) == 0) {
+    int ret = lpr_capture_plate(uart_fd, CAMERA_SAIDA_ADDR, MATRICULA, &data, 3, 2000);
+    trace_drain(stdout);
+    
+    if (ret == 0) {
         printf("\n✓ Captura bem-sucedida!\n");
         printf("  Placa: %s\n", data.placa);
         printf("  Confiança: %d%%\n", data.confianca);
@@ -42,6 +54,27 @@ void test_camera_saida(int uart_fd) {
     }
 }
 
+void test_cameras_simultaneas(int uart_fd) {
+    printf("\n========== TESTE CAPTURA SIMULTÂNEA (0x11 + 0x12) ==========\n");
+    
+    lpr_capture_t caps[2];
+    
+    // As duas capturas compartilham o barramento de forma intercalada
+    lpr_capture_init(&caps[0], CAMERA_ENTRADA_ADDR, 3, 2000);
+    lpr_capture_init(&caps[1], CAMERA_SAIDA_ADDR, 3, 2000);
+    lpr_capture_run(uart_fd, MATRICULA, caps, 2);
+    trace_drain(stdout);
+    
+    for (int i = 0; i < 2; i++) {
+        if (caps[i].state == LPR_CAPTURE_DONE) {
+            printf("\n✓ Câmera 0x%02X: placa %s (confiança %d%%)\n",
+                   caps[i].camera_addr, caps[i].data.placa, caps[i].data.confianca);
+        } else {
+            printf("\n✗ Câmera 0x%02X: falha na captura da placa\n", caps[i].camera_addr);
+        }
+    }
+}
+
 void test_placar(int uart_fd) {
     printf("\n========== TESTE PLACAR DE VAGAS (0x20) ==========\n");
     
@@ -61,7 +94,10 @@ void test_placar(int uart_fd) {
         .flags = 0x04  // bit2 = 1 (2º andar lotado)
     };
     
-    if (placar_update(uart_fd, MATRICULA, &placar) == 0) {
+    int ret = placar_update(uart_fd, MATRICULA, &placar);
+    trace_drain(stdout);
+    
+    if (ret == 0) {
         printf("\n✓ Placar atualizado com sucesso!\n");
         printf("  Vagas livres Térreo: PNE=%d, Idoso=%d, Comuns=%d\n", 
                placar.vagas_terreo_pne, placar.vagas_terreo_idoso, placar.vagas_terreo_comuns);
@@ -79,6 +115,17 @@ void test_placar(int uart_fd) {
 
 int main(int argc, char *argv[]) {
     const char *uart_device = "/dev/serial0";
+    uart_config_t uart_config;
+    int config_loaded = config_load(".env") >= 0;
+    
+    // Parâmetros da linha: padrão, sobrescritos pelo .env
+    uart_config_default(&uart_config);
+    if (config_loaded) {
+        uart_load_config(&uart_config);
+        if (config_get("UART_DEVICE") != NULL) {
+            uart_device = config_get("UART_DEVICE");
+        }
+    }
     
     // Permite especificar dispositivo UART via argumento
     if (argc > 1) {
@@ -89,11 +136,27 @@ int main(int argc, char *argv[]) {
     printf("  TESTE DO SISTEMA MODBUS - ESTACIONAMENTO\n");
     printf("=================================================\n");
     printf("Dispositivo UART: %s\n", uart_device);
+    printf("Linha: %d %d%c%d\n", uart_config.baudrate, uart_config.data_bits,
+           uart_config.parity, uart_config.stop_bits);
     printf("Matrícula: %s\n", MATRICULA);
     printf("=================================================\n");
     
+    // Parâmetros do barramento (perfis de tempo por dispositivo)
+    if (config_loaded) {
+        int overrides = modbus_load_timing_config();
+        placar_load_config();
+        retry_load_config();
+        lpr_capture_load_config();
+        trace_load_config();
+        metrics_load_config(stderr);
+        if (bus_capture_load_config() > 0) {
+            printf("Gravando o barramento em %s\n", config_get("BUS_CAPTURE_FILE"));
+        }
+        printf("Configuração .env carregada (%d perfis de tempo por dispositivo)\n", overrides);
+    }
+    
     // Abre a UART
-    int uart_fd = open_uart(uart_device);
+    int uart_fd = open_uart_config(uart_device, &uart_config);
     if (uart_fd < 0) {
         fprintf(stderr, "Erro ao abrir UART %s\n", uart_device);
         return 1;
@@ -110,6 +173,8 @@ int main(int argc, char *argv[]) {
         printf("2 - Testar Câmera de Saída (0x12)\n");
         printf("3 - Testar Placar de Vagas (0x20)\n");
         printf("4 - Executar todos os testes\n");
+        printf("5 - Captura simultânea entrada + saída\n");
+        printf("6 - Mostrar métricas do barramento\n");
         printf("0 - Sair\n");
         printf("=================================================\n");
         printf("Escolha uma opção: ");
@@ -137,6 +202,12 @@ int main(int argc, char *argv[]) {
                 sleep(1);
                 test_placar(uart_fd);
                 break;
+            case 5:
+                test_cameras_simultaneas(uart_fd);
+                break;
+            case 6:
+                metrics_dump_text(stdout);
+                break;
             case 0:
                 printf("\nEncerrando...\n");
                 break;
@@ -147,6 +218,8 @@ int main(int argc, char *argv[]) {
     } while (opcao != 0);
     
     // Fecha a UART
+    metrics_stop_dump();
+    bus_capture_close();
     close_uart(uart_fd);
     printf("✓ UART fechada\n");
     
@@ -0,0 +1,828 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "lpr_capture.h"
+#include "trace.h"
+#include "metrics.h"
+#include "retry.h"
+#include "config.h"
+#include "uart.h"
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Argumentos dos eventos de captura no trace
+static int format_trigger_fail(const trace_record_t *rec, char *buffer, int size) {
+    return snprintf(buffer, size, ": %s", modbus_error_name((modbus_error_t)rec->arg0));
+}
+
+static int format_capture_cached(const trace_record_t *rec, char *buffer, int size) {
+    if (rec->arg1 == LPR_CACHE_HIT) {
+        return snprintf(buffer, size, ": placa de %d ms atrás (debounce)", rec->arg0);
+    }
+    if (rec->arg1 == LPR_CACHE_TIMEOUT) {
+        return snprintf(buffer, size, ": prazo esgotado esperando a captura em andamento");
+    }
+    return snprintf(buffer, size, ": unida à captura em andamento");
+}
+
+__attribute__((constructor))
+static void lpr_capture_register_trace(void) {
+    trace_register_formatter(TRACE_EV_TRIGGER_FAIL, format_trigger_fail);
+    trace_register_formatter(TRACE_EV_CAPTURE_CACHED, format_capture_cached);
+}
+
+/*
+ * Estimativa por câmera no estilo do RTO do TCP: média e desvio móveis em µs
+ * (pesos 1/8 e 1/4). Protegida por mutex: é atualizada uma vez por captura.
+ * A chave é a porta (fd) e o endereço: portas diferentes podem ter câmeras
+ * com o mesmo endereço.
+ */
+typedef struct {
+    int uart_fd;
+    uint8_t addr;
+    int samples;
+    int64_t mean_us;
+    int64_t deviation_us;
+} processing_estimate_t;
+
+// Backoff entre tentativas de captura (com jitter)
+static const retry_policy_t capture_backoff = {
+    .max_attempts = 0,
+    .base_backoff_ms = 200,
+    .max_backoff_ms = 2000,
+};
+
+static int capture_sla_ms;
+
+/*
+ * Resets do trigger adiados pelo modo rápido, por câmera (porta e endereço,
+ * como as estimativas). pending_reset_count deixa as threads ociosas saberem
+ * sem lock se há algum.
+ */
+typedef struct {
+    int uart_fd;
+    uint8_t addr;
+    int pending;
+} pending_reset_t;
+
+static pending_reset_t pending_resets[LPR_MAX_CAMERAS];
+static int pending_reset_slots;
+static atomic_int pending_reset_count;
+static pthread_mutex_t pending_resets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static processing_estimate_t estimates[LPR_MAX_CAMERAS];
+static int estimate_count;
+static pthread_mutex_t estimates_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Chamada com estimates_lock
+static processing_estimate_t *find_estimate(int uart_fd, uint8_t addr, int create) {
+    for (int i = 0; i < estimate_count; i++) {
+        if (estimates[i].uart_fd == uart_fd && estimates[i].addr == addr) {
+            return &estimates[i];
+        }
+    }
+
+    if (!create || estimate_count >= LPR_MAX_CAMERAS) {
+        return NULL;
+    }
+
+    processing_estimate_t *est = &estimates[estimate_count++];
+    memset(est, 0, sizeof(*est));
+    est->uart_fd = uart_fd;
+    est->addr = addr;
+    return est;
+}
+
+static void record_processing_time(int uart_fd, uint8_t addr, int64_t sample_us) {
+    pthread_mutex_lock(&estimates_lock);
+
+    processing_estimate_t *est = find_estimate(uart_fd, addr, 1);
+    if (est != NULL) {
+        if (est->samples == 0) {
+            est->mean_us = sample_us;
+            est->deviation_us = sample_us / 2;
+        } else {
+            int64_t err = sample_us - est->mean_us;
+            est->mean_us += err / 8;
+            est->deviation_us += ((err < 0 ? -err : err) - est->deviation_us) / 4;
+        }
+        est->samples++;
+    }
+
+    pthread_mutex_unlock(&estimates_lock);
+}
+
+void lpr_capture_get_estimate(int uart_fd, uint8_t camera_addr, lpr_processing_estimate_t *estimate) {
+    pthread_mutex_lock(&estimates_lock);
+
+    processing_estimate_t *est = find_estimate(uart_fd, camera_addr, 0);
+    estimate->samples = est ? est->samples : 0;
+    estimate->mean_ms = est ? (int)(est->mean_us / 1000) : 0;
+    estimate->deviation_ms = est ? (int)(est->deviation_us / 1000) : 0;
+
+    pthread_mutex_unlock(&estimates_lock);
+}
+
+void lpr_capture_reset_estimates(void) {
+    pthread_mutex_lock(&estimates_lock);
+    estimate_count = 0;
+    pthread_mutex_unlock(&estimates_lock);
+}
+
+void lpr_capture_set_sla_ms(int sla_ms) {
+    capture_sla_ms = sla_ms;
+}
+
+void lpr_capture_load_config(void) {
+    lpr_capture_set_sla_ms(config_get_int("LPR_CAPTURE_SLA_MS", 0));
+    lpr_capture_set_debounce(config_get_int("LPR_DEBOUNCE_MS", 0),
+                             config_get_int("LPR_MIN_CONFIDENCE", LPR_DEFAULT_MIN_CONFIDENCE));
+}
+
+/*
+ * Cache de resultados por câmera (porta e endereço, como as estimativas). Um
+ * novo pedido dentro da janela de debounce recebe a última placa com
+ * confiança suficiente; pedidos que chegam com uma captura em andamento na
+ * mesma câmera esperam por ela (condvar) em vez de disparar outra.
+ */
+typedef struct {
+    int uart_fd;
+    uint8_t addr;
+    int valid;            // data pode ser reaproveitado (confiança suficiente)
+    lpr_data_t data;
+    int64_t captured_us;  // Fim da captura que gerou data
+    int in_flight;        // Há uma captura em andamento
+    uint64_t generation;  // Incrementado a cada captura concluída
+    int last_result;      // Resultado da última captura concluída
+    lpr_data_t last_data;
+} plate_cache_entry_t;
+
+static plate_cache_entry_t plate_cache[LPR_MAX_CAMERAS];
+static int plate_cache_count;
+static int debounce_ms;
+static int min_confidence = LPR_DEFAULT_MIN_CONFIDENCE;
+static pthread_mutex_t plate_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t plate_cache_done;  // Em CLOCK_MONOTONIC (lpr_capture_init_cache)
+
+__attribute__((constructor))
+static void lpr_capture_init_cache(void) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&plate_cache_done, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Até quando esperar uma captura em andamento: o prazo que a do chamador teria
+static int64_t join_deadline(const lpr_capture_t *cap) {
+    int64_t deadline = cap->deadline_us;
+    int64_t thread_deadline = retry_get_deadline();
+
+    if (thread_deadline != 0 && (deadline == 0 || thread_deadline < deadline)) {
+        deadline = thread_deadline;
+    }
+    if (deadline == 0) {
+        deadline = monotonic_us() + (int64_t)cap->max_retries * cap->timeout_ms * 1000;
+    }
+    return deadline;
+}
+
+// Chamada com plate_cache_lock
+static plate_cache_entry_t *find_cache_entry(int uart_fd, uint8_t addr) {
+    for (int i = 0; i < plate_cache_count; i++) {
+        if (plate_cache[i].uart_fd == uart_fd && plate_cache[i].addr == addr) {
+            return &plate_cache[i];
+        }
+    }
+
+    // Entrada liberada por close_uart() ou uma nova no fim da tabela
+    plate_cache_entry_t *entry = NULL;
+    for (int i = 0; i < plate_cache_count && entry == NULL; i++) {
+        if (plate_cache[i].uart_fd < 0) {
+            entry = &plate_cache[i];
+        }
+    }
+    if (entry == NULL) {
+        if (plate_cache_count >= LPR_MAX_CAMERAS) {
+            return NULL;
+        }
+        entry = &plate_cache[plate_cache_count++];
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->uart_fd = uart_fd;
+    entry->addr = addr;
+    return entry;
+}
+
+void lpr_capture_set_debounce(int window_ms, int confidence) {
+    pthread_mutex_lock(&plate_cache_lock);
+    debounce_ms = window_ms;
+    min_confidence = confidence;
+    pthread_mutex_unlock(&plate_cache_lock);
+}
+
+lpr_cache_result_t lpr_capture_cache_begin(int uart_fd, const lpr_capture_t *cap, lpr_data_t *data,
+                                           int *result) {
+    uint8_t camera_addr = cap->camera_addr;
+
+    pthread_mutex_lock(&plate_cache_lock);
+
+    plate_cache_entry_t *entry = find_cache_entry(uart_fd, camera_addr);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&plate_cache_lock);
+        return LPR_CACHE_MISS;
+    }
+
+    int64_t now = monotonic_us();
+    if (entry->valid && debounce_ms > 0 && now - entry->captured_us < (int64_t)debounce_ms * 1000) {
+        *data = entry->data;
+        *result = 0;
+        pthread_mutex_unlock(&plate_cache_lock);
+        TRACE_INFO(TRACE_EV_CAPTURE_CACHED, camera_addr, 0, (int32_t)((now - entry->captured_us) / 1000),
+                   LPR_CACHE_HIT);
+        return LPR_CACHE_HIT;
+    }
+
+    if (entry->in_flight) {
+        uint64_t generation = entry->generation;
+        int64_t deadline = join_deadline(cap);
+        struct timespec ts = { .tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000 };
+
+        while (entry->generation == generation) {
+            if (pthread_cond_timedwait(&plate_cache_done, &plate_cache_lock, &ts) == ETIMEDOUT &&
+                entry->generation == generation) {
+                *result = -1;
+                pthread_mutex_unlock(&plate_cache_lock);
+                TRACE_ERROR(TRACE_EV_CAPTURE_CACHED, camera_addr, 0, 0, LPR_CACHE_TIMEOUT);
+                return LPR_CACHE_TIMEOUT;
+            }
+        }
+        *data = entry->last_data;
+        *result = entry->last_result;
+        pthread_mutex_unlock(&plate_cache_lock);
+        TRACE_INFO(TRACE_EV_CAPTURE_CACHED, camera_addr, 0, 0, LPR_CACHE_JOINED);
+        return LPR_CACHE_JOINED;
+    }
+
+    entry->in_flight = 1;
+    pthread_mutex_unlock(&plate_cache_lock);
+    return LPR_CACHE_MISS;
+}
+
+void lpr_capture_cache_end(int uart_fd, uint8_t camera_addr, int result, const lpr_data_t *data) {
+    pthread_mutex_lock(&plate_cache_lock);
+
+    plate_cache_entry_t *entry = find_cache_entry(uart_fd, camera_addr);
+    if (entry != NULL) {
+        entry->in_flight = 0;
+        entry->generation++;
+        entry->last_result = result;
+        if (result == 0) {
+            entry->last_data = *data;
+            if (data->confianca >= min_confidence) {
+                entry->data = *data;
+                entry->captured_us = monotonic_us();
+                entry->valid = 1;
+            }
+        }
+        pthread_cond_broadcast(&plate_cache_done);
+    }
+
+    pthread_mutex_unlock(&plate_cache_lock);
+}
+
+void lpr_capture_cache_invalidate(uint8_t camera_addr) {
+    pthread_mutex_lock(&plate_cache_lock);
+    for (int i = 0; i < plate_cache_count; i++) {
+        if (plate_cache[i].addr == camera_addr) {
+            plate_cache[i].valid = 0;
+        }
+    }
+    pthread_mutex_unlock(&plate_cache_lock);
+}
+
+/*
+ * Esquece o que foi aprendido sobre as câmeras de uart_fd (close_uart): o fd
+ * pode voltar para outra porta, com outras câmeras nos mesmos endereços. Uma
+ * entrada do cache com captura em andamento fica até lpr_capture_cache_end(),
+ * sem placa reaproveitável.
+ */
+static void lpr_capture_port_closed(int uart_fd) {
+    pthread_mutex_lock(&plate_cache_lock);
+    for (int i = 0; i < plate_cache_count; i++) {
+        if (plate_cache[i].uart_fd == uart_fd) {
+            plate_cache[i].valid = 0;
+            if (!plate_cache[i].in_flight) {
+                plate_cache[i].uart_fd = -1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&plate_cache_lock);
+
+    pthread_mutex_lock(&estimates_lock);
+    int kept = 0;
+    for (int i = 0; i < estimate_count; i++) {
+        if (estimates[i].uart_fd != uart_fd) {
+            estimates[kept++] = estimates[i];
+        }
+    }
+    estimate_count = kept;
+    pthread_mutex_unlock(&estimates_lock);
+
+    pthread_mutex_lock(&pending_resets_lock);
+    for (int i = 0; i < pending_reset_slots; i++) {
+        if (pending_resets[i].pending && pending_resets[i].uart_fd == uart_fd) {
+            pending_resets[i].pending = 0;
+            atomic_fetch_sub(&pending_reset_count, 1);
+        }
+    }
+    pthread_mutex_unlock(&pending_resets_lock);
+}
+
+__attribute__((constructor))
+static void lpr_capture_register_close_hook(void) {
+    uart_register_close_hook(lpr_capture_port_closed);
+}
+
+void lpr_capture_set_deadline(lpr_capture_t *cap, int64_t deadline_us) {
+    cap->deadline_us = deadline_us;
+}
+
+void lpr_capture_init(lpr_capture_t *cap, uint8_t camera_addr, int max_retries, int timeout_ms) {
+    cap->camera_addr = camera_addr;
+    cap->max_retries = max_retries;
+    cap->timeout_ms = timeout_ms;
+    cap->state = max_retries > 0 ? LPR_CAPTURE_TRIGGER : LPR_CAPTURE_FAILED;
+    cap->retry = 0;
+    cap->poll_count = 0;
+    cap->next_action_us = monotonic_us();
+    cap->trigger_us = 0;
+    cap->last_busy_us = 0;
+    cap->poll_interval_us = LPR_POLL_MIN_MS * 1000;
+    cap->deadline_us = retry_deadline_after_ms(capture_sla_ms);
+    cap->fast_path = 0;
+    retry_reset(&cap->txn_retry);
+}
+
+void lpr_capture_set_fast_path(lpr_capture_t *cap, int enable) {
+    cap->fast_path = enable;
+}
+
+int lpr_capture_reset_pending(void) {
+    return atomic_load_explicit(&pending_reset_count, memory_order_relaxed) > 0;
+}
+
+// Chamada com pending_resets_lock
+static pending_reset_t *find_pending_reset(int uart_fd, uint8_t addr) {
+    for (int i = 0; i < pending_reset_slots; i++) {
+        if (pending_resets[i].pending && pending_resets[i].uart_fd == uart_fd && pending_resets[i].addr == addr) {
+            return &pending_resets[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Marca o reset de addr em uart_fd como pendente. Retorna -1 com a tabela
+ * cheia: a captura faz o reset na hora.
+ */
+static int mark_reset(int uart_fd, uint8_t addr) {
+    int ret = 0;
+
+    pthread_mutex_lock(&pending_resets_lock);
+    if (find_pending_reset(uart_fd, addr) == NULL) {
+        pending_reset_t *slot = NULL;
+        for (int i = 0; i < pending_reset_slots && slot == NULL; i++) {
+            if (!pending_resets[i].pending) {
+                slot = &pending_resets[i];
+            }
+        }
+        if (slot == NULL && pending_reset_slots < LPR_MAX_CAMERAS) {
+            slot = &pending_resets[pending_reset_slots++];
+        }
+
+        if (slot != NULL) {
+            slot->uart_fd = uart_fd;
+            slot->addr = addr;
+            slot->pending = 1;
+            atomic_fetch_add(&pending_reset_count, 1);
+        } else {
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&pending_resets_lock);
+    return ret;
+}
+
+// Retira o reset pendente de addr em uart_fd; retorna 1 se havia um
+static int take_reset(int uart_fd, uint8_t addr) {
+    pthread_mutex_lock(&pending_resets_lock);
+    pending_reset_t *entry = find_pending_reset(uart_fd, addr);
+    if (entry != NULL) {
+        entry->pending = 0;
+        atomic_fetch_sub(&pending_reset_count, 1);
+    }
+    pthread_mutex_unlock(&pending_resets_lock);
+    return entry != NULL;
+}
+
+// Endereço de um reset pendente em uart_fd, ou -1
+static int next_pending_reset(int uart_fd, int after) {
+    int addr = -1;
+
+    pthread_mutex_lock(&pending_resets_lock);
+    for (int i = 0; i < pending_reset_slots; i++) {
+        if (pending_resets[i].pending && pending_resets[i].uart_fd == uart_fd && pending_resets[i].addr > after &&
+            (addr < 0 || pending_resets[i].addr < addr)) {
+            addr = pending_resets[i].addr;
+        }
+    }
+    pthread_mutex_unlock(&pending_resets_lock);
+    return addr;
+}
+
+/*
+ * Faz o reset adiado de addr em uart_fd, se houver. Quem retira a marca faz o
+ * reset; se falhar, volta a ficar pendente. Retorna 1 se fez o reset com
+ * sucesso.
+ */
+static int flush_reset(int uart_fd, const char *matricula, uint8_t addr) {
+    if (!take_reset(uart_fd, addr)) {
+        return 0;
+    }
+    if (lpr_reset_trigger(uart_fd, addr, matricula) != 0) {
+        mark_reset(uart_fd, addr);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Indica se há reset pendente de addr em uart_fd
+static int reset_is_pending(int uart_fd, uint8_t addr) {
+    if (!lpr_capture_reset_pending()) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pending_resets_lock);
+    int pending = find_pending_reset(uart_fd, addr) != NULL;
+    pthread_mutex_unlock(&pending_resets_lock);
+    return pending;
+}
+
+int lpr_capture_flush_resets(int uart_fd, const char *matricula) {
+    int ret = 0;
+
+    for (int addr = next_pending_reset(uart_fd, -1); addr >= 0; addr = next_pending_reset(uart_fd, addr)) {
+        if (!flush_reset(uart_fd, matricula, (uint8_t)addr)) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int lpr_capture_flush_one_reset(int uart_fd, const char *matricula) {
+    if (!lpr_capture_reset_pending()) {
+        return 0;
+    }
+
+    int addr = next_pending_reset(uart_fd, -1);
+    if (addr < 0) {
+        return 0;
+    }
+
+    // Uma tentativa só: o reset continua pendente e sai na próxima folga
+    retry_t retry;
+    retry_reset(&retry);
+    retry_t *previous = retry_attach(&retry);
+    int ret = flush_reset(uart_fd, matricula, (uint8_t)addr);
+    retry_attach(previous);
+    return ret;
+}
+
+int lpr_capture_finished(const lpr_capture_t *cap) {
+    return cap->state == LPR_CAPTURE_DONE || cap->state == LPR_CAPTURE_FAILED;
+}
+
+static void capture_deadline_expired(lpr_capture_t *cap) {
+    TRACE_ERROR(TRACE_EV_CAPTURE_DEADLINE, cap->camera_addr, 0, cap->retry + 1, 0);
+    cap->state = LPR_CAPTURE_FAILED;
+}
+
+// Instante limite para o próximo passo: o menor entre o prazo da tentativa e o da captura
+static int64_t capture_limit(const lpr_capture_t *cap, int64_t attempt_deadline) {
+    if (cap->deadline_us != 0 && cap->deadline_us < attempt_deadline) {
+        return cap->deadline_us;
+    }
+    return attempt_deadline;
+}
+
+/*
+ * Encerra a tentativa atual e agenda a próxima com backoff exponencial com
+ * jitter. Erros não transitórios (exceção do escravo, falha de E/S) e
+ * esperas que passariam do prazo da captura encerram a captura.
+ */
+static void capture_attempt_failed(lpr_capture_t *cap, int64_t now, int retryable) {
+    cap->retry++;
+
+    if (!retryable || cap->retry >= cap->max_retries) {
+        TRACE_INFO(TRACE_EV_CAPTURE_FAILED, cap->camera_addr, 0, cap->retry, 0);
+        cap->state = LPR_CAPTURE_FAILED;
+        return;
+    }
+
+    int64_t backoff_us = retry_backoff_us(&capture_backoff, cap->retry);
+    if (cap->deadline_us != 0 && now + backoff_us >= cap->deadline_us) {
+        capture_deadline_expired(cap);
+        return;
+    }
+
+    metrics_count_retry(cap->camera_addr, METRICS_FUNC_DEVICE);
+
+    TRACE_INFO(TRACE_EV_CAPTURE_BACKOFF, cap->camera_addr, 0, (int32_t)(backoff_us / 1000), 0);
+    cap->state = LPR_CAPTURE_TRIGGER;
+    cap->next_action_us = now + backoff_us;
+}
+
+/*
+ * A transação do passo falhou mas será repetida (retry_attach): o mesmo passo
+ * é refeito depois do backoff, sem dormir aqui.
+ */
+static int txn_retry_later(lpr_capture_t *cap) {
+    if (cap->txn_retry.delay_us < 0) {
+        return 0;
+    }
+
+    cap->next_action_us = monotonic_us() + cap->txn_retry.delay_us;
+    return 1;
+}
+
+// Erro da última transação desta thread vale nova tentativa de captura?
+static int last_error_retryable(void) {
+    return retry_is_retryable(modbus_last_error());
+}
+
+// Agenda a primeira leitura de status logo após o término esperado
+static void capture_first_poll(int uart_fd, lpr_capture_t *cap, int64_t now) {
+    processing_estimate_t est = { 0 };
+
+    pthread_mutex_lock(&estimates_lock);
+    processing_estimate_t *found = find_estimate(uart_fd, cap->camera_addr, 0);
+    if (found != NULL) {
+        est = *found;
+    }
+    pthread_mutex_unlock(&estimates_lock);
+
+    cap->state = LPR_CAPTURE_POLL;
+    cap->poll_count = 0;
+    cap->trigger_us = now;
+    cap->last_busy_us = 0;
+
+    if (est.samples < LPR_ESTIMATE_MIN_SAMPLES) {
+        cap->poll_interval_us = LPR_POLL_MIN_MS * 1000;
+        cap->next_action_us = now + cap->poll_interval_us;
+        return;
+    }
+
+    // Espaçamento curto (meio desvio) enquanto o término ainda é provável
+    cap->poll_interval_us = est.deviation_us / 2;
+    if (cap->poll_interval_us < LPR_POLL_MIN_MS * 1000) {
+        cap->poll_interval_us = LPR_POLL_MIN_MS * 1000;
+    }
+    cap->next_action_us = now + est.mean_us + est.deviation_us / 2;
+    if (cap->deadline_us != 0 && cap->next_action_us > cap->deadline_us) {
+        cap->next_action_us = cap->deadline_us;
+    }
+}
+
+// Reagenda a leitura de status; o intervalo dobra a cada leitura sem resultado
+static void capture_next_poll(lpr_capture_t *cap, int64_t now) {
+    int64_t deadline = capture_limit(cap, cap->trigger_us + (int64_t)cap->timeout_ms * 1000);
+
+    cap->poll_count++;
+    if (cap->deadline_us != 0 && now >= cap->deadline_us) {
+        capture_deadline_expired(cap);
+        return;
+    }
+    if (now >= deadline) {
+        capture_attempt_failed(cap, now, 1);
+        return;
+    }
+
+    cap->state = LPR_CAPTURE_POLL;
+    cap->next_action_us = now + cap->poll_interval_us;
+    if (cap->next_action_us > deadline) {
+        cap->next_action_us = deadline;
+    }
+
+    if (cap->poll_count > 1) {
+        cap->poll_interval_us *= 2;
+        if (cap->poll_interval_us > LPR_POLL_MAX_MS * 1000) {
+            cap->poll_interval_us = LPR_POLL_MAX_MS * 1000;
+        }
+    }
+}
+
+/*
+ * O término ocorreu entre a última leitura PROCESSANDO e a leitura OK; usa o
+ * ponto médio. Se a primeira leitura já encontrou OK, só se sabe que o
+ * término foi antes dela: a amostra fica um pouco abaixo para que a
+ * estimativa desça até voltar a errar por pouco.
+ */
+static void capture_learn(int uart_fd, lpr_capture_t *cap, int64_t poll_us) {
+    int64_t sample;
+
+    if (cap->last_busy_us > 0) {
+        sample = (cap->last_busy_us + poll_us) / 2 - cap->trigger_us;
+    } else {
+        sample = poll_us - cap->trigger_us;
+        sample -= sample / 16;
+    }
+
+    if (sample < 0) {
+        sample = 0;
+    }
+
+    record_processing_time(uart_fd, cap->camera_addr, sample);
+    TRACE_INFO(TRACE_EV_CAPTURE_ESTIMATE, cap->camera_addr, 0, (int32_t)(sample / 1000), cap->poll_count + 1);
+}
+
+static void capture_plate_read(const lpr_capture_t *cap) {
+    TRACE(TRACE_LEVEL_INFO, TRACE_EV_CAPTURE_OK, cap->camera_addr, 0, cap->data.confianca, 0,
+          cap->data.placa, (int)strlen(cap->data.placa));
+}
+
+int lpr_capture_step(int uart_fd, const char *matricula, lpr_capture_t *cap) {
+    if (lpr_capture_finished(cap)) {
+        return 1;
+    }
+
+    int64_t now = monotonic_us();
+    if (now < cap->next_action_us) {
+        return 0;
+    }
+
+    // O reset do trigger não conta para o prazo: a placa já foi lida
+    if (cap->deadline_us != 0 && now >= cap->deadline_us && cap->state != LPR_CAPTURE_RESET) {
+        capture_deadline_expired(cap);
+        return 1;
+    }
+
+    uint8_t status = LPR_STATUS_PRONTO;
+
+    // Cada transação da captura herda o prazo (timeout cortado, retentativas limitadas)
+    int64_t previous_deadline = retry_set_deadline(cap->deadline_us != 0 ? cap->deadline_us : retry_get_deadline());
+    retry_t *previous_retry = retry_attach(&cap->txn_retry);
+
+    switch (cap->state) {
+        case LPR_CAPTURE_TRIGGER:
+            // Reset adiado de uma captura rápida anterior: sai antes do novo trigger
+            if (reset_is_pending(uart_fd, cap->camera_addr)) {
+                if (!flush_reset(uart_fd, matricula, cap->camera_addr) &&
+                    reset_is_pending(uart_fd, cap->camera_addr) &&
+                    !txn_retry_later(cap)) {
+                    capture_attempt_failed(cap, monotonic_us(), last_error_retryable());
+                }
+                break;
+            }
+
+            TRACE_INFO(TRACE_EV_CAPTURE_TRY, cap->camera_addr, 0, cap->retry + 1, cap->max_retries);
+
+            if (lpr_trigger_capture(uart_fd, cap->camera_addr, matricula) != 0) {
+                if (txn_retry_later(cap)) {
+                    break;
+                }
+                TRACE_ERROR(TRACE_EV_TRIGGER_FAIL, cap->camera_addr, 0, modbus_last_error(), 0);
+                capture_attempt_failed(cap, monotonic_us(), last_error_retryable());
+                break;
+            }
+
+            capture_first_poll(uart_fd, cap, monotonic_us());
+            break;
+
+        case LPR_CAPTURE_POLL: {
+            int64_t poll_us = monotonic_us();
+            int ret;
+
+            // Modo rápido: a leitura de 8 registradores traz status, placa e confiança juntos
+            if (cap->fast_path) {
+                ret = lpr_read_data(uart_fd, cap->camera_addr, matricula, &cap->data);
+                status = cap->data.status;
+            } else {
+                ret = lpr_read_status(uart_fd, cap->camera_addr, matricula, &status);
+            }
+
+            if (ret == 0) {
+                TRACE_INFO(TRACE_EV_CAPTURE_STATUS, cap->camera_addr, 0, status, 0);
+
+                if (status == LPR_STATUS_OK) {
+                    capture_learn(uart_fd, cap, poll_us);
+                    if (cap->fast_path) {
+                        capture_plate_read(cap);
+                        // Sem lugar na tabela de pendentes, o reset sai agora
+                        cap->state = mark_reset(uart_fd, cap->camera_addr) == 0 ? LPR_CAPTURE_DONE : LPR_CAPTURE_RESET;
+                    } else {
+                        cap->state = LPR_CAPTURE_READ;
+                    }
+                    break;
+                }
+                if (status == LPR_STATUS_ERRO) {
+                    TRACE_ERROR(TRACE_EV_CAPTURE_ERROR, cap->camera_addr, 0, 0, 0);
+                    capture_attempt_failed(cap, monotonic_us(), 1);
+                    break;
+                }
+                if (status == LPR_STATUS_PROCESSANDO) {
+                    cap->last_busy_us = poll_us;
+                }
+            } else if (txn_retry_later(cap)) {
+                break;
+            } else if (!last_error_retryable() && modbus_last_error() != MODBUS_ERR_DEADLINE) {
+                capture_attempt_failed(cap, monotonic_us(), 0);
+                break;
+            }
+
+            capture_next_poll(cap, monotonic_us());
+            break;
+        }
+
+        case LPR_CAPTURE_READ:
+            if (lpr_read_data(uart_fd, cap->camera_addr, matricula, &cap->data) == 0) {
+                capture_plate_read(cap);
+                cap->state = LPR_CAPTURE_RESET;
+                break;
+            }
+            if (txn_retry_later(cap)) {
+                break;
+            }
+
+            capture_next_poll(cap, monotonic_us());
+            break;
+
+        case LPR_CAPTURE_RESET:
+            if (lpr_reset_trigger(uart_fd, cap->camera_addr, matricula) != 0 && txn_retry_later(cap)) {
+                break;
+            }
+            cap->state = LPR_CAPTURE_DONE;
+            break;
+
+        default:
+            break;
+    }
+
+    retry_attach(previous_retry);
+    retry_set_deadline(previous_deadline);
+
+    // Transação concluída (com sucesso ou sem mais tentativas): a próxima começa do zero
+    if (cap->txn_retry.delay_us < 0) {
+        retry_reset(&cap->txn_retry);
+    }
+    return lpr_capture_finished(cap);
+}
+
+int lpr_capture_run(int uart_fd, const char *matricula, lpr_capture_t *caps, int count) {
+    for (;;) {
+        lpr_capture_t *next = NULL;
+
+        for (int i = 0; i < count; i++) {
+            if (!lpr_capture_finished(&caps[i]) &&
+                (next == NULL || caps[i].next_action_us < next->next_action_us)) {
+                next = &caps[i];
+            }
+        }
+
+        if (next == NULL) {
+            break;
+        }
+
+        // Barramento ocioso até o próximo prazo: aproveita para os resets adiados
+        int64_t wait = next->next_action_us - monotonic_us();
+        if (wait >= LPR_POLL_MIN_MS * 1000 && lpr_capture_flush_one_reset(uart_fd, matricula)) {
+            continue;
+        }
+        if (wait > 0) {
+            usleep(wait);
+        }
+
+        lpr_capture_step(uart_fd, matricula, next);
+    }
+
+    int successes = 0;
+    for (int i = 0; i < count; i++) {
+        if (caps[i].state == LPR_CAPTURE_DONE) {
+            successes++;
+        }
+    }
+
+    return successes;
+}
@@ -0,0 +1,241 @@
+#ifndef LPR_CAPTURE_H
+#define LPR_CAPTURE_H
+
+#include <stdint.h>
+#include "modbus_parking.h"
+#include "retry.h"
+
+/*
+ * Captura de placa não bloqueante. Cada captura é uma máquina de estados
+ * (trigger -> polling -> leitura -> reset) que executa no máximo uma
+ * transação por passo, de modo que várias câmeras no mesmo barramento
+ * podem ter capturas em andamento ao mesmo tempo: enquanto uma câmera
+ * processa a imagem, o barramento atende as outras.
+ */
+
+/*
+ * O polling é adaptativo: cada câmera tem uma estimativa do tempo de
+ * processamento (média e desvio, atualizados a cada captura). A primeira
+ * leitura de status é feita logo após o término esperado, as seguintes com
+ * espaçamento curto enquanto o término ainda é provável e, se a câmera
+ * demorar mais que o normal, com backoff exponencial. Sem estimativa, o
+ * intervalo começa em LPR_POLL_MIN_MS e dobra a cada leitura.
+ */
+#define LPR_POLL_MIN_MS 10           // Menor intervalo entre leituras de status
+#define LPR_POLL_MAX_MS 400          // Limite do backoff
+#define LPR_ESTIMATE_MIN_SAMPLES 3   // Capturas necessárias antes de usar a estimativa
+#define LPR_MAX_CAMERAS 16           // Câmeras (porta e endereço) com estimativa e cache próprios
+
+// Confiança mínima (%) para uma placa entrar no cache de debounce
+#define LPR_DEFAULT_MIN_CONFIDENCE 70
+
+// Resultado da consulta ao cache de placas
+typedef enum {
+    LPR_CACHE_MISS = 0,  // O chamador deve capturar e chamar lpr_capture_cache_end
+    LPR_CACHE_HIT,       // Placa da janela de debounce
+    LPR_CACHE_JOINED,    // Resultado da captura que já estava em andamento
+    LPR_CACHE_TIMEOUT    // A captura em andamento não terminou dentro do prazo do chamador
+} lpr_cache_result_t;
+
+// Estados da captura
+typedef enum {
+    LPR_CAPTURE_TRIGGER = 0,  // Disparar o trigger
+    LPR_CAPTURE_POLL,         // Polling do status
+    LPR_CAPTURE_READ,         // Ler placa e confiança
+    LPR_CAPTURE_RESET,        // Zerar o trigger
+    LPR_CAPTURE_DONE,         // Concluída com sucesso
+    LPR_CAPTURE_FAILED        // Esgotou as tentativas
+} lpr_capture_state_t;
+
+// Captura em andamento
+typedef struct {
+    uint8_t camera_addr;
+    int max_retries;
+    int timeout_ms;
+    lpr_data_t data;              // Resultado (válido em LPR_CAPTURE_DONE)
+
+    lpr_capture_state_t state;
+    int retry;                    // Tentativas já consumidas
+    int poll_count;               // Leituras de status na tentativa atual
+    int64_t next_action_us;       // Instante (CLOCK_MONOTONIC) do próximo passo
+
+    int64_t trigger_us;           // Fim do trigger da tentativa atual
+    int64_t last_busy_us;         // Última leitura que encontrou PROCESSANDO (0 = nenhuma)
+    int64_t poll_interval_us;     // Intervalo atual do backoff
+    int64_t deadline_us;          // Prazo da captura inteira (0 = sem prazo)
+    int fast_path;                // Polling com a leitura completa e reset adiado
+    retry_t txn_retry;            // Retentativas da transação do passo atual (sem dormir no passo)
+} lpr_capture_t;
+
+// Estimativa do tempo de processamento de uma câmera
+typedef struct {
+    int samples;       // Capturas observadas
+    int mean_ms;       // Média móvel
+    int deviation_ms;  // Desvio médio móvel
+} lpr_processing_estimate_t;
+
+/**
+ * @brief Prepara uma captura
+ * @param cap Captura
+ * @param camera_addr Endereço da câmera (0x11 ou 0x12)
+ * @param max_retries Número máximo de tentativas
+ * @param timeout_ms Timeout em milissegundos para polling em cada tentativa
+ */
+void lpr_capture_init(lpr_capture_t *cap, uint8_t camera_addr, int max_retries, int timeout_ms);
+
+/**
+ * @brief Define o prazo absoluto da captura (substitui o SLA padrão)
+ *
+ * Nenhum passo começa depois do prazo e as transações da captura têm o
+ * timeout e as retentativas limitados por ele (retry.h). Ao esgotar, a
+ * captura termina em LPR_CAPTURE_FAILED.
+ *
+ * @param cap Captura
+ * @param deadline_us Prazo em CLOCK_MONOTONIC (retry_deadline_after_ms), 0 = sem prazo
+ */
+void lpr_capture_set_deadline(lpr_capture_t *cap, int64_t deadline_us);
+
+/**
+ * @brief Ativa o modo rápido da captura
+ *
+ * O polling usa a leitura dos 8 registradores da câmera, de modo que a
+ * primeira resposta com LPR_STATUS_OK já traz placa, confiança e erro, e a
+ * captura termina nela. O reset do trigger fica pendente e é feito fora do
+ * caminho crítico: em lpr_capture_flush_resets(), nos intervalos ociosos de
+ * lpr_capture_run(), na thread do modbus_bus ociosa ou, no mais tardar,
+ * antes do próximo trigger da mesma câmera (porta e endereço). Com
+ * LPR_MAX_CAMERAS resets já pendentes, a captura faz o reset na hora.
+ *
+ * @param cap Captura
+ * @param enable 1 para ativar
+ */
+void lpr_capture_set_fast_path(lpr_capture_t *cap, int enable);
+
+/**
+ * @brief Executa os resets de trigger adiados pelo modo rápido
+ * @param uart_fd File descriptor da UART (só os resets de capturas feitas nela)
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @return 0 se todos foram feitos, -1 se algum falhou (continua pendente)
+ */
+int lpr_capture_flush_resets(int uart_fd, const char *matricula);
+
+/**
+ * @brief Executa no máximo um reset adiado (para laços de eventos)
+ *
+ * Faz uma única tentativa, sem backoff: quem chama está ocioso e tenta de
+ * novo na próxima folga.
+ *
+ * @return 1 se um reset foi feito, 0 se não havia pendente ou se falhou
+ */
+int lpr_capture_flush_one_reset(int uart_fd, const char *matricula);
+
+/**
+ * @brief Indica se há resets adiados
+ */
+int lpr_capture_reset_pending(void);
+
+/**
+ * @brief Define o SLA aplicado por lpr_capture_init (e lpr_capture_plate)
+ * @param sla_ms Tempo máximo de uma captura em ms (0 = sem prazo)
+ */
+void lpr_capture_set_sla_ms(int sla_ms);
+
+/**
+ * @brief Configura o cache de placas por câmera
+ *
+ * Um pedido de captura até window_ms após uma captura bem-sucedida com
+ * confiança >= confidence recebe a mesma placa sem usar o barramento
+ * (sensor com bounce, carro que para e volta na entrada).
+ *
+ * @param window_ms Janela de debounce (0 = sem cache; pedidos simultâneos ainda são unidos)
+ * @param confidence Confiança mínima para reaproveitar o resultado
+ */
+void lpr_capture_set_debounce(int window_ms, int confidence);
+
+/**
+ * @brief Consulta o cache antes de capturar
+ *
+ * Com uma captura em andamento na mesma câmera, espera ela terminar e
+ * devolve o resultado dela. A espera vai no máximo até o prazo que a captura
+ * do próprio chamador teria: o de cap (lpr_capture_set_deadline ou SLA), o
+ * da thread (retry_set_deadline) ou, sem nenhum, max_retries * timeout_ms.
+ * Em LPR_CACHE_MISS o chamador passa a ser o dono da captura e deve chamar
+ * lpr_capture_cache_end() ao final. O cache é por porta: a mesma câmera em
+ * outro fd (outro contexto ou porta do gerente) tem entrada própria.
+ *
+ * @param uart_fd Porta onde a captura seria feita
+ * @param cap Captura que o chamador faria (lpr_capture_init)
+ * @param data Recebe a placa em LPR_CACHE_HIT e LPR_CACHE_JOINED
+ * @param result Recebe 0 ou -1 (resultado da captura unida) nesses casos; -1 em LPR_CACHE_TIMEOUT
+ * @return LPR_CACHE_MISS, LPR_CACHE_HIT, LPR_CACHE_JOINED ou LPR_CACHE_TIMEOUT
+ */
+lpr_cache_result_t lpr_capture_cache_begin(int uart_fd, const lpr_capture_t *cap, lpr_data_t *data,
+                                           int *result);
+
+/**
+ * @brief Publica o resultado de uma captura iniciada após LPR_CACHE_MISS
+ * @param uart_fd Porta passada a lpr_capture_cache_begin()
+ * @param camera_addr Endereço da câmera
+ * @param result 0 em caso de sucesso, -1 em caso de erro
+ * @param data Placa capturada (ignorada em erro)
+ */
+void lpr_capture_cache_end(int uart_fd, uint8_t camera_addr, int result, const lpr_data_t *data);
+
+/**
+ * @brief Descarta a placa em cache de uma câmera (ex: a cancela fechou após o carro passar)
+ *
+ * Vale para o endereço em todas as portas.
+ */
+void lpr_capture_cache_invalidate(uint8_t camera_addr);
+
+/**
+ * @brief Aplica LPR_CAPTURE_SLA_MS, LPR_DEBOUNCE_MS e LPR_MIN_CONFIDENCE da configuração
+ */
+void lpr_capture_load_config(void);
+
+/**
+ * @brief Executa o próximo passo da captura, se já estiver na hora
+ *
+ * O passo nunca dorme: se a transação falhar e couber nova tentativa
+ * (retry.h), o passo é refeito em next_action_us, depois do backoff.
+ *
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param cap Captura
+ * @return 1 se a captura terminou (DONE ou FAILED), 0 caso contrário
+ */
+int lpr_capture_step(int uart_fd, const char *matricula, lpr_capture_t *cap);
+
+/**
+ * @brief Indica se a captura terminou
+ */
+int lpr_capture_finished(const lpr_capture_t *cap);
+
+/**
+ * @brief Conduz várias capturas intercaladas no mesmo barramento até o fim
+ *
+ * A cada iteração executa o passo da captura com o prazo mais próximo e
+ * dorme apenas quando nenhuma câmera tem trabalho pendente.
+ *
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param caps Vetor de capturas preparadas com lpr_capture_init
+ * @param count Número de capturas
+ * @return Número de capturas concluídas com sucesso
+ */
+int lpr_capture_run(int uart_fd, const char *matricula, lpr_capture_t *caps, int count);
+
+/**
+ * @brief Consulta a estimativa do tempo de processamento de uma câmera
+ * @param uart_fd Porta da câmera (as estimativas são por porta e endereço)
+ * @param camera_addr Endereço da câmera
+ * @param estimate Recebe a estimativa (samples = 0 se a câmera ainda não foi observada)
+ */
+void lpr_capture_get_estimate(int uart_fd, uint8_t camera_addr, lpr_processing_estimate_t *estimate);
+
+/**
+ * @brief Descarta as estimativas (ex: após trocar a câmera ou sua configuração)
+ */
+void lpr_capture_reset_estimates(void);
+
+#endif
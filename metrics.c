@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "metrics.h"
+#include "config.h"
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_us;
+    _Atomic uint64_t max_us;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} histogram_t;
+
+// Entrada da tabela: key = 0 livre, senão 0x10000 | addr << 8 | func
+typedef struct {
+    _Atomic uint32_t key;
+    _Atomic uint64_t transactions;
+    _Atomic uint64_t errors[METRICS_ERR_COUNT];
+    _Atomic uint64_t retries;
+    histogram_t stages[METRICS_STAGE_COUNT];
+} entry_t;
+
+// Ocupação por porta: key = 0 livre, senão fd + 1
+typedef struct {
+    _Atomic uint32_t key;
+    _Atomic uint64_t busy_us;
+} port_entry_t;
+
+static entry_t entries[METRICS_MAX_DEVICES];
+static port_entry_t ports[METRICS_MAX_PORTS];
+static _Atomic uint64_t window_start_us;
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    FILE *out;
+    int interval_ms;
+    int json;
+    int running;
+} dumper = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static const char *stage_names[METRICS_STAGE_COUNT] = {
+    "send", "turnaround", "receive", "total"
+};
+
+static const char *error_names[METRICS_ERR_COUNT] = {
+    "timeout", "crc", "exception", "other"
+};
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+__attribute__((constructor))
+static void metrics_init(void) {
+    atomic_store(&window_start_us, monotonic_us());
+}
+
+// Busca ou reserva (lock-free) a entrada do par; NULL com a tabela cheia
+static entry_t *entry_for(uint8_t addr, uint8_t func) {
+    uint32_t key = 0x10000u | ((uint32_t)addr << 8) | func;
+    unsigned int slot = (addr * 31u + func) & (METRICS_MAX_DEVICES - 1);
+
+    for (int i = 0; i < METRICS_MAX_DEVICES; i++) {
+        entry_t *entry = &entries[(slot + i) & (METRICS_MAX_DEVICES - 1)];
+        uint32_t current = atomic_load_explicit(&entry->key, memory_order_acquire);
+
+        if (current == key) {
+            return entry;
+        }
+        if (current == 0) {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong(&entry->key, &expected, key) || expected == key) {
+                return entry;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Mesmo esquema de entry_for, pelo fd
+static port_entry_t *port_for(int port) {
+    if (port < 0) {
+        return NULL;
+    }
+
+    uint32_t key = (uint32_t)port + 1;
+    unsigned int slot = (unsigned int)port & (METRICS_MAX_PORTS - 1);
+
+    for (int i = 0; i < METRICS_MAX_PORTS; i++) {
+        port_entry_t *entry = &ports[(slot + i) & (METRICS_MAX_PORTS - 1)];
+        uint32_t current = atomic_load_explicit(&entry->key, memory_order_acquire);
+
+        if (current == key) {
+            return entry;
+        }
+        if (current == 0) {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong(&entry->key, &expected, key) || expected == key) {
+                return entry;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int bucket_for(uint64_t us) {
+    if (us < 8) {
+        return (int)us;
+    }
+
+    int msb = 63 - __builtin_clzll(us);
+    int bucket = (msb - 1) * 4 + (int)((us >> (msb - 2)) & 3);
+
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+// Maior valor que cai no bucket
+static uint64_t bucket_upper(int bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+
+    int shift = bucket / 4 - 1;
+    return ((uint64_t)(4 + bucket % 4) << shift) + (1ULL << shift) - 1;
+}
+
+static void histogram_add(histogram_t *hist, uint64_t us) {
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->buckets[bucket_for(us)], 1, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+    while (us > max && !atomic_compare_exchange_weak(&hist->max_us, &max, us)) {
+    }
+}
+
+void metrics_record_transaction(int port, uint8_t addr, uint8_t func, const uint64_t *stage_us) {
+    port_entry_t *port_entry = port_for(port);
+    if (port_entry != NULL) {
+        atomic_fetch_add_explicit(&port_entry->busy_us, stage_us[METRICS_STAGE_TOTAL], memory_order_relaxed);
+    }
+
+    entry_t *entry = entry_for(addr, func);
+    if (entry == NULL) {
+        return;
+    }
+
+    atomic_fetch_add_explicit(&entry->transactions, 1, memory_order_relaxed);
+    for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+        histogram_add(&entry->stages[s], stage_us[s]);
+    }
+}
+
+void metrics_count_error(uint8_t addr, uint8_t func, metrics_error_t error) {
+    entry_t *entry = entry_for(addr, func);
+    if (entry != NULL && error >= 0 && error < METRICS_ERR_COUNT) {
+        atomic_fetch_add_explicit(&entry->errors[error], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_count_retry(uint8_t addr, uint8_t func) {
+    entry_t *entry = entry_for(addr, func);
+    if (entry != NULL) {
+        atomic_fetch_add_explicit(&entry->retries, 1, memory_order_relaxed);
+    }
+}
+
+static int compare_devices(const void *a, const void *b) {
+    const metrics_device_t *da = a;
+    const metrics_device_t *db = b;
+
+    if (da->addr != db->addr) {
+        return da->addr - db->addr;
+    }
+    return da->func - db->func;
+}
+
+static int compare_ports(const void *a, const void *b) {
+    const metrics_port_t *pa = a;
+    const metrics_port_t *pb = b;
+
+    return pa->port - pb->port;
+}
+
+void metrics_snapshot(metrics_snapshot_t *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    for (int i = 0; i < METRICS_MAX_DEVICES; i++) {
+        entry_t *entry = &entries[i];
+        uint32_t key = atomic_load_explicit(&entry->key, memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+
+        metrics_device_t *dev = &snapshot->devices[snapshot->num_devices++];
+        dev->addr = (key >> 8) & 0xFF;
+        dev->func = key & 0xFF;
+        dev->transactions = atomic_load_explicit(&entry->transactions, memory_order_relaxed);
+        dev->retries = atomic_load_explicit(&entry->retries, memory_order_relaxed);
+        for (int e = 0; e < METRICS_ERR_COUNT; e++) {
+            dev->errors[e] = atomic_load_explicit(&entry->errors[e], memory_order_relaxed);
+        }
+
+        for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+            histogram_t *src = &entry->stages[s];
+            metrics_histogram_t *dst = &dev->stages[s];
+
+            dst->count = atomic_load_explicit(&src->count, memory_order_relaxed);
+            dst->sum_us = atomic_load_explicit(&src->sum_us, memory_order_relaxed);
+            dst->max_us = atomic_load_explicit(&src->max_us, memory_order_relaxed);
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                dst->buckets[b] = atomic_load_explicit(&src->buckets[b], memory_order_relaxed);
+            }
+        }
+    }
+
+    qsort(snapshot->devices, snapshot->num_devices, sizeof(metrics_device_t), compare_devices);
+
+    snapshot->elapsed_us = monotonic_us() - atomic_load(&window_start_us);
+
+    // Cada porta é um segmento: as transações de portas diferentes se sobrepõem
+    for (int i = 0; i < METRICS_MAX_PORTS; i++) {
+        uint32_t key = atomic_load_explicit(&ports[i].key, memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+
+        metrics_port_t *port = &snapshot->ports[snapshot->num_ports++];
+        port->port = (int)(key - 1);
+        port->busy_us = atomic_load_explicit(&ports[i].busy_us, memory_order_relaxed);
+        if (snapshot->elapsed_us > 0) {
+            port->busy_pct = 100.0 * (double)port->busy_us / (double)snapshot->elapsed_us;
+        }
+        if (port->busy_us > snapshot->busy_us) {
+            snapshot->busy_us = port->busy_us;
+            snapshot->bus_busy_pct = port->busy_pct;
+        }
+    }
+
+    qsort(snapshot->ports, snapshot->num_ports, sizeof(metrics_port_t), compare_ports);
+}
+
+uint64_t metrics_percentile(const metrics_histogram_t *hist, double percentile) {
+    uint64_t total = 0;
+
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        total += hist->buckets[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // Posição da amostra no percentil (arredondada para cima)
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper(b);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+
+    return hist->max_us;
+}
+
+void metrics_reset(void) {
+    for (int i = 0; i < METRICS_MAX_DEVICES; i++) {
+        entry_t *entry = &entries[i];
+
+        atomic_store(&entry->transactions, 0);
+        atomic_store(&entry->retries, 0);
+        for (int e = 0; e < METRICS_ERR_COUNT; e++) {
+            atomic_store(&entry->errors[e], 0);
+        }
+        for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+            histogram_t *hist = &entry->stages[s];
+            atomic_store(&hist->count, 0);
+            atomic_store(&hist->sum_us, 0);
+            atomic_store(&hist->max_us, 0);
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                atomic_store(&hist->buckets[b], 0);
+            }
+        }
+    }
+
+    for (int i = 0; i < METRICS_MAX_PORTS; i++) {
+        atomic_store(&ports[i].busy_us, 0);
+    }
+    atomic_store(&window_start_us, monotonic_us());
+}
+
+// O snapshot é grande demais para a pilha das threads de dump
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics_snapshot_t dump_snapshot;
+
+void metrics_dump_text(FILE *out) {
+    pthread_mutex_lock(&snapshot_lock);
+    metrics_snapshot_t *snap = &dump_snapshot;
+    metrics_snapshot(snap);
+
+    fprintf(out, "=== Métricas do barramento: ocupação %.1f%% na porta mais ocupada (%llu ms de %llu ms) ===\n",
+            snap->bus_busy_pct, (unsigned long long)(snap->busy_us / 1000),
+            (unsigned long long)(snap->elapsed_us / 1000));
+
+    for (int i = 0; i < snap->num_ports; i++) {
+        metrics_port_t *port = &snap->ports[i];
+        fprintf(out, "porta fd %d: ocupação %.1f%% (%llu ms)\n", port->port, port->busy_pct,
+                (unsigned long long)(port->busy_us / 1000));
+    }
+
+    for (int i = 0; i < snap->num_devices; i++) {
+        metrics_device_t *dev = &snap->devices[i];
+
+        if (dev->func == METRICS_FUNC_DEVICE) {
+            fprintf(out, "0x%02X dispositivo: retries=%llu\n", dev->addr,
+                    (unsigned long long)dev->retries);
+            continue;
+        }
+
+        fprintf(out, "0x%02X func 0x%02X: %llu transações, timeout=%llu crc=%llu exceção=%llu outros=%llu retries=%llu\n",
+                dev->addr, dev->func, (unsigned long long)dev->transactions,
+                (unsigned long long)dev->errors[METRICS_ERR_TIMEOUT],
+                (unsigned long long)dev->errors[METRICS_ERR_CRC],
+                (unsigned long long)dev->errors[METRICS_ERR_EXCEPTION],
+                (unsigned long long)dev->errors[METRICS_ERR_OTHER],
+                (unsigned long long)dev->retries);
+
+        for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+            metrics_histogram_t *hist = &dev->stages[s];
+            if (hist->count == 0) {
+                continue;
+            }
+            fprintf(out, "    %-10s p50=%llu us p99=%llu us max=%llu us média=%llu us\n", stage_names[s],
+                    (unsigned long long)metrics_percentile(hist, 50),
+                    (unsigned long long)metrics_percentile(hist, 99),
+                    (unsigned long long)hist->max_us,
+                    (unsigned long long)(hist->sum_us / hist->count));
+        }
+    }
+
+    fflush(out);
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+void metrics_dump_json(FILE *out) {
+    pthread_mutex_lock(&snapshot_lock);
+    metrics_snapshot_t *snap = &dump_snapshot;
+    metrics_snapshot(snap);
+
+    fprintf(out, "{\"busy_us\":%llu,\"elapsed_us\":%llu,\"bus_busy_pct\":%.2f,\"ports\":[",
+            (unsigned long long)snap->busy_us, (unsigned long long)snap->elapsed_us, snap->bus_busy_pct);
+
+    for (int i = 0; i < snap->num_ports; i++) {
+        metrics_port_t *port = &snap->ports[i];
+        fprintf(out, "%s{\"port\":%d,\"busy_us\":%llu,\"busy_pct\":%.2f}", i > 0 ? "," : "",
+                port->port, (unsigned long long)port->busy_us, port->busy_pct);
+    }
+
+    fprintf(out, "],\"devices\":[");
+
+    for (int i = 0; i < snap->num_devices; i++) {
+        metrics_device_t *dev = &snap->devices[i];
+
+        fprintf(out, "%s{\"addr\":%u,\"func\":%u,\"transactions\":%llu,\"retries\":%llu",
+                i > 0 ? "," : "", dev->addr, dev->func, (unsigned long long)dev->transactions,
+                (unsigned long long)dev->retries);
+        for (int e = 0; e < METRICS_ERR_COUNT; e++) {
+            fprintf(out, ",\"%s\":%llu", error_names[e], (unsigned long long)dev->errors[e]);
+        }
+
+        for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+            metrics_histogram_t *hist = &dev->stages[s];
+            fprintf(out, ",\"%s\":{\"count\":%llu,\"p50_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu,\"sum_us\":%llu,\"buckets\":[",
+                    stage_names[s], (unsigned long long)hist->count,
+                    (unsigned long long)metrics_percentile(hist, 50),
+                    (unsigned long long)metrics_percentile(hist, 99),
+                    (unsigned long long)hist->max_us, (unsigned long long)hist->sum_us);
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                fprintf(out, "%s%llu", b > 0 ? "," : "", (unsigned long long)hist->buckets[b]);
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "}");
+    }
+
+    fprintf(out, "]}\n");
+    fflush(out);
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+static void *dump_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&dumper.lock);
+    while (dumper.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += dumper.interval_ms / 1000;
+        deadline.tv_nsec += (long)(dumper.interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        // Espera o intervalo ou o pedido de parada
+        while (dumper.running &&
+               pthread_cond_timedwait(&dumper.cond, &dumper.lock, &deadline) == 0) {
+        }
+        if (!dumper.running) {
+            break;
+        }
+
+        pthread_mutex_unlock(&dumper.lock);
+        if (dumper.json) {
+            metrics_dump_json(dumper.out);
+        } else {
+            metrics_dump_text(dumper.out);
+        }
+        pthread_mutex_lock(&dumper.lock);
+    }
+    pthread_mutex_unlock(&dumper.lock);
+
+    return NULL;
+}
+
+int metrics_start_dump(FILE *out, int interval_ms, int json) {
+    pthread_condattr_t attr;
+
+    if (interval_ms <= 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&dumper.lock);
+    if (dumper.running) {
+        pthread_mutex_unlock(&dumper.lock);
+        return 0;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&dumper.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    dumper.out = out;
+    dumper.interval_ms = interval_ms;
+    dumper.json = json;
+    dumper.running = 1;
+
+    if (pthread_create(&dumper.thread, NULL, dump_thread, NULL) != 0) {
+        fprintf(stderr, "Erro ao criar a thread de métricas\n");
+        dumper.running = 0;
+        pthread_mutex_unlock(&dumper.lock);
+        return -1;
+    }
+
+    pthread_mutex_unlock(&dumper.lock);
+    return 0;
+}
+
+void metrics_stop_dump(void) {
+    pthread_mutex_lock(&dumper.lock);
+    if (!dumper.running) {
+        pthread_mutex_unlock(&dumper.lock);
+        return;
+    }
+    dumper.running = 0;
+    pthread_cond_signal(&dumper.cond);
+    pthread_mutex_unlock(&dumper.lock);
+
+    pthread_join(dumper.thread, NULL);
+    pthread_cond_destroy(&dumper.cond);
+}
+
+int metrics_load_config(FILE *out) {
+    int interval_ms = config_get_int("METRICS_DUMP_INTERVAL_MS", 0);
+    const char *format = config_get("METRICS_DUMP_FORMAT");
+    int json = format != NULL && strcmp(format, "json") == 0;
+
+    if (interval_ms <= 0) {
+        return 0;
+    }
+
+    return metrics_start_dump(out, interval_ms, json) == 0;
+}
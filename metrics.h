@@ -0,0 +1,147 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Instrumentação das transações por (endereço, código de função): tempos de
+ * cada etapa em histogramas logarítmicos, contadores de erro e ocupação do
+ * barramento. A gravação é lock-free (contadores atômicos); a leitura é feita
+ * por uma cópia (snapshot) sem interromper o tráfego.
+ */
+
+// Histograma log-linear em microssegundos: cada potência de 2 é dividida em
+// 4 buckets (erro máximo de 25%); cobre até ~33 s, o último acumula o resto
+#define METRICS_BUCKETS 96
+
+// Pares (endereço, função) distintos (potência de 2)
+#define METRICS_MAX_DEVICES 32
+
+// Portas (fds) com ocupação própria (potência de 2)
+#define METRICS_MAX_PORTS 16
+
+// Função 0: contadores do dispositivo que não pertencem a uma transação (ex: retries de captura)
+#define METRICS_FUNC_DEVICE 0
+
+// Etapas medidas em cada transação
+typedef enum {
+    METRICS_STAGE_SEND = 0,    // write + tcdrain
+    METRICS_STAGE_TURNAROUND,  // Espera antes da leitura
+    METRICS_STAGE_RECEIVE,     // Até o fim do quadro de resposta (ou timeout)
+    METRICS_STAGE_TOTAL,       // Ponta a ponta
+    METRICS_STAGE_COUNT
+} metrics_stage_t;
+
+// Tipos de erro contabilizados
+typedef enum {
+    METRICS_ERR_TIMEOUT = 0,
+    METRICS_ERR_CRC,
+    METRICS_ERR_EXCEPTION,
+    METRICS_ERR_OTHER,  // Endereço/função/tamanho inesperados
+    METRICS_ERR_COUNT
+} metrics_error_t;
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint64_t buckets[METRICS_BUCKETS];
+} metrics_histogram_t;
+
+typedef struct {
+    uint8_t addr;
+    uint8_t func;
+    uint64_t transactions;
+    uint64_t errors[METRICS_ERR_COUNT];
+    uint64_t retries;
+    metrics_histogram_t stages[METRICS_STAGE_COUNT];
+} metrics_device_t;
+
+// Ocupação de um segmento (porta): só uma transação por vez ocupa o fio
+typedef struct {
+    int port;             // fd da UART
+    uint64_t busy_us;     // Tempo com transação em andamento nesta porta
+    double busy_pct;
+} metrics_port_t;
+
+typedef struct {
+    int num_devices;
+    metrics_device_t devices[METRICS_MAX_DEVICES];  // Ordenados por endereço e função
+    int num_ports;
+    metrics_port_t ports[METRICS_MAX_PORTS];        // Ordenadas por fd
+    uint64_t busy_us;     // Da porta mais ocupada
+    uint64_t elapsed_us;  // Desde o início (ou metrics_reset)
+    double bus_busy_pct;  // Da porta mais ocupada (nunca passa de 100%)
+} metrics_snapshot_t;
+
+/**
+ * @brief Registra os tempos de uma transação
+ * @param port fd da UART (a ocupação é contada por porta)
+ * @param addr Endereço do dispositivo
+ * @param func Código de função
+ * @param stage_us Duração de cada etapa (METRICS_STAGE_COUNT valores)
+ */
+void metrics_record_transaction(int port, uint8_t addr, uint8_t func, const uint64_t *stage_us);
+
+/**
+ * @brief Conta um erro de transação
+ */
+void metrics_count_error(uint8_t addr, uint8_t func, metrics_error_t error);
+
+/**
+ * @brief Conta uma nova tentativa (retry)
+ */
+void metrics_count_retry(uint8_t addr, uint8_t func);
+
+/**
+ * @brief Copia o estado atual das métricas
+ * @param snapshot Destino (estrutura grande: prefira memória estática)
+ */
+void metrics_snapshot(metrics_snapshot_t *snapshot);
+
+/**
+ * @brief Percentil aproximado (limite superior do bucket, limitado ao máximo)
+ * @param hist Histograma
+ * @param percentile Entre 0 e 100 (ex: 50, 99)
+ * @return Valor em microssegundos (0 sem amostras)
+ */
+uint64_t metrics_percentile(const metrics_histogram_t *hist, double percentile);
+
+/**
+ * @brief Zera contadores, histogramas e a janela de ocupação
+ */
+void metrics_reset(void);
+
+/**
+ * @brief Escreve o snapshot atual em texto legível
+ */
+void metrics_dump_text(FILE *out);
+
+/**
+ * @brief Escreve o snapshot atual em JSON (um objeto por linha)
+ */
+void metrics_dump_json(FILE *out);
+
+/**
+ * @brief Inicia uma thread que escreve as métricas periodicamente
+ * @param out Destino
+ * @param interval_ms Intervalo entre escritas
+ * @param json 1 para JSON, 0 para texto
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int metrics_start_dump(FILE *out, int interval_ms, int json);
+
+/**
+ * @brief Para a escrita periódica
+ */
+void metrics_stop_dump(void);
+
+/**
+ * @brief Inicia a escrita periódica conforme METRICS_DUMP_INTERVAL_MS e METRICS_DUMP_FORMAT
+ * @param out Destino
+ * @return 1 se a escrita periódica foi iniciada, 0 se desabilitada
+ */
+int metrics_load_config(FILE *out);
+
+#endif
@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <linux/futex.h>
+#include "modbus_async.h"
+#include "modbus_frame.h"
+#include "uart.h"
+#include "modbus_rx.h"
+#include "bus_capture.h"
+#include "retry.h"
+#include "trace.h"
+#include "metrics.h"
+
+#define RTU_BITS_PER_CHAR 11
+
+typedef enum {
+    ASYNC_IDLE = 0,   // Sem transação ativa
+    ASYNC_SENDING,    // Quadro ainda não coube todo no buffer da UART
+    ASYNC_WAITING,    // Esperando o primeiro byte da resposta
+    ASYNC_RECEIVING,  // Recebendo; o timer mede o silêncio de fim de quadro
+    ASYNC_BACKOFF     // Esperando para a próxima tentativa
+} async_state_t;
+
+typedef struct {
+    modbus_node_t *head;
+    modbus_node_t *tail;
+} txn_fifo_t;
+
+struct modbus_async {
+    int uart_fd;
+    int uart_flags;  // Flags originais do fd (restauradas no destroy)
+    int epoll_fd;
+    int timer_fd;
+    int want_write;  // EPOLLOUT registrado na UART
+    char matricula[5];
+    int baudrate;
+    int t15_us;
+
+    txn_fifo_t queue[MODBUS_PRIO_COUNT];
+    int pending;
+
+    // Transação ativa
+    modbus_txn_t *active;
+    async_state_t state;
+    modbus_frame_t frame;
+    modbus_timing_t timing;
+    retry_t retry;
+    modbus_rx_t rx;  // Resposta validada à medida que chega
+    int sent;
+    int gap_phase;  // 0 = esperando t1.5, 1 = esperando o resto de t3.5
+    int64_t start_us;
+    int64_t sent_us;
+    int64_t wait_until_us;  // Fim da espera pelo início da resposta
+    int completed;  // Concluídas na chamada atual de modbus_async_process
+};
+
+static void arm_timer(modbus_async_t *a, int64_t at_us) {
+    struct itimerspec its = { 0 };
+
+    // Com TFD_TIMER_ABSTIME um instante já passado dispara na hora; 0 desarma
+    if (at_us > 0) {
+        its.it_value.tv_sec = at_us / 1000000;
+        its.it_value.tv_nsec = (at_us % 1000000) * 1000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (timerfd_settime(a->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        perror("Erro ao armar o timer do barramento");
+    }
+}
+
+static void set_want_write(modbus_async_t *a, int want) {
+    if (a->want_write == want) {
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.fd = a->uart_fd };
+    if (epoll_ctl(a->epoll_fd, EPOLL_CTL_MOD, a->uart_fd, &ev) < 0) {
+        perror("Erro no epoll da UART");
+        return;
+    }
+    a->want_write = want;
+}
+
+static void fifo_push(txn_fifo_t *fifo, modbus_txn_t *txn) {
+    atomic_store_explicit(&txn->node.next, NULL, memory_order_relaxed);
+    if (fifo->tail == NULL) {
+        fifo->head = &txn->node;
+    } else {
+        atomic_store_explicit(&fifo->tail->next, &txn->node, memory_order_relaxed);
+    }
+    fifo->tail = &txn->node;
+}
+
+static modbus_txn_t *fifo_pop(txn_fifo_t *fifo) {
+    modbus_node_t *node = fifo->head;
+    if (node == NULL) {
+        return NULL;
+    }
+
+    fifo->head = atomic_load_explicit(&node->next, memory_order_relaxed);
+    if (fifo->head == NULL) {
+        fifo->tail = NULL;
+    }
+    return (modbus_txn_t *)node;
+}
+
+static void futex_wake(atomic_int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void deliver(modbus_async_t *a, modbus_txn_t *txn, int result, modbus_error_t err) {
+    txn->result = result;
+    txn->error = err;
+    // Em exceção a resposta fica com o quadro de exceção (código em response[2])
+    if (result != 0 && err != MODBUS_ERR_EXCEPTION) {
+        txn->response_len = 0;
+    }
+    a->pending--;
+    a->completed++;
+
+    // Como no modbus_bus: com callback, done é marcado antes (o callback pode reutilizar a transação)
+    if (txn->callback != NULL) {
+        atomic_store(&txn->done, 1);
+        txn->callback(txn, txn->user);
+        return;
+    }
+
+    // Sem callback, outra thread pode estar em modbus_txn_wait()
+    atomic_store(&txn->done, 1);
+    futex_wake(&txn->done);
+}
+
+// Encerra a transação ativa; o contexto fica livre antes do callback
+static void complete_active(modbus_async_t *a, int result, modbus_error_t err) {
+    modbus_txn_t *txn = a->active;
+
+    a->active = NULL;
+    a->state = ASYNC_IDLE;
+    set_want_write(a, 0);
+
+    // Mantém a fila andando mesmo que o callback não submeta nada
+    arm_timer(a, modbus_async_pending(a) > 1 ? 1 : 0);
+
+    deliver(a, txn, result, err);
+}
+
+static void record_attempt(modbus_async_t *a, int64_t end_us) {
+    uint64_t stage_us[METRICS_STAGE_COUNT];
+    int64_t sent_us = a->sent_us != 0 ? a->sent_us : end_us;
+
+    stage_us[METRICS_STAGE_SEND] = sent_us - a->start_us;
+    stage_us[METRICS_STAGE_TURNAROUND] = 0;
+    stage_us[METRICS_STAGE_RECEIVE] = end_us - sent_us;
+    stage_us[METRICS_STAGE_TOTAL] = end_us - a->start_us;
+    metrics_record_transaction(a->uart_fd, a->frame.buf[0], a->frame.buf[1], stage_us);
+}
+
+static void send_attempt(modbus_async_t *a);
+
+static void attempt_failed(modbus_async_t *a, modbus_error_t err) {
+    int64_t delay_us = retry_next_delay(&a->retry, err);
+
+    if (delay_us < 0) {
+        // Falha transitória que esgotou o tempo: o motivo da desistência é o prazo
+        if (retry_is_retryable(err) && retry_remaining_us(a->retry.deadline_us) <= 0) {
+            err = MODBUS_ERR_DEADLINE;
+        }
+        complete_active(a, -1, err);
+        return;
+    }
+
+    metrics_count_retry(a->frame.buf[0], a->frame.buf[1]);
+    if (delay_us == 0) {
+        send_attempt(a);
+        return;
+    }
+
+    a->state = ASYNC_BACKOFF;
+    arm_timer(a, retry_now_us() + delay_us);
+}
+
+static int rtu_t35_us(const modbus_async_t *a) {
+    return a->timing.frame_gap_us > 0 ? a->timing.frame_gap_us : uart_frame_gap_us(a->baudrate);
+}
+
+static void trace_resync(modbus_async_t *a) {
+    if (a->rx.skipped > 0 || a->rx.echo > 0) {
+        TRACE_INFO(TRACE_EV_RESYNC, a->active->addr, a->active->func, a->rx.skipped, a->rx.echo);
+    }
+}
+
+// Nada pendente do quadro (eco, ruído descartado): volta a esperar a resposta
+static void resume_waiting(modbus_async_t *a) {
+    a->active->response_len = 0;
+    a->state = ASYNC_WAITING;
+    arm_timer(a, a->wait_until_us);
+}
+
+static void finish_attempt(modbus_async_t *a) {
+    modbus_txn_t *txn = a->active;
+
+    arm_timer(a, 0);
+    record_attempt(a, retry_now_us());
+    trace_resync(a);
+    if (modbus_rx_finish(&a->rx) == MODBUS_RX_OK || a->rx.status == MODBUS_RX_EXCEPTION) {
+        txn->response_len = a->rx.len;  // Sem bytes além do CRC
+    }
+    TRACE_FRAME(TRACE_EV_RX, txn->response, txn->response_len);
+
+    modbus_error_t err = modbus_rx_result(&a->rx);
+    if (err == MODBUS_OK) {
+        complete_active(a, 0, MODBUS_OK);
+        return;
+    }
+    attempt_failed(a, err);
+}
+
+// Quadro inteiro no buffer da UART: começa a esperar a resposta
+static void start_waiting(modbus_async_t *a) {
+    set_want_write(a, 0);
+    a->sent_us = retry_now_us();
+    a->state = ASYNC_WAITING;
+
+    // write() não espera a linha: soma o tempo de transmissão ao timeout
+    int64_t tx_us = (int64_t)a->frame.len * RTU_BITS_PER_CHAR * 1000000 / a->baudrate;
+    int64_t at_us = a->sent_us + tx_us + a->timing.turnaround_us + (int64_t)a->timing.response_timeout_ms * 1000;
+    if (a->retry.deadline_us != 0 && a->retry.deadline_us < at_us) {
+        at_us = a->retry.deadline_us;
+    }
+    a->wait_until_us = at_us;
+    arm_timer(a, at_us);
+}
+
+static void on_writable(modbus_async_t *a) {
+    while (a->sent < a->frame.len) {
+        ssize_t n = write(a->uart_fd, a->frame.buf + a->sent, a->frame.len - a->sent);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                set_want_write(a, 1);
+                return;
+            }
+            perror("Erro ao escrever na UART");
+            record_attempt(a, retry_now_us());
+            attempt_failed(a, MODBUS_ERR_IO);
+            return;
+        }
+        bus_capture_frame(a->uart_fd, BUS_CAPTURE_TX, a->frame.buf + a->sent, (int)n);
+        a->sent += (int)n;
+    }
+
+    start_waiting(a);
+}
+
+static void send_attempt(modbus_async_t *a) {
+    if (retry_remaining_us(a->retry.deadline_us) <= 0) {
+        complete_active(a, -1, MODBUS_ERR_DEADLINE);
+        return;
+    }
+
+    a->active->response_len = 0;
+    modbus_rx_init(&a->rx, a->active->response, sizeof(a->active->response), a->active->addr, a->active->func);
+    modbus_rx_set_request(&a->rx, a->frame.buf, a->frame.len);
+    modbus_rx_set_trailer(&a->rx, a->timing.response_trailer);
+
+    // O que chegou antes do envio não é resposta a esta requisição
+    int stale = uart_discard_input(a->uart_fd);
+    if (stale > 0) {
+        a->rx.skipped += stale;
+    }
+    a->sent = 0;
+    a->sent_us = 0;
+    a->start_us = retry_now_us();
+    a->state = ASYNC_SENDING;
+    TRACE_FRAME(TRACE_EV_TX, a->frame.buf, a->frame.len);
+
+    on_writable(a);
+}
+
+static void start_next(modbus_async_t *a) {
+    modbus_txn_t *txn = NULL;
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT && txn == NULL; prio++) {
+        txn = fifo_pop(&a->queue[prio]);
+    }
+    if (txn == NULL) {
+        return;
+    }
+
+    a->active = txn;
+    modbus_frame_begin(&a->frame, txn->addr, txn->func);
+    modbus_frame_put_bytes(&a->frame, txn->data, txn->data_len);
+    if (modbus_frame_finish(&a->frame, a->matricula) < 0) {
+        complete_active(a, -1, MODBUS_ERR_FRAME);
+        return;
+    }
+
+    modbus_get_device_timing(txn->addr, &a->timing);
+    retry_begin(&a->retry, NULL, txn->deadline_us);
+    send_attempt(a);
+}
+
+static void on_readable(modbus_async_t *a) {
+    modbus_txn_t *txn = a->active;
+    int received = 0;
+
+    if (a->state != ASYNC_WAITING && a->state != ASYNC_RECEIVING) {
+        // Bytes fora de uma resposta (ruído, resposta atrasada): descarta
+        uint8_t scratch[64];
+        ssize_t n;
+        while ((n = read(a->uart_fd, scratch, sizeof(scratch))) > 0) {
+            bus_capture_frame(a->uart_fd, BUS_CAPTURE_RX, scratch, (int)n);
+        }
+        return;
+    }
+
+    while (a->rx.avail + received < (int)sizeof(txn->response)) {
+        ssize_t n = read(a->uart_fd, txn->response + a->rx.avail + received,
+                         sizeof(txn->response) - a->rx.avail - received);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            perror("Erro ao ler da UART");
+            arm_timer(a, 0);
+            record_attempt(a, retry_now_us());
+            attempt_failed(a, MODBUS_ERR_IO);
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        bus_capture_frame(a->uart_fd, BUS_CAPTURE_RX, txn->response + a->rx.avail + received, (int)n);
+        received += (int)n;
+    }
+
+    if (received == 0) {
+        return;
+    }
+
+    modbus_rx_push(&a->rx, received);
+    txn->response_len = a->rx.avail;
+    if (a->rx.avail == 0) {
+        resume_waiting(a);
+        return;
+    }
+
+    a->state = ASYNC_RECEIVING;
+    if ((modbus_rx_done(&a->rx) && !modbus_rx_rejected(&a->rx)) ||
+        txn->response_len == (int)sizeof(txn->response)) {
+        finish_attempt(a);
+        return;
+    }
+
+    // Quadro rejeitado: o resto é descartado até o silêncio de t3.5
+    if (modbus_rx_rejected(&a->rx)) {
+        a->gap_phase = 1;
+        arm_timer(a, retry_now_us() + rtu_t35_us(a));
+        return;
+    }
+
+    // Silêncio de t1.5 a partir do último byte
+    a->gap_phase = 0;
+    arm_timer(a, retry_now_us() + a->t15_us);
+}
+
+static void on_timer(modbus_async_t *a) {
+    modbus_txn_t *txn = a->active;
+
+    switch (a->state) {
+        case ASYNC_IDLE:
+            start_next(a);
+            break;
+
+        case ASYNC_WAITING:
+            record_attempt(a, retry_now_us());
+            trace_resync(a);
+            TRACE_ERROR(TRACE_EV_TIMEOUT, txn->addr, txn->func, 0, 0);
+            metrics_count_error(txn->addr, txn->func, METRICS_ERR_TIMEOUT);
+            attempt_failed(a, MODBUS_ERR_TIMEOUT);
+            break;
+
+        case ASYNC_RECEIVING: {
+            int t35_us = rtu_t35_us(a);
+
+            // Silêncio de t1.5: se o CRC já fecha, o quadro terminou
+            if (a->gap_phase == 0 && !(a->rx.len >= 4 && a->rx.crc == 0) &&
+                t35_us > a->t15_us) {
+                a->gap_phase = 1;
+                arm_timer(a, retry_now_us() + t35_us - a->t15_us);
+                break;
+            }
+            if (modbus_rx_finish(&a->rx) == MODBUS_RX_MORE && retry_now_us() < a->wait_until_us) {
+                // Quadro interrompido (ruído, resposta atrasada cortada): continua esperando
+                modbus_rx_discard(&a->rx);
+                resume_waiting(a);
+                break;
+            }
+            finish_attempt(a);
+            break;
+        }
+
+        case ASYNC_BACKOFF:
+            send_attempt(a);
+            break;
+
+        case ASYNC_SENDING:
+            break;
+    }
+}
+
+modbus_async_t *modbus_async_create(int uart_fd, const char *matricula) {
+    modbus_async_t *a = calloc(1, sizeof(*a));
+    if (a == NULL) {
+        return NULL;
+    }
+
+    a->uart_fd = uart_fd;
+    a->epoll_fd = -1;
+    a->timer_fd = -1;
+    memcpy(a->matricula, matricula, 4);
+    a->matricula[4] = '\0';
+
+    a->baudrate = uart_get_baudrate(uart_fd);
+    if (a->baudrate <= 0) {
+        a->baudrate = 9600;
+    }
+    a->t15_us = uart_char_gap_us(a->baudrate);
+
+    a->uart_flags = fcntl(uart_fd, F_GETFL);
+    if (a->uart_flags < 0 || fcntl(uart_fd, F_SETFL, a->uart_flags | O_NONBLOCK) < 0) {
+        perror("Erro ao configurar a UART como não bloqueante");
+        free(a);
+        return NULL;
+    }
+
+    a->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    a->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (a->epoll_fd < 0 || a->timer_fd < 0) {
+        perror("Erro ao criar o epoll do barramento");
+        modbus_async_destroy(a);
+        return NULL;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = uart_fd };
+    struct epoll_event tev = { .events = EPOLLIN, .data.fd = a->timer_fd };
+    if (epoll_ctl(a->epoll_fd, EPOLL_CTL_ADD, uart_fd, &ev) < 0 ||
+        epoll_ctl(a->epoll_fd, EPOLL_CTL_ADD, a->timer_fd, &tev) < 0) {
+        perror("Erro no epoll do barramento");
+        modbus_async_destroy(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+void modbus_async_destroy(modbus_async_t *a) {
+    if (a == NULL) {
+        return;
+    }
+
+    if (a->active != NULL) {
+        modbus_txn_t *txn = a->active;
+        a->active = NULL;
+        deliver(a, txn, -1, MODBUS_ERR_IO);
+    }
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        modbus_txn_t *txn;
+        while ((txn = fifo_pop(&a->queue[prio])) != NULL) {
+            deliver(a, txn, -1, MODBUS_ERR_IO);
+        }
+    }
+
+    if (a->timer_fd >= 0) {
+        close(a->timer_fd);
+    }
+    if (a->epoll_fd >= 0) {
+        close(a->epoll_fd);
+    }
+    fcntl(a->uart_fd, F_SETFL, a->uart_flags);
+    free(a);
+}
+
+int modbus_async_fd(const modbus_async_t *a) {
+    return a->epoll_fd;
+}
+
+int modbus_async_submit(modbus_async_t *a, modbus_txn_t *txn) {
+    if (txn->call != NULL || txn->priority < 0 || txn->priority >= MODBUS_PRIO_COUNT) {
+        return -1;
+    }
+
+    if (txn->deadline_us == 0) {
+        txn->deadline_us = retry_get_deadline();
+    }
+    atomic_store(&txn->done, 0);
+    txn->response_len = 0;
+
+    fifo_push(&a->queue[txn->priority], txn);
+    a->pending++;
+
+    // O envio começa em modbus_async_process(): callbacks só rodam dentro dele
+    if (a->state == ASYNC_IDLE) {
+        arm_timer(a, 1);
+    }
+    return 0;
+}
+
+int modbus_async_process(modbus_async_t *a) {
+    struct epoll_event events[4];
+    int timer_ready = 0;
+
+    a->completed = 0;
+
+    int n = epoll_wait(a->epoll_fd, events, 4, 0);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("Erro no epoll do barramento");
+        return -1;
+    }
+
+    // UART antes do timer: bytes que chegaram junto com o timeout ainda contam
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == a->timer_fd) {
+            timer_ready = 1;
+            continue;
+        }
+        if ((events[i].events & EPOLLOUT) && a->state == ASYNC_SENDING) {
+            on_writable(a);
+        }
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            on_readable(a);
+        }
+    }
+
+    if (timer_ready) {
+        uint64_t expirations;
+        // Rearmado durante o tratamento da UART: a expiração antiga foi descartada
+        if (read(a->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            on_timer(a);
+        }
+    }
+
+    return a->completed;
+}
+
+int modbus_async_pending(const modbus_async_t *a) {
+    return a->pending;
+}
@@ -0,0 +1,83 @@
+#ifndef MODBUS_ASYNC_H
+#define MODBUS_ASYNC_H
+
+#include <stdint.h>
+#include "modbus_parking.h"
+#include "modbus_bus.h"
+
+/*
+ * Mestre não bloqueante para laços de eventos: em vez de uma thread de E/S
+ * (modbus_bus), as transações avançam dentro do laço da aplicação, que já
+ * multiplexa sockets e timers. Internamente há um epoll com a UART (em modo
+ * O_NONBLOCK) e um timerfd para o timeout de resposta, os silêncios t1.5/t3.5
+ * de fim de quadro e o backoff das retentativas; para fora é exposto um único
+ * fd, que fica legível sempre que há algo a processar.
+ *
+ * Uso:
+ *     modbus_async_t *a = modbus_async_create(uart_fd, matricula);
+ *     epoll_ctl(loop, EPOLL_CTL_ADD, modbus_async_fd(a), &(struct epoll_event){ .events = EPOLLIN });
+ *     ...
+ *     modbus_async_submit(a, &txn);           // txn com callback
+ *     ...
+ *     // no laço, quando modbus_async_fd(a) ficar legível:
+ *     modbus_async_process(a);
+ *
+ * Com io_uring, o mesmo fd serve a um IORING_OP_POLL_ADD (POLLIN) do anel da
+ * aplicação: quando a conclusão chegar, chame modbus_async_process() e
+ * rearme o poll.
+ *
+ * As transações são as do modbus_bus (modbus_txn_init, _read, _write) e
+ * terminam pelo callback, chamado dentro de modbus_async_process(); com
+ * txn->error == MODBUS_ERR_EXCEPTION, txn->response traz o quadro de exceção. O
+ * contexto não é thread-safe: todas as chamadas devem vir da thread do laço.
+ * Como no modbus_bus, modbus_txn_done() vale com e sem callback, e uma
+ * transação sem callback pode ser esperada por outra thread com
+ * modbus_txn_wait().
+ */
+
+typedef struct modbus_async modbus_async_t;
+
+/**
+ * @brief Cria o contexto assíncrono de uma porta
+ *
+ * A UART passa a O_NONBLOCK até modbus_async_destroy() e não deve ser usada
+ * pela API bloqueante nesse intervalo.
+ *
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @return Contexto ou NULL em caso de erro
+ */
+modbus_async_t *modbus_async_create(int uart_fd, const char *matricula);
+
+/**
+ * @brief Libera o contexto; transações pendentes terminam com erro
+ */
+void modbus_async_destroy(modbus_async_t *a);
+
+/**
+ * @brief fd a registrar no laço da aplicação (EPOLLIN)
+ */
+int modbus_async_fd(const modbus_async_t *a);
+
+/**
+ * @brief Enfileira uma transação
+ *
+ * Operações compostas (modbus_txn_init_call) não são aceitas: elas bloqueiam.
+ * O prazo é txn->deadline_us ou, se zero, o da thread (retry_set_deadline).
+ *
+ * @return 0 em caso de sucesso, -1 se a transação não for suportada
+ */
+int modbus_async_submit(modbus_async_t *a, modbus_txn_t *txn);
+
+/**
+ * @brief Processa os eventos prontos da UART e do timer, sem bloquear
+ * @return Número de transações concluídas ou -1 em caso de erro
+ */
+int modbus_async_process(modbus_async_t *a);
+
+/**
+ * @brief Transações em andamento ou na fila
+ */
+int modbus_async_pending(const modbus_async_t *a);
+
+#endif
@@ -0,0 +1,825 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "modbus_bus.h"
+#include "crc16.h"
+#include "config.h"
+#include "lpr_capture.h"
+#include "retry.h"
+
+// Máximo de leituras atendidas por uma única leitura de cobertura
+#define MODBUS_READ_MERGE_MAX 16
+
+// Fila MPSC intrusiva (Vyukov): produtores só fazem uma troca atômica
+typedef struct {
+    _Atomic(modbus_node_t *) head;  // Lado dos produtores
+    modbus_node_t *tail;            // Lado da thread de E/S
+    modbus_node_t stub;
+} mpsc_queue_t;
+
+// Lista FIFO local da thread de E/S (transações já retiradas das filas MPSC)
+typedef struct {
+    modbus_node_t *head;
+    modbus_node_t *tail;
+} txn_list_t;
+
+struct modbus_bus {
+    int uart_fd;
+    char matricula[5];
+    pthread_t thread;
+    int wake_fd;              // eventfd para acordar a thread de E/S
+    atomic_int sleeping;      // Thread de E/S bloqueada no eventfd
+    atomic_int stopping;
+    atomic_int submitters;    // Submissões em andamento (a parada espera por elas)
+    mpsc_queue_t queues[MODBUS_PRIO_COUNT];
+    txn_list_t ready[MODBUS_PRIO_COUNT];  // Só a thread de E/S acessa
+    txn_list_t delayed;                   // Esperando o backoff de uma retentativa (idem)
+    atomic_int read_window_us;            // Espera por leituras próximas com o barramento ocioso
+    atomic_int read_max_span;             // Maior leitura de cobertura (registradores)
+};
+
+static void mpsc_init(mpsc_queue_t *q) {
+    atomic_store(&q->stub.next, NULL);
+    atomic_store(&q->head, &q->stub);
+    q->tail = &q->stub;
+}
+
+static void mpsc_push(mpsc_queue_t *q, modbus_node_t *node) {
+    atomic_store(&node->next, NULL);
+    modbus_node_t *prev = atomic_exchange(&q->head, node);
+    atomic_store(&prev->next, node);
+}
+
+// Retorna NULL se vazia (ou se um produtor ainda está ligando o nó)
+static modbus_node_t *mpsc_pop(mpsc_queue_t *q) {
+    modbus_node_t *tail = q->tail;
+    modbus_node_t *next = atomic_load(&tail->next);
+
+    if (tail == &q->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load(&next->next);
+    }
+
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load(&q->head)) {
+        return NULL;
+    }
+
+    mpsc_push(q, &q->stub);
+
+    next = atomic_load(&tail->next);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+static void list_append(txn_list_t *list, modbus_node_t *node) {
+    atomic_store(&node->next, NULL);
+    if (list->tail == NULL) {
+        list->head = node;
+    } else {
+        atomic_store(&list->tail->next, node);
+    }
+    list->tail = node;
+}
+
+// Move tudo o que já foi submetido para as listas locais
+static int drain_queues(modbus_bus_t *bus) {
+    int moved = 0;
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        modbus_node_t *node;
+        while ((node = mpsc_pop(&bus->queues[prio])) != NULL) {
+            list_append(&bus->ready[prio], node);
+            moved++;
+        }
+    }
+
+    return moved;
+}
+
+static int ready_empty(modbus_bus_t *bus) {
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        if (bus->ready[prio].head != NULL) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void list_remove(txn_list_t *list, modbus_node_t *prev, modbus_node_t *node) {
+    modbus_node_t *next = atomic_load(&node->next);
+
+    if (prev == NULL) {
+        list->head = next;
+    } else {
+        atomic_store(&prev->next, next);
+    }
+    if (list->tail == node) {
+        list->tail = prev;
+    }
+}
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Põe de lado uma transação que falhou e será refeita daqui a delay_us
+static void delay_txn(modbus_bus_t *bus, modbus_txn_t *txn, int64_t delay_us) {
+    txn->retry_at_us = monotonic_us() + delay_us;
+    list_append(&bus->delayed, &txn->node);
+}
+
+/*
+ * Devolve à frente da fila as transações cujo backoff acabou, na ordem em
+ * que saíram: elas vinham antes de tudo o que ficou esperando por elas.
+ */
+static void release_delayed(modbus_bus_t *bus) {
+    txn_list_t due[MODBUS_PRIO_COUNT] = { 0 };
+    modbus_node_t *prev = NULL;
+    modbus_node_t *node = bus->delayed.head;
+    int64_t now = monotonic_us();
+
+    while (node != NULL) {
+        modbus_node_t *next = atomic_load(&node->next);
+        modbus_txn_t *txn = (modbus_txn_t *)node;
+
+        if (txn->retry_at_us > now) {
+            prev = node;
+            node = next;
+            continue;
+        }
+
+        list_remove(&bus->delayed, prev, node);
+        int prio = txn->priority >= 0 && txn->priority < MODBUS_PRIO_COUNT ? txn->priority : MODBUS_PRIO_NORMAL;
+        list_append(&due[prio], node);
+        node = next;
+    }
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        txn_list_t *list = &bus->ready[prio];
+        if (due[prio].head == NULL) {
+            continue;
+        }
+        atomic_store(&due[prio].tail->next, list->head);
+        if (list->tail == NULL) {
+            list->tail = due[prio].tail;
+        }
+        list->head = due[prio].head;
+    }
+}
+
+// Espera até o fim do backoff mais próximo (-1 = nenhuma transação adiada)
+static int64_t delayed_wait_us(modbus_bus_t *bus) {
+    int64_t earliest = -1;
+
+    for (modbus_node_t *node = bus->delayed.head; node != NULL; node = atomic_load(&node->next)) {
+        modbus_txn_t *txn = (modbus_txn_t *)node;
+        if (earliest < 0 || txn->retry_at_us < earliest) {
+            earliest = txn->retry_at_us;
+        }
+    }
+
+    if (earliest < 0) {
+        return -1;
+    }
+    earliest -= monotonic_us();
+    return earliest > 0 ? earliest : 0;
+}
+
+// Transação que não pode sair antes de uma adiada do mesmo escravo
+static int held_back(modbus_bus_t *bus, const modbus_txn_t *txn) {
+    for (modbus_node_t *node = bus->delayed.head; node != NULL; node = atomic_load(&node->next)) {
+        const modbus_txn_t *delayed = (const modbus_txn_t *)node;
+        if (delayed->addr != 0 && delayed->addr == txn->addr) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static modbus_txn_t *next_txn(modbus_bus_t *bus) {
+    drain_queues(bus);
+    if (bus->delayed.head != NULL) {
+        release_delayed(bus);
+    }
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        txn_list_t *list = &bus->ready[prio];
+        modbus_node_t *prev = NULL;
+
+        for (modbus_node_t *node = list->head; node != NULL; node = atomic_load(&node->next)) {
+            if (bus->delayed.head == NULL || !held_back(bus, (modbus_txn_t *)node)) {
+                list_remove(list, prev, node);
+                return (modbus_txn_t *)node;
+            }
+            prev = node;
+        }
+    }
+
+    return NULL;
+}
+
+static void futex_wake(atomic_int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void futex_wait(atomic_int *addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void finish_txn(modbus_txn_t *txn, int result, modbus_error_t err) {
+    txn->result = result;
+    txn->error = err;
+
+    // Com callback, done é marcado antes: o callback pode reutilizar ou liberar a transação
+    if (txn->callback != NULL) {
+        atomic_store(&txn->done, 1);
+        txn->callback(txn, txn->user);
+        return;
+    }
+
+    atomic_store(&txn->done, 1);
+    futex_wake(&txn->done);
+}
+
+static void complete_txn(modbus_txn_t *txn, int result) {
+    finish_txn(txn, result, result == 0 ? MODBUS_OK : modbus_last_error());
+}
+
+// Intervalo [start, start + count) de uma leitura 0x03 simples; 0 se não for uma
+static int read_range(const modbus_txn_t *txn, uint16_t *start, uint16_t *count) {
+    if (txn->call != NULL || txn->func != MODBUS_READ_HOLDING_REGS || txn->data_len != 4) {
+        return 0;
+    }
+
+    *start = txn->data[0] | (txn->data[1] << 8);
+    *count = txn->data[2] | (txn->data[3] << 8);
+
+    return *count > 0 && *count <= MODBUS_READ_MAX_REGS;
+}
+
+// Com o barramento ocioso, espera até window_us por submissões próximas
+static void wait_read_window(modbus_bus_t *bus, int window_us) {
+    int64_t deadline = monotonic_us() + window_us;
+
+    for (;;) {
+        int64_t remaining = deadline - monotonic_us();
+        if (remaining <= 0 || atomic_load(&bus->stopping)) {
+            break;
+        }
+
+        atomic_store(&bus->sleeping, 1);
+        if (drain_queues(bus) > 0) {
+            atomic_store(&bus->sleeping, 0);
+            continue;
+        }
+
+        struct pollfd pfd = { .fd = bus->wake_fd, .events = POLLIN };
+        struct timespec ts = { .tv_sec = remaining / 1000000, .tv_nsec = (remaining % 1000000) * 1000 };
+        if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+            uint64_t count;
+            if (read(bus->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                perror("Erro no eventfd do barramento");
+            }
+        }
+        atomic_store(&bus->sleeping, 0);
+    }
+
+    drain_queues(bus);
+}
+
+// Monta em txn a resposta de uma leitura [start, start + count) a partir dos valores lidos
+static void split_read_response(modbus_txn_t *txn, const uint16_t *values, uint16_t start, uint16_t count) {
+    uint8_t *r = txn->response;
+    int len = 0;
+
+    r[len++] = txn->addr;
+    r[len++] = MODBUS_READ_HOLDING_REGS;
+    r[len++] = (uint8_t)(count * 2);
+    for (int i = 0; i < count; i++) {
+        r[len++] = values[start + i] & 0xFF;
+        r[len++] = (values[start + i] >> 8) & 0xFF;
+    }
+
+    uint16_t crc = crc16_modbus(r, len);
+    r[len++] = crc & 0xFF;
+    r[len++] = (crc >> 8) & 0xFF;
+    txn->response_len = len;
+}
+
+// Executa uma transação sozinha, sob o próprio prazo; falha com nova tentativa vai para o backoff
+static void run_single(modbus_bus_t *bus, modbus_txn_t *txn) {
+    int64_t previous = retry_set_deadline(txn->deadline_us);
+    retry_t *previous_retry = retry_attach(&txn->retry);
+
+    txn->response_len = modbus_request(bus->uart_fd, txn->addr, txn->func, txn->data, txn->data_len,
+                                       bus->matricula, txn->response, sizeof(txn->response));
+
+    retry_attach(previous_retry);
+    retry_set_deadline(previous);
+
+    if (txn->response_len <= 0 && txn->retry.delay_us >= 0) {
+        delay_txn(bus, txn, txn->retry.delay_us);
+        return;
+    }
+    complete_txn(txn, txn->response_len > 0 ? 0 : -1);
+}
+
+/*
+ * Transação depois da qual nenhuma leitura de addr pode ser adiantada: uma
+ * escrita (ou outra função) no mesmo escravo, ou uma operação composta sem
+ * escravo definido, que pode tocar qualquer um.
+ */
+static int read_barrier(const modbus_txn_t *txn, uint8_t addr) {
+    if (txn->call != NULL) {
+        return txn->addr == addr || txn->addr == 0;
+    }
+    return txn->addr == addr && txn->func != MODBUS_READ_HOLDING_REGS;
+}
+
+/*
+ * Junta ao líder as leituras pendentes do mesmo escravo cuja união ainda cabe
+ * numa leitura de cobertura: no RS485 o que pesa é a ida e volta (quadro,
+ * turnaround, resposta), não os 2 bytes de cada registrador a mais.
+ *
+ * As listas são percorridas na ordem de execução, e a busca para na primeira
+ * transação que não é leitura do mesmo escravo: uma leitura submetida depois
+ * de uma escrita nunca é adiantada para antes dela.
+ */
+static void run_read_group(modbus_bus_t *bus, modbus_txn_t *leader, uint16_t start, uint16_t count) {
+    modbus_txn_t *group[MODBUS_READ_MERGE_MAX];
+    uint16_t group_start[MODBUS_READ_MERGE_MAX];
+    uint16_t group_count[MODBUS_READ_MERGE_MAX];
+    uint16_t values[MODBUS_READ_MAX_REGS];
+    int max_span = atomic_load(&bus->read_max_span);
+    int window_us = atomic_load(&bus->read_window_us);
+    int lo = start;
+    int hi = start + count;
+    int n = 0;
+    int barrier = 0;
+
+    if (window_us > 0 && ready_empty(bus)) {
+        wait_read_window(bus, window_us);
+    }
+
+    group[n] = leader;
+    group_start[n] = start;
+    group_count[n] = count;
+    n++;
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT && n < MODBUS_READ_MERGE_MAX && !barrier; prio++) {
+        txn_list_t *list = &bus->ready[prio];
+        modbus_node_t *prev = NULL;
+        modbus_node_t *node = list->head;
+
+        while (node != NULL && n < MODBUS_READ_MERGE_MAX) {
+            modbus_node_t *next = atomic_load(&node->next);
+            modbus_txn_t *txn = (modbus_txn_t *)node;
+            uint16_t s, c;
+
+            if (read_barrier(txn, leader->addr)) {
+                barrier = 1;
+                break;
+            }
+
+            if (txn->addr == leader->addr && read_range(txn, &s, &c)) {
+                int new_lo = s < lo ? s : lo;
+                int new_hi = s + c > hi ? s + c : hi;
+
+                if (new_hi - new_lo <= max_span) {
+                    list_remove(list, prev, node);
+                    group[n] = txn;
+                    group_start[n] = s;
+                    group_count[n] = c;
+                    n++;
+                    lo = new_lo;
+                    hi = new_hi;
+                    node = next;
+                    continue;
+                }
+            }
+
+            prev = node;
+            node = next;
+        }
+    }
+
+    if (n == 1) {
+        run_single(bus, leader);
+        return;
+    }
+
+    // A leitura de cobertura respeita o prazo mais curto do grupo
+    int64_t group_deadline = 0;
+    for (int i = 0; i < n; i++) {
+        if (group[i]->deadline_us != 0 && (group_deadline == 0 || group[i]->deadline_us < group_deadline)) {
+            group_deadline = group[i]->deadline_us;
+        }
+    }
+
+    int64_t previous = retry_set_deadline(group_deadline);
+    retry_t *previous_retry = retry_attach(&leader->retry);
+    int ret = modbus_read_holding_registers(bus->uart_fd, leader->addr, lo, hi - lo,
+                                            bus->matricula, values);
+    modbus_error_t err = ret == 0 ? MODBUS_OK : modbus_last_error();
+    retry_attach(previous_retry);
+    retry_set_deadline(previous);
+
+    // O grupo inteiro espera o backoff e volta junto à fila (a junção se refaz)
+    if (ret != 0 && leader->retry.delay_us >= 0) {
+        for (int i = 0; i < n; i++) {
+            delay_txn(bus, group[i], leader->retry.delay_us);
+        }
+        return;
+    }
+    retry_reset(&leader->retry);
+
+    for (int i = 0; i < n; i++) {
+        modbus_txn_t *txn = group[i];
+
+        if (ret == 0) {
+            split_read_response(txn, values, group_start[i] - lo, group_count[i]);
+            complete_txn(txn, 0);
+            continue;
+        }
+
+        /*
+         * Exceção (ex: 0x02, a união cobre registradores inexistentes): cada
+         * leitura pode dar certo sozinha. Prazo esgotado: só o do grupo, o de
+         * quem tem prazo mais longo ainda vale.
+         */
+        if (err == MODBUS_ERR_EXCEPTION ||
+            (err == MODBUS_ERR_DEADLINE && txn->deadline_us != group_deadline)) {
+            run_single(bus, txn);
+            continue;
+        }
+
+        txn->response_len = 0;
+        finish_txn(txn, -1, err);
+    }
+}
+
+static void dispatch_txn(modbus_bus_t *bus, modbus_txn_t *txn) {
+    uint16_t start, count;
+
+    if (txn->call != NULL) {
+        retry_t *previous_retry = retry_attach(&txn->retry);
+        int result = txn->call(bus->uart_fd, bus->matricula, txn->call_arg);
+        retry_attach(previous_retry);
+
+        // Uma transação da operação vai ser repetida: a operação inteira é refeita depois
+        if (result != 0 && txn->retry.delay_us >= 0) {
+            delay_txn(bus, txn, txn->retry.delay_us);
+            return;
+        }
+        complete_txn(txn, result);
+        return;
+    }
+
+    if (read_range(txn, &start, &count)) {
+        run_read_group(bus, txn, start, count);
+        return;
+    }
+
+    run_single(bus, txn);
+}
+
+static void run_txn(modbus_bus_t *bus, modbus_txn_t *txn) {
+    // A transação pode ser liberada no callback: o prazo é lido antes
+    int64_t deadline_us = txn->deadline_us;
+
+    if (deadline_us == 0) {
+        dispatch_txn(bus, txn);
+        return;
+    }
+
+    int64_t previous = retry_set_deadline(deadline_us);
+    dispatch_txn(bus, txn);
+    retry_set_deadline(previous);
+}
+
+static void *bus_thread(void *arg) {
+    modbus_bus_t *bus = arg;
+
+    for (;;) {
+        modbus_txn_t *txn = next_txn(bus);
+        if (txn != NULL) {
+            run_txn(bus, txn);
+            continue;
+        }
+
+        if (atomic_load(&bus->stopping)) {
+            break;
+        }
+
+        // Fila vazia: resets de trigger adiados pelas capturas rápidas (lpr_capture.h)
+        if (lpr_capture_flush_one_reset(bus->uart_fd, bus->matricula)) {
+            continue;
+        }
+
+        // e a atualização agrupada do placar cujo intervalo venceu
+        if (placar_flush_one(bus->uart_fd, bus->matricula)) {
+            continue;
+        }
+
+        // Anuncia que vai dormir e confere as filas de novo antes de bloquear
+        atomic_store(&bus->sleeping, 1);
+        txn = next_txn(bus);
+        if (txn != NULL) {
+            atomic_store(&bus->sleeping, 0);
+            run_txn(bus, txn);
+            continue;
+        }
+
+        // Acorda no fim do backoff mais próximo ou quando o placar pendente vence, se vier antes
+        int64_t wait_us = delayed_wait_us(bus);
+        int64_t placar_us = placar_pending_wait_us(bus->uart_fd);
+        if (placar_us >= 0 && (wait_us < 0 || placar_us < wait_us)) {
+            wait_us = placar_us;
+        }
+        if (wait_us < 0 || wait_us > 100000) {
+            wait_us = 100000;
+        }
+
+        struct pollfd pfd = { .fd = bus->wake_fd, .events = POLLIN };
+        struct timespec ts = { .tv_sec = wait_us / 1000000, .tv_nsec = (wait_us % 1000000) * 1000 };
+        if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+            uint64_t count;
+            if (read(bus->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                perror("Erro no eventfd do barramento");
+            }
+        }
+        atomic_store(&bus->sleeping, 0);
+    }
+
+    /*
+     * Uma submissão que passou pela verificação de stopping ainda pode estar
+     * ligando o nó na fila (mpsc_pop retorna NULL nesse meio tempo): espera
+     * todas terminarem para que nenhuma transação fique sem conclusão.
+     */
+    while (atomic_load(&bus->submitters) > 0) {
+        sched_yield();
+    }
+
+    // Cancela o que ficou na fila e o que esperava o backoff
+    modbus_txn_t *txn;
+    for (modbus_node_t *node = bus->delayed.head; node != NULL; ) {
+        modbus_node_t *next = atomic_load(&node->next);
+        txn = (modbus_txn_t *)node;
+        txn->response_len = 0;
+        finish_txn(txn, -1, MODBUS_ERR_IO);
+        node = next;
+    }
+    bus->delayed.head = NULL;
+    bus->delayed.tail = NULL;
+
+    while ((txn = next_txn(bus)) != NULL) {
+        txn->response_len = 0;
+        finish_txn(txn, -1, MODBUS_ERR_IO);
+    }
+
+    return NULL;
+}
+
+modbus_bus_t *modbus_bus_start(int uart_fd, const char *matricula) {
+    modbus_bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return NULL;
+    }
+
+    bus->uart_fd = uart_fd;
+    memcpy(bus->matricula, matricula, 4);
+    bus->matricula[4] = '\0';
+
+    for (int prio = 0; prio < MODBUS_PRIO_COUNT; prio++) {
+        mpsc_init(&bus->queues[prio]);
+    }
+    atomic_store(&bus->read_max_span, MODBUS_READ_MAX_REGS);
+
+    bus->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (bus->wake_fd < 0) {
+        perror("Erro ao criar eventfd");
+        free(bus);
+        return NULL;
+    }
+
+    if (pthread_create(&bus->thread, NULL, bus_thread, bus) != 0) {
+        fprintf(stderr, "Erro ao criar a thread do barramento\n");
+        close(bus->wake_fd);
+        free(bus);
+        return NULL;
+    }
+
+    return bus;
+}
+
+static void wake_bus(modbus_bus_t *bus) {
+    if (atomic_exchange(&bus->sleeping, 0)) {
+        uint64_t one = 1;
+        if (write(bus->wake_fd, &one, sizeof(one)) < 0) {
+            perror("Erro ao acordar a thread do barramento");
+        }
+    }
+}
+
+void modbus_bus_stop(modbus_bus_t *bus) {
+    if (bus == NULL) {
+        return;
+    }
+
+    uint64_t one = 1;
+    atomic_store(&bus->stopping, 1);
+    if (write(bus->wake_fd, &one, sizeof(one)) < 0) {
+        perror("Erro ao acordar a thread do barramento");
+    }
+    pthread_join(bus->thread, NULL);
+
+    // Submissões recusadas depois da thread sair ainda estão saindo de modbus_bus_submit
+    while (atomic_load(&bus->submitters) > 0) {
+        sched_yield();
+    }
+
+    close(bus->wake_fd);
+    free(bus);
+}
+
+void modbus_bus_set_read_coalescing(modbus_bus_t *bus, int window_us, int max_span) {
+    if (max_span <= 0 || max_span > MODBUS_READ_MAX_REGS) {
+        max_span = MODBUS_READ_MAX_REGS;
+    }
+
+    atomic_store(&bus->read_window_us, window_us > 0 ? window_us : 0);
+    atomic_store(&bus->read_max_span, max_span);
+}
+
+void modbus_bus_load_config(modbus_bus_t *bus) {
+    modbus_bus_set_read_coalescing(bus, config_get_int("MODBUS_READ_COALESCE_US", 0),
+                                   config_get_int("MODBUS_READ_MAX_SPAN", MODBUS_READ_MAX_REGS));
+}
+
+int modbus_txn_init(modbus_txn_t *txn, uint8_t addr, uint8_t func,
+                    const uint8_t *data, int data_len, modbus_prio_t priority) {
+    if (data_len < 0 || data_len > MODBUS_TXN_MAX_DATA) {
+        return -1;
+    }
+
+    memset(txn, 0, offsetof(modbus_txn_t, response));
+    txn->addr = addr;
+    txn->func = func;
+    if (data_len > 0) {
+        memcpy(txn->data, data, data_len);
+    }
+    txn->data_len = data_len;
+    txn->priority = priority;
+    txn->response_len = 0;
+    atomic_store(&txn->done, 0);
+
+    return 0;
+}
+
+int modbus_txn_init_read(modbus_txn_t *txn, uint8_t addr, uint16_t start, uint16_t count,
+                         modbus_prio_t priority) {
+    // Endereço inicial e quantidade em little-endian, como no resto da biblioteca
+    uint8_t data[] = {
+        start & 0xFF, (start >> 8) & 0xFF,
+        count & 0xFF, (count >> 8) & 0xFF
+    };
+
+    return modbus_txn_init(txn, addr, MODBUS_READ_HOLDING_REGS, data, sizeof(data), priority);
+}
+
+int modbus_txn_init_write(modbus_txn_t *txn, uint8_t addr, uint16_t start,
+                          const uint16_t *values, uint16_t count, modbus_prio_t priority) {
+    uint8_t data[MODBUS_TXN_MAX_DATA];
+    int idx = 0;
+
+    if (5 + count * 2 > MODBUS_TXN_MAX_DATA) {
+        return -1;
+    }
+
+    data[idx++] = start & 0xFF;
+    data[idx++] = (start >> 8) & 0xFF;
+    data[idx++] = count & 0xFF;
+    data[idx++] = (count >> 8) & 0xFF;
+    data[idx++] = (uint8_t)(count * 2);
+    for (int i = 0; i < count; i++) {
+        data[idx++] = values[i] & 0xFF;
+        data[idx++] = (values[i] >> 8) & 0xFF;
+    }
+
+    return modbus_txn_init(txn, addr, MODBUS_WRITE_MULTIPLE_REGS, data, idx, priority);
+}
+
+void modbus_txn_init_call(modbus_txn_t *txn, modbus_txn_fn fn, void *arg, modbus_prio_t priority) {
+    modbus_txn_init(txn, 0, 0, NULL, 0, priority);
+    txn->call = fn;
+    txn->call_arg = arg;
+}
+
+void modbus_txn_set_callback(modbus_txn_t *txn, modbus_txn_cb callback, void *user) {
+    txn->callback = callback;
+    txn->user = user;
+}
+
+int modbus_bus_submit(modbus_bus_t *bus, modbus_txn_t *txn) {
+    /*
+     * Contador antes da verificação (ambos seq_cst): ou a parada vê esta
+     * submissão e espera por ela, ou a submissão vê stopping e desiste.
+     */
+    atomic_fetch_add(&bus->submitters, 1);
+    if (atomic_load(&bus->stopping)) {
+        atomic_fetch_sub(&bus->submitters, 1);
+        return -1;
+    }
+
+    int prio = txn->priority;
+    if (prio < 0 || prio >= MODBUS_PRIO_COUNT) {
+        prio = MODBUS_PRIO_NORMAL;
+    }
+
+    atomic_store(&txn->done, 0);
+    retry_reset(&txn->retry);
+    mpsc_push(&bus->queues[prio], &txn->node);
+    wake_bus(bus);
+
+    atomic_fetch_sub(&bus->submitters, 1);
+    return 0;
+}
+
+int modbus_txn_wait(modbus_txn_t *txn) {
+    while (atomic_load(&txn->done) == 0) {
+        futex_wait(&txn->done, 0);
+    }
+
+    return txn->result;
+}
+
+int modbus_txn_done(modbus_txn_t *txn) {
+    return atomic_load(&txn->done);
+}
+
+int modbus_bus_execute(modbus_bus_t *bus, modbus_txn_t *txn) {
+    if (modbus_bus_submit(bus, txn) != 0) {
+        return -1;
+    }
+
+    return modbus_txn_wait(txn);
+}
+
+int modbus_bus_read_registers(modbus_bus_t *bus, uint8_t addr, uint16_t start, uint16_t count,
+                              uint16_t *values, modbus_prio_t priority) {
+    modbus_txn_t txn;
+
+    if (count == 0 || count > MODBUS_READ_MAX_REGS) {
+        return -1;
+    }
+
+    modbus_txn_init_read(&txn, addr, start, count, priority);
+    if (modbus_bus_execute(bus, &txn) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        values[i] = modbus_txn_register(&txn, i);
+    }
+
+    return 0;
+}
+
+uint16_t modbus_txn_register(const modbus_txn_t *txn, int index) {
+    // Resposta: [addr][func][byte_count][dados...][crc_lo][crc_hi]
+    int offset = 3 + index * 2;
+
+    if (offset + 1 >= txn->response_len - 2) {
+        return 0;
+    }
+
+    return txn->response[offset] | (txn->response[offset + 1] << 8);
+}
@@ -0,0 +1,206 @@
+#ifndef MODBUS_BUS_H
+#define MODBUS_BUS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "modbus_parking.h"
+#include "retry.h"
+
+/*
+ * Mestre do barramento: uma thread de E/S dona do fd da UART executa as
+ * transações submetidas por qualquer thread. A submissão é lock-free (uma
+ * fila MPSC por prioridade) e, entre uma transação e outra, a thread sempre
+ * atende primeiro a fila de maior prioridade.
+ *
+ * Leituras 0x03 pendentes para o mesmo escravo são atendidas por uma única
+ * leitura de cobertura e o resultado é repartido entre as transações.
+ *
+ * A thread de E/S nunca dorme no backoff de uma retentativa: a transação que
+ * falhou fica de lado até a espera acabar e o barramento atende as outras.
+ * Enquanto isso, as transações seguintes para o mesmo escravo também esperam,
+ * para que a ordem por escravo seja mantida.
+ */
+
+// Prioridades das transações (menor valor = mais urgente)
+typedef enum {
+    MODBUS_PRIO_CRITICAL = 0,  // Câmeras das cancelas
+    MODBUS_PRIO_NORMAL,
+    MODBUS_PRIO_LOW,           // Placar
+    MODBUS_PRIO_COUNT
+} modbus_prio_t;
+
+// Maior payload de requisição (quadro máximo - endereço, função, matrícula e CRC)
+#define MODBUS_TXN_MAX_DATA (MODBUS_MAX_FRAME - 8)
+
+typedef struct modbus_bus modbus_bus_t;
+typedef struct modbus_txn modbus_txn_t;
+
+/**
+ * @brief Callback de conclusão, chamado na thread de E/S
+ *
+ * A partir da chamada o chamador volta a ser dono da transação e pode
+ * reutilizá-la ou liberá-la dentro do próprio callback.
+ */
+typedef void (*modbus_txn_cb)(modbus_txn_t *txn, void *user);
+
+/**
+ * @brief Operação composta executada na thread de E/S com acesso exclusivo ao fd
+ * @return Valor armazenado em txn->result
+ */
+typedef int (*modbus_txn_fn)(int uart_fd, const char *matricula, void *arg);
+
+// Nó intrusivo da fila MPSC
+typedef struct modbus_node {
+    _Atomic(struct modbus_node *) next;
+} modbus_node_t;
+
+// Transação do barramento (memória do chamador, sem alocação)
+struct modbus_txn {
+    modbus_node_t node;  // Deve ser o primeiro membro
+
+    // Requisição
+    uint8_t addr;
+    uint8_t func;
+    uint8_t data[MODBUS_TXN_MAX_DATA];
+    int data_len;
+    modbus_txn_fn call;  // Se definido, executa call(fd, matricula, call_arg)
+    void *call_arg;
+    modbus_prio_t priority;
+    int64_t deadline_us;  // Prazo absoluto em CLOCK_MONOTONIC (0 = sem prazo, ver retry.h)
+
+    // Conclusão
+    modbus_txn_cb callback;
+    void *user;
+
+    // Retentativa em andamento (só a thread de E/S acessa)
+    retry_t retry;
+    int64_t retry_at_us;  // Instante em que a transação adiada volta à fila
+
+    // Resultado
+    int result;  // 0 em sucesso, -1 em erro
+    int error;   // modbus_error_t do resultado
+    uint8_t response[MODBUS_MAX_FRAME];
+    int response_len;
+    atomic_int done;
+};
+
+/**
+ * @brief Inicia a thread de E/S do barramento
+ * @param uart_fd File descriptor da UART (passa a ser usado só pela thread)
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @return Handle do barramento ou NULL em caso de erro
+ */
+modbus_bus_t *modbus_bus_start(int uart_fd, const char *matricula);
+
+/**
+ * @brief Encerra a thread de E/S; transações pendentes terminam com erro
+ *
+ * Submissões concorrentes com a parada ou terminam normalmente ou retornam
+ * -1; nenhuma fica sem conclusão. Depois do retorno o handle não existe
+ * mais: nenhuma thread pode voltar a usá-lo.
+ *
+ * @param bus Handle do barramento
+ */
+void modbus_bus_stop(modbus_bus_t *bus);
+
+/**
+ * @brief Configura a junção de leituras 0x03 do mesmo escravo
+ * @param bus Handle do barramento
+ * @param window_us Com o barramento ocioso, tempo que uma leitura espera por outras
+ *                  antes de sair (0 = junta só o que já estiver na fila)
+ * @param max_span Maior leitura de cobertura em registradores (até MODBUS_READ_MAX_REGS)
+ */
+void modbus_bus_set_read_coalescing(modbus_bus_t *bus, int window_us, int max_span);
+
+/**
+ * @brief Aplica MODBUS_READ_COALESCE_US e MODBUS_READ_MAX_SPAN da configuração
+ * @param bus Handle do barramento
+ */
+void modbus_bus_load_config(modbus_bus_t *bus);
+
+/**
+ * @brief Prepara uma transação genérica
+ * @param txn Transação
+ * @param addr Endereço do dispositivo
+ * @param func Código de função
+ * @param data Dados da requisição (após o código de função)
+ * @param data_len Tamanho dos dados (até MODBUS_TXN_MAX_DATA)
+ * @param priority Prioridade
+ * @return 0 em caso de sucesso, -1 se os dados não couberem
+ */
+int modbus_txn_init(modbus_txn_t *txn, uint8_t addr, uint8_t func,
+                    const uint8_t *data, int data_len, modbus_prio_t priority);
+
+/**
+ * @brief Prepara uma leitura de holding registers (0x03)
+ */
+int modbus_txn_init_read(modbus_txn_t *txn, uint8_t addr, uint16_t start, uint16_t count,
+                         modbus_prio_t priority);
+
+/**
+ * @brief Prepara uma escrita de múltiplos registradores (0x10)
+ */
+int modbus_txn_init_write(modbus_txn_t *txn, uint8_t addr, uint16_t start,
+                          const uint16_t *values, uint16_t count, modbus_prio_t priority);
+
+/**
+ * @brief Prepara uma operação composta (ex: lpr_capture_plate) na thread de E/S
+ *
+ * Com addr definido em txn->addr, a operação segue a ordem das transações
+ * daquele escravo. Se uma transação dela falhar e couber nova tentativa, a
+ * operação é refeita inteira depois do backoff (retry_attach): ela deve
+ * poder ser repetida.
+ */
+void modbus_txn_init_call(modbus_txn_t *txn, modbus_txn_fn fn, void *arg, modbus_prio_t priority);
+
+/**
+ * @brief Define o callback de conclusão (alternativa a modbus_txn_wait)
+ */
+void modbus_txn_set_callback(modbus_txn_t *txn, modbus_txn_cb callback, void *user);
+
+/**
+ * @brief Submete a transação (lock-free, pode ser chamada de qualquer thread)
+ * @return 0 em caso de sucesso, -1 se o barramento estiver parando
+ */
+int modbus_bus_submit(modbus_bus_t *bus, modbus_txn_t *txn);
+
+/**
+ * @brief Aguarda a conclusão de uma transação sem callback
+ * @return Resultado da transação (0 em sucesso, -1 em erro)
+ */
+int modbus_txn_wait(modbus_txn_t *txn);
+
+/**
+ * @brief Indica se a transação já terminou (sem bloquear)
+ *
+ * Vale nos dois modos: com callback, passa a 1 logo antes da chamada.
+ */
+int modbus_txn_done(modbus_txn_t *txn);
+
+/**
+ * @brief Submete e aguarda (atalho síncrono)
+ */
+int modbus_bus_execute(modbus_bus_t *bus, modbus_txn_t *txn);
+
+/**
+ * @brief Lê holding registers pelo barramento (síncrono, sujeito à junção de leituras)
+ * @param bus Handle do barramento
+ * @param addr Endereço do dispositivo
+ * @param start Primeiro registrador
+ * @param count Quantidade (1 a MODBUS_READ_MAX_REGS)
+ * @param values Vetor para os valores lidos
+ * @param priority Prioridade
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int modbus_bus_read_registers(modbus_bus_t *bus, uint8_t addr, uint16_t start, uint16_t count,
+                              uint16_t *values, modbus_prio_t priority);
+
+/**
+ * @brief Lê um registrador da resposta de uma leitura 0x03 (little-endian)
+ * @param txn Transação concluída com sucesso
+ * @param index Índice do registrador a partir do início da leitura
+ * @return Valor do registrador
+ */
+uint16_t modbus_txn_register(const modbus_txn_t *txn, int index);
+
+#endif
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "modbus_ctx.h"
+#include "lpr_capture.h"
+
+struct modbus_ctx {
+    modbus_frame_t frame;  // Primeiro membro: alinhado em linha de cache
+    uint8_t rx[MODBUS_MAX_FRAME] __attribute__((aligned(64)));
+    modbus_trailer_t trailer;
+    pthread_mutex_t lock;
+    modbus_ctx_t *previous;  // Contexto da thread antes do lock (restaurado no unlock)
+
+    int uart_fd;
+    int owns_fd;
+    char matricula[5];
+
+    modbus_timing_t timing[256];
+    uint8_t timing_set[256];
+    retry_policy_t policy;
+    int has_policy;
+
+    atomic_uint_fast64_t transactions;
+    atomic_uint_fast64_t results[MODBUS_ERR_COUNT];
+    atomic_uint_fast64_t retries;
+    atomic_uint_fast64_t contended;
+};
+
+static _Thread_local modbus_ctx_t *current_ctx;
+
+modbus_ctx_t *modbus_ctx_create(int uart_fd, const char *matricula) {
+    pthread_mutexattr_t attr;
+    modbus_ctx_t *ctx;
+
+    if (matricula == NULL || strlen(matricula) != 4) {
+        fprintf(stderr, "Matrícula deve ter 4 dígitos\n");
+        return NULL;
+    }
+
+    // Os buffers de transmissão e recepção exigem alinhamento de 64 bytes
+    if (posix_memalign((void **)&ctx, 64, sizeof(*ctx)) != 0) {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+
+    ctx->uart_fd = uart_fd;
+    memcpy(ctx->matricula, matricula, 4);
+    ctx->matricula[4] = '\0';
+    modbus_trailer_init(&ctx->trailer, matricula);
+
+    // Espera curta com spin antes de dormir: a posse dura uma ida e volta no barramento
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+    pthread_mutex_init(&ctx->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return ctx;
+}
+
+modbus_ctx_t *modbus_ctx_open(const char *device, const uart_config_t *config, const char *matricula) {
+    int uart_fd = open_uart_config(device, config);
+    if (uart_fd < 0) {
+        return NULL;
+    }
+
+    modbus_ctx_t *ctx = modbus_ctx_create(uart_fd, matricula);
+    if (ctx == NULL) {
+        close_uart(uart_fd);
+        return NULL;
+    }
+    ctx->owns_fd = 1;
+    return ctx;
+}
+
+void modbus_ctx_destroy(modbus_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+
+    if (ctx->owns_fd) {
+        close_uart(ctx->uart_fd);
+    }
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+}
+
+int modbus_ctx_fd(const modbus_ctx_t *ctx) {
+    return ctx->uart_fd;
+}
+
+void modbus_ctx_set_timing(modbus_ctx_t *ctx, uint8_t addr, const modbus_timing_t *timing) {
+    pthread_mutex_lock(&ctx->lock);
+    if (timing != NULL) {
+        ctx->timing[addr] = *timing;
+        ctx->timing_set[addr] = 1;
+    } else {
+        ctx->timing_set[addr] = 0;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void modbus_ctx_set_retry_policy(modbus_ctx_t *ctx, const retry_policy_t *policy) {
+    pthread_mutex_lock(&ctx->lock);
+    if (policy != NULL) {
+        ctx->policy = *policy;
+        if (ctx->policy.max_attempts < 1) {
+            ctx->policy.max_attempts = 1;
+        }
+        ctx->has_policy = 1;
+    } else {
+        ctx->has_policy = 0;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void modbus_ctx_lock(modbus_ctx_t *ctx) {
+    if (pthread_mutex_trylock(&ctx->lock) != 0) {
+        atomic_fetch_add_explicit(&ctx->contended, 1, memory_order_relaxed);
+        pthread_mutex_lock(&ctx->lock);
+    }
+
+    ctx->previous = current_ctx;
+    current_ctx = ctx;
+}
+
+void modbus_ctx_unlock(modbus_ctx_t *ctx) {
+    current_ctx = ctx->previous;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void modbus_ctx_get_stats(modbus_ctx_t *ctx, modbus_ctx_stats_t *stats) {
+    stats->transactions = atomic_load_explicit(&ctx->transactions, memory_order_relaxed);
+    for (int i = 0; i < MODBUS_ERR_COUNT; i++) {
+        stats->results[i] = atomic_load_explicit(&ctx->results[i], memory_order_relaxed);
+    }
+    stats->retries = atomic_load_explicit(&ctx->retries, memory_order_relaxed);
+    stats->contended = atomic_load_explicit(&ctx->contended, memory_order_relaxed);
+}
+
+/*
+ * Executa op com o barramento tomado. Se uma transação falhar e couber nova
+ * tentativa (retry_attach), o lock é solto durante o backoff e a operação é
+ * refeita depois: nesse meio tempo as outras threads usam o contexto.
+ */
+typedef int (*ctx_op_fn)(modbus_ctx_t *ctx, void *arg);
+
+static int ctx_run(modbus_ctx_t *ctx, ctx_op_fn op, void *arg) {
+    retry_t retry;
+    int ret;
+
+    retry_reset(&retry);
+    for (;;) {
+        modbus_ctx_lock(ctx);
+        retry_t *previous = retry_attach(&retry);
+        ret = op(ctx, arg);
+        retry_attach(previous);
+        modbus_ctx_unlock(ctx);
+
+        if (retry.delay_us < 0) {
+            return ret;
+        }
+        if (retry.delay_us > 0) {
+            usleep(retry.delay_us);
+        }
+    }
+}
+
+// Argumentos das operações dos wrappers
+typedef struct {
+    uint8_t addr;
+    uint8_t func;
+    const uint8_t *data;
+    int data_len;
+    uint8_t *rx_buffer;
+    int rx_max;
+} ctx_request_t;
+
+typedef struct {
+    uint8_t addr;
+    uint16_t start;
+    uint16_t count;
+    void *out;
+} ctx_read_t;
+
+static int op_request(modbus_ctx_t *ctx, void *arg) {
+    ctx_request_t *r = arg;
+    return modbus_request(ctx->uart_fd, r->addr, r->func, r->data, r->data_len, ctx->matricula,
+                          r->rx_buffer, r->rx_max);
+}
+
+static int op_read_registers(modbus_ctx_t *ctx, void *arg) {
+    ctx_read_t *r = arg;
+    return modbus_read_holding_registers(ctx->uart_fd, r->addr, r->start, r->count, ctx->matricula, r->out);
+}
+
+static int op_read_status(modbus_ctx_t *ctx, void *arg) {
+    ctx_read_t *r = arg;
+    return lpr_read_status(ctx->uart_fd, r->addr, ctx->matricula, r->out);
+}
+
+static int op_read_data(modbus_ctx_t *ctx, void *arg) {
+    ctx_read_t *r = arg;
+    return lpr_read_data(ctx->uart_fd, r->addr, ctx->matricula, r->out);
+}
+
+static int op_placar_update(modbus_ctx_t *ctx, void *arg) {
+    return placar_update(ctx->uart_fd, ctx->matricula, arg);
+}
+
+int modbus_ctx_request(modbus_ctx_t *ctx, uint8_t addr, uint8_t func, const uint8_t *data, int data_len,
+                       uint8_t *rx_buffer, int rx_max) {
+    ctx_request_t r = { addr, func, data, data_len, rx_buffer, rx_max };
+    return ctx_run(ctx, op_request, &r);
+}
+
+int modbus_ctx_read_registers(modbus_ctx_t *ctx, uint8_t addr, uint16_t start, uint16_t count,
+                              uint16_t *values) {
+    ctx_read_t r = { .addr = addr, .start = start, .count = count, .out = values };
+    return ctx_run(ctx, op_read_registers, &r);
+}
+
+int modbus_ctx_read_status(modbus_ctx_t *ctx, uint8_t camera_addr, uint8_t *status) {
+    ctx_read_t r = { .addr = camera_addr, .out = status };
+    return ctx_run(ctx, op_read_status, &r);
+}
+
+int modbus_ctx_read_data(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data) {
+    ctx_read_t r = { .addr = camera_addr, .out = data };
+    return ctx_run(ctx, op_read_data, &r);
+}
+
+int modbus_ctx_placar_update(modbus_ctx_t *ctx, const placar_data_t *data) {
+    return ctx_run(ctx, op_placar_update, (void *)data);
+}
+
+// Como lpr_capture_run(), mas com o barramento tomado só durante cada passo
+static int ctx_capture(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data,
+                       int max_retries, int timeout_ms, int fast_path) {
+    lpr_capture_t cap;
+    int ret;
+
+    lpr_capture_init(&cap, camera_addr, max_retries, timeout_ms);
+    if (lpr_capture_cache_begin(ctx->uart_fd, &cap, data, &ret) != LPR_CACHE_MISS) {
+        return ret;
+    }
+
+    lpr_capture_set_fast_path(&cap, fast_path);
+
+    while (!lpr_capture_finished(&cap)) {
+        int64_t wait = cap.next_action_us - retry_now_us();
+        if (wait > 0) {
+            usleep(wait);
+        }
+
+        modbus_ctx_lock(ctx);
+        lpr_capture_step(ctx->uart_fd, ctx->matricula, &cap);
+        modbus_ctx_unlock(ctx);
+    }
+
+    ret = cap.state == LPR_CAPTURE_DONE ? 0 : -1;
+    lpr_capture_cache_end(ctx->uart_fd, camera_addr, ret, &cap.data);
+    if (ret == 0) {
+        *data = cap.data;
+    }
+    return ret;
+}
+
+int modbus_ctx_capture_plate(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data,
+                             int max_retries, int timeout_ms) {
+    return ctx_capture(ctx, camera_addr, data, max_retries, timeout_ms, 0);
+}
+
+int modbus_ctx_capture_plate_fast(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data,
+                                  int max_retries, int timeout_ms) {
+    return ctx_capture(ctx, camera_addr, data, max_retries, timeout_ms, 1);
+}
+
+modbus_ctx_t *modbus_ctx_current(void) {
+    return current_ctx;
+}
+
+modbus_frame_t *modbus_ctx_frame(modbus_ctx_t *ctx) {
+    return &ctx->frame;
+}
+
+uint8_t *modbus_ctx_rx_buffer(modbus_ctx_t *ctx) {
+    return ctx->rx;
+}
+
+const modbus_trailer_t *modbus_ctx_trailer(const modbus_ctx_t *ctx) {
+    return &ctx->trailer;
+}
+
+void modbus_ctx_get_timing(const modbus_ctx_t *ctx, uint8_t addr, modbus_timing_t *timing) {
+    if (ctx->timing_set[addr]) {
+        *timing = ctx->timing[addr];
+        return;
+    }
+    modbus_get_device_timing(addr, timing);
+}
+
+const retry_policy_t *modbus_ctx_retry_policy(const modbus_ctx_t *ctx) {
+    return ctx->has_policy ? &ctx->policy : NULL;
+}
+
+void modbus_ctx_count(modbus_ctx_t *ctx, modbus_error_t result, int attempts) {
+    atomic_fetch_add_explicit(&ctx->transactions, 1, memory_order_relaxed);
+    if (result >= 0 && result < MODBUS_ERR_COUNT) {
+        atomic_fetch_add_explicit(&ctx->results[result], 1, memory_order_relaxed);
+    }
+    if (attempts > 1) {
+        atomic_fetch_add_explicit(&ctx->retries, attempts - 1, memory_order_relaxed);
+    }
+}
+
+void modbus_ctx_count_retry(modbus_ctx_t *ctx) {
+    atomic_fetch_add_explicit(&ctx->retries, 1, memory_order_relaxed);
+}
@@ -0,0 +1,187 @@
+#ifndef MODBUS_CTX_H
+#define MODBUS_CTX_H
+
+#include <stdint.h>
+#include "modbus_parking.h"
+#include "modbus_frame.h"
+#include "retry.h"
+#include "uart.h"
+
+/*
+ * Contexto de barramento: reúne o fd da UART, a matrícula, os perfis de tempo
+ * e a política de retentativas do barramento, contadores, os buffers de
+ * transmissão e recepção e o trailer da matrícula pré-formatado. Várias
+ * threads (ex: tratadores das cancelas de entrada e de saída) podem usar o
+ * mesmo contexto.
+ *
+ * O acesso é exclusivo por transação, não por operação: cada requisição (ou
+ * cada passo de uma captura) toma o lock do contexto só durante a ida e volta
+ * no barramento. Assim o descarte dos bytes pendentes antes do envio nunca
+ * joga fora a resposta de outra thread, e enquanto uma câmera processa a imagem
+ * a outra cancela usa o barramento. Nenhuma espera de backoff é feita com o
+ * lock: se a transação falhar e couber nova tentativa, o lock é solto durante
+ * a espera e a operação é refeita depois. Contextos diferentes (portas
+ * diferentes) não compartilham lock.
+ *
+ * As funções modbus_ctx_* equivalem às da API por fd. Para uma sequência
+ * própria de chamadas da API por fd, use modbus_ctx_lock()/modbus_ctx_unlock():
+ * entre os dois, as chamadas feitas com modbus_ctx_fd() usam os perfis, a
+ * política e os buffers do contexto.
+ */
+
+typedef struct modbus_ctx modbus_ctx_t;
+
+// Contadores do contexto
+typedef struct {
+    uint64_t transactions;              // Transações concluídas
+    uint64_t results[MODBUS_ERR_COUNT]; // Por resultado (results[MODBUS_OK] = sucessos)
+    uint64_t retries;                   // Tentativas além da primeira
+    uint64_t contended;                 // Acessos que esperaram outra thread
+} modbus_ctx_stats_t;
+
+/**
+ * @brief Cria um contexto sobre uma UART já aberta (o contexto não a fecha)
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @return Contexto ou NULL em caso de erro
+ */
+modbus_ctx_t *modbus_ctx_create(int uart_fd, const char *matricula);
+
+/**
+ * @brief Abre a UART e cria um contexto dono dela
+ * @return Contexto ou NULL em caso de erro
+ */
+modbus_ctx_t *modbus_ctx_open(const char *device, const uart_config_t *config, const char *matricula);
+
+/**
+ * @brief Libera o contexto (e fecha a UART se foi aberta por modbus_ctx_open)
+ *
+ * Nenhuma thread pode estar usando o contexto.
+ */
+void modbus_ctx_destroy(modbus_ctx_t *ctx);
+
+/**
+ * @brief fd da UART do contexto
+ */
+int modbus_ctx_fd(const modbus_ctx_t *ctx);
+
+/**
+ * @brief Define o perfil de tempo de um dispositivo só neste contexto
+ * @param timing Perfil (NULL volta ao perfil global de modbus_get_device_timing)
+ */
+void modbus_ctx_set_timing(modbus_ctx_t *ctx, uint8_t addr, const modbus_timing_t *timing);
+
+/**
+ * @brief Define a política de retentativas do contexto
+ * @param policy Política (NULL volta à política da biblioteca)
+ */
+void modbus_ctx_set_retry_policy(modbus_ctx_t *ctx, const retry_policy_t *policy);
+
+/**
+ * @brief Toma o barramento para uma sequência de chamadas da API por fd
+ *
+ * Não é recursivo. Mantenha o trecho curto: as outras threads esperam. As
+ * chamadas feitas entre lock e unlock são bloqueantes, inclusive as esperas
+ * de backoff; para soltar o lock nelas, use as funções modbus_ctx_*.
+ */
+void modbus_ctx_lock(modbus_ctx_t *ctx);
+
+/**
+ * @brief Libera o barramento
+ */
+void modbus_ctx_unlock(modbus_ctx_t *ctx);
+
+/**
+ * @brief Lê os contadores
+ */
+void modbus_ctx_get_stats(modbus_ctx_t *ctx, modbus_ctx_stats_t *stats);
+
+/**
+ * @brief modbus_request() no contexto
+ */
+int modbus_ctx_request(modbus_ctx_t *ctx, uint8_t addr, uint8_t func, const uint8_t *data, int data_len,
+                       uint8_t *rx_buffer, int rx_max);
+
+/**
+ * @brief modbus_read_holding_registers() no contexto
+ */
+int modbus_ctx_read_registers(modbus_ctx_t *ctx, uint8_t addr, uint16_t start, uint16_t count,
+                              uint16_t *values);
+
+/**
+ * @brief lpr_read_status() no contexto
+ */
+int modbus_ctx_read_status(modbus_ctx_t *ctx, uint8_t camera_addr, uint8_t *status);
+
+/**
+ * @brief lpr_read_data() no contexto
+ */
+int modbus_ctx_read_data(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data);
+
+/**
+ * @brief placar_update() no contexto
+ */
+int modbus_ctx_placar_update(modbus_ctx_t *ctx, const placar_data_t *data);
+
+/**
+ * @brief lpr_capture_plate() no contexto
+ *
+ * O barramento é tomado a cada passo da captura, não durante ela inteira:
+ * nas esperas do polling outras threads usam o contexto.
+ */
+int modbus_ctx_capture_plate(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data,
+                             int max_retries, int timeout_ms);
+
+/**
+ * @brief lpr_capture_plate_fast() no contexto
+ */
+int modbus_ctx_capture_plate_fast(modbus_ctx_t *ctx, uint8_t camera_addr, lpr_data_t *data,
+                                  int max_retries, int timeout_ms);
+
+/*
+ * Uso interno (modbus_parking.c): o contexto tomado pela thread atual,
+ * consultado a cada transação da API por fd.
+ */
+
+/**
+ * @brief Contexto tomado pela thread (NULL fora de modbus_ctx_lock)
+ */
+modbus_ctx_t *modbus_ctx_current(void);
+
+/**
+ * @brief Buffer de transmissão do contexto
+ */
+modbus_frame_t *modbus_ctx_frame(modbus_ctx_t *ctx);
+
+/**
+ * @brief Buffer de recepção do contexto (MODBUS_MAX_FRAME bytes)
+ */
+uint8_t *modbus_ctx_rx_buffer(modbus_ctx_t *ctx);
+
+/**
+ * @brief Trailer pré-formatado da matrícula do contexto
+ */
+const modbus_trailer_t *modbus_ctx_trailer(const modbus_ctx_t *ctx);
+
+/**
+ * @brief Perfil de tempo efetivo de um dispositivo no contexto
+ */
+void modbus_ctx_get_timing(const modbus_ctx_t *ctx, uint8_t addr, modbus_timing_t *timing);
+
+/**
+ * @brief Política do contexto (NULL = política da biblioteca)
+ */
+const retry_policy_t *modbus_ctx_retry_policy(const modbus_ctx_t *ctx);
+
+/**
+ * @brief Contabiliza uma transação concluída
+ * @param attempts Tentativas usadas
+ */
+void modbus_ctx_count(modbus_ctx_t *ctx, modbus_error_t result, int attempts);
+
+/**
+ * @brief Contabiliza uma tentativa adiada (retry_attach) que será refeita
+ */
+void modbus_ctx_count_retry(modbus_ctx_t *ctx);
+
+#endif
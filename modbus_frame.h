@@ -0,0 +1,156 @@
+#ifndef MODBUS_FRAME_H
+#define MODBUS_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include "crc16.h"
+#include "modbus_parking.h"
+
+/*
+ * Codificador de quadros RTU no próprio buffer de transmissão: cabeçalho,
+ * payload, matrícula e CRC são escritos diretamente no buffer, sem vetores
+ * temporários nem cópias. O CRC é acumulado por trechos: os bytes ainda não
+ * cobertos são dobrados de uma vez com a implementação mais rápida disponível
+ * (byte a byte pela tabela sairia mais caro que uma passada com PCLMUL).
+ */
+
+// Bytes reservados no final: matrícula (4) + CRC (2)
+#define MODBUS_FRAME_TRAILER 6
+
+typedef struct {
+    uint8_t buf[MODBUS_MAX_FRAME] __attribute__((aligned(64)));
+    int len;
+    uint16_t crc;  // CRC dos primeiros crc_len bytes
+    int crc_len;
+    int overflow;  // Algum put não coube no quadro
+} modbus_frame_t;
+
+/**
+ * @brief Inicia um quadro com endereço e código de função
+ */
+static inline void modbus_frame_begin(modbus_frame_t *frame, uint8_t addr, uint8_t func) {
+    frame->buf[0] = addr;
+    frame->buf[1] = func;
+    frame->len = 2;
+    frame->crc = CRC16_MODBUS_INIT;
+    frame->crc_len = 0;
+    frame->overflow = 0;
+}
+
+/**
+ * @brief Acrescenta um byte ao payload
+ */
+static inline void modbus_frame_put_u8(modbus_frame_t *frame, uint8_t value) {
+    if (frame->len >= MODBUS_MAX_FRAME - MODBUS_FRAME_TRAILER) {
+        frame->overflow = 1;
+        return;
+    }
+
+    frame->buf[frame->len++] = value;
+}
+
+/**
+ * @brief Acrescenta um valor de 16 bits em little-endian (convenção dos dispositivos)
+ */
+static inline void modbus_frame_put_u16(modbus_frame_t *frame, uint16_t value) {
+    modbus_frame_put_u8(frame, value & 0xFF);
+    modbus_frame_put_u8(frame, (value >> 8) & 0xFF);
+}
+
+/**
+ * @brief Acrescenta um bloco de bytes ao payload
+ */
+static inline void modbus_frame_put_bytes(modbus_frame_t *frame, const uint8_t *data, int len) {
+    if (len <= 0) {
+        return;
+    }
+
+    if (frame->len + len > MODBUS_MAX_FRAME - MODBUS_FRAME_TRAILER) {
+        frame->overflow = 1;
+        return;
+    }
+
+    memcpy(frame->buf + frame->len, data, len);
+    frame->len += len;
+}
+
+/**
+ * @brief Acumula no CRC os bytes escritos desde a última chamada
+ * @return CRC parcial do quadro até aqui
+ */
+static inline uint16_t modbus_frame_sync_crc(modbus_frame_t *frame) {
+    if (frame->crc_len < frame->len) {
+        frame->crc = crc16_modbus_update(frame->crc, frame->buf + frame->crc_len,
+                                         frame->len - frame->crc_len);
+        frame->crc_len = frame->len;
+    }
+
+    return frame->crc;
+}
+
+/**
+ * @brief Fecha o quadro com os 4 dígitos da matrícula e o CRC
+ * @return Tamanho total do quadro ou -1 se algum put não coube
+ */
+static inline int modbus_frame_finish(modbus_frame_t *frame, const char *matricula) {
+    if (frame->overflow) {
+        return -1;
+    }
+
+    memcpy(frame->buf + frame->len, matricula, 4);
+    frame->len += 4;
+
+    uint16_t crc = modbus_frame_sync_crc(frame);
+    frame->buf[frame->len++] = crc & 0xFF;         // CRC Low
+    frame->buf[frame->len++] = (crc >> 8) & 0xFF;  // CRC High
+
+    return frame->len;
+}
+
+/*
+ * Trailer pré-formatado: os 4 dígitos da matrícula e o efeito deles no CRC.
+ * O CRC sem xor final é linear no estado, então passar um trailer fixo pelo
+ * CRC equivale a duas consultas de tabela (byte baixo e alto do estado).
+ */
+typedef struct {
+    uint8_t bytes[4];
+    uint16_t crc_lo[256];  // CRC após o trailer partindo do estado b
+    uint16_t crc_hi[256];  // Contribuição do byte alto b << 8 (sem o trailer)
+} modbus_trailer_t;
+
+/**
+ * @brief Prepara o trailer de uma matrícula (feito uma vez, ex: ao criar o contexto)
+ */
+static inline void modbus_trailer_init(modbus_trailer_t *trailer, const char *matricula) {
+    static const uint8_t zeros[4];
+
+    memcpy(trailer->bytes, matricula, 4);
+    for (int b = 0; b < 256; b++) {
+        trailer->crc_lo[b] = crc16_modbus_update((uint16_t)b, trailer->bytes, 4);
+        trailer->crc_hi[b] = crc16_modbus_update((uint16_t)(b << 8), zeros, 4);
+    }
+}
+
+/**
+ * @brief modbus_frame_finish() com o trailer pré-formatado
+ * @return Tamanho total do quadro ou -1 se algum put não coube
+ */
+static inline int modbus_frame_finish_trailer(modbus_frame_t *frame, const modbus_trailer_t *trailer) {
+    if (frame->overflow) {
+        return -1;
+    }
+
+    uint16_t state = modbus_frame_sync_crc(frame);
+    uint16_t crc = trailer->crc_lo[state & 0xFF] ^ trailer->crc_hi[state >> 8];
+
+    memcpy(frame->buf + frame->len, trailer->bytes, 4);
+    frame->len += 4;
+    frame->crc = crc;
+    frame->crc_len = frame->len;
+    frame->buf[frame->len++] = crc & 0xFF;         // CRC Low
+    frame->buf[frame->len++] = (crc >> 8) & 0xFF;  // CRC High
+
+    return frame->len;
+}
+
+#endif
@@ -0,0 +1,653 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "modbus_gateway.h"
+#include "config.h"
+#include "retry.h"
+
+#define MBAP_HEADER 7          // Transação, protocolo, tamanho e unidade
+#define MBAP_MAX_LENGTH 254    // Campo de tamanho: unidade + PDU (até 253)
+#define GW_RX_BUF 1024
+#define GW_TX_BUF 4096
+
+// Identificação dos fds no epoll do gateway (clientes a partir de GW_TAG_CLIENT)
+#define GW_TAG_LISTEN 0
+#define GW_TAG_BUS 1
+#define GW_TAG_CLIENT 2
+
+typedef struct {
+    int fd;  // -1 = livre
+    uint32_t gen;  // Muda a cada conexão no slot (respostas atrasadas de conexões fechadas são descartadas)
+    int want_write;
+    uint8_t rx[GW_RX_BUF];
+    int rx_len;
+    uint8_t tx[GW_TX_BUF];
+    int tx_len;
+} gw_client_t;
+
+typedef struct gw_request {
+    modbus_txn_t txn;  // Só o líder vai ao barramento
+    int in_use;
+    int in_flight;     // Líder com transação no barramento
+    int client;
+    uint32_t gen;
+    uint16_t tid;
+    uint8_t unit;
+    uint8_t func;
+    int cacheable;
+    uint32_t key;
+    struct gw_request *followers;  // Leituras iguais aguardando este líder
+    struct gw_request *next;
+} gw_request_t;
+
+typedef struct {
+    int valid;
+    uint32_t key;
+    int64_t time_us;
+    uint8_t pdu[MBAP_MAX_LENGTH];
+    int pdu_len;
+} gw_cache_entry_t;
+
+struct modbus_gateway {
+    modbus_async_t *bus;
+    int listen_fd;
+    int epoll_fd;
+    int cache_ttl_ms;
+    gw_client_t clients[MODBUS_GATEWAY_MAX_CLIENTS];
+    gw_request_t requests[MODBUS_GATEWAY_MAX_PENDING];
+    gw_cache_entry_t cache[MODBUS_GATEWAY_CACHE_SLOTS];
+    uint16_t pending_writes[256];  // Escritas no barramento por escravo: sem cache nem junção enquanto > 0
+    modbus_gateway_stats_t stats;
+};
+
+// Troca os bytes de cada registrador (big-endian do TCP <-> little-endian do barramento)
+static void swap_pairs(uint8_t *dst, const uint8_t *src, int len) {
+    for (int i = 0; i + 1 < len; i += 2) {
+        uint8_t hi = src[i];
+        dst[i] = src[i + 1];
+        dst[i + 1] = hi;
+    }
+}
+
+static uint32_t cache_key(uint8_t unit, uint16_t start, uint16_t count) {
+    return ((uint32_t)unit << 24) | ((uint32_t)(count & 0xFF) << 16) | start;
+}
+
+static gw_cache_entry_t *cache_slot(modbus_gateway_t *gw, uint32_t key) {
+    uint32_t h = key * 0x9E3779B1u;
+    return &gw->cache[h >> 26 & (MODBUS_GATEWAY_CACHE_SLOTS - 1)];
+}
+
+static void cache_invalidate_unit(modbus_gateway_t *gw, uint8_t unit) {
+    for (int i = 0; i < MODBUS_GATEWAY_CACHE_SLOTS; i++) {
+        if (gw->cache[i].valid && gw->cache[i].key >> 24 == unit) {
+            gw->cache[i].valid = 0;
+        }
+    }
+}
+
+static void close_client(modbus_gateway_t *gw, int index) {
+    gw_client_t *c = &gw->clients[index];
+
+    close(c->fd);  // Sai do epoll junto
+    c->fd = -1;
+    c->gen++;
+    c->rx_len = 0;
+    c->tx_len = 0;
+    c->want_write = 0;
+}
+
+static void client_set_want_write(modbus_gateway_t *gw, int index, int want) {
+    gw_client_t *c = &gw->clients[index];
+    if (c->want_write == want) {
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.u32 = GW_TAG_CLIENT + index };
+    if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) < 0) {
+        perror("Erro no epoll do cliente");
+        return;
+    }
+    c->want_write = want;
+}
+
+static void client_flush(modbus_gateway_t *gw, int index) {
+    gw_client_t *c = &gw->clients[index];
+    int sent = 0;
+
+    while (sent < c->tx_len) {
+        ssize_t n = send(c->fd, c->tx + sent, c->tx_len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            close_client(gw, index);
+            return;
+        }
+        sent += (int)n;
+    }
+
+    memmove(c->tx, c->tx + sent, c->tx_len - sent);
+    c->tx_len -= sent;
+    client_set_want_write(gw, index, c->tx_len > 0);
+}
+
+// Envia uma resposta MBAP a um cliente (descartada se a conexão já fechou)
+static void reply(modbus_gateway_t *gw, int index, uint32_t gen, uint16_t tid, uint8_t unit,
+                  const uint8_t *pdu, int pdu_len) {
+    gw_client_t *c = &gw->clients[index];
+    if (c->fd < 0 || c->gen != gen) {
+        return;
+    }
+
+    // Cliente que não lê as respostas: derruba em vez de acumular
+    if (c->tx_len + MBAP_HEADER + pdu_len > GW_TX_BUF) {
+        close_client(gw, index);
+        return;
+    }
+
+    uint8_t *p = c->tx + c->tx_len;
+    p[0] = tid >> 8;
+    p[1] = tid & 0xFF;
+    p[2] = 0;
+    p[3] = 0;
+    p[4] = (pdu_len + 1) >> 8;
+    p[5] = (pdu_len + 1) & 0xFF;
+    p[6] = unit;
+    memcpy(p + MBAP_HEADER, pdu, pdu_len);
+    c->tx_len += MBAP_HEADER + pdu_len;
+
+    if (!c->want_write) {
+        client_flush(gw, index);
+    }
+}
+
+static void reply_exception(modbus_gateway_t *gw, int index, uint32_t gen, uint16_t tid, uint8_t unit,
+                            uint8_t func, uint8_t code) {
+    uint8_t pdu[2] = { func | 0x80, code };
+
+    gw->stats.exceptions++;
+    reply(gw, index, gen, tid, unit, pdu, sizeof(pdu));
+}
+
+static uint8_t exception_for(const modbus_txn_t *txn) {
+    switch (txn->error) {
+        case MODBUS_ERR_EXCEPTION:
+            return txn->response_len >= 3 ? txn->response[2] : MODBUS_EXC_GATEWAY_TARGET;
+        case MODBUS_ERR_BUSY:
+            return MODBUS_EXC_BUSY;
+        case MODBUS_ERR_IO:
+            return MODBUS_EXC_GATEWAY_PATH;
+        default:
+            return MODBUS_EXC_GATEWAY_TARGET;
+    }
+}
+
+/*
+ * Converte a resposta RTU (little-endian, com endereço e CRC) no PDU MODBUS
+ * TCP. Retorna o tamanho do PDU ou -1 se a resposta não tiver o formato
+ * esperado para a função.
+ */
+static int response_to_pdu(const modbus_txn_t *txn, uint8_t *pdu) {
+    const uint8_t *r = txn->response;
+    int len = txn->response_len - 2;  // Sem o CRC
+
+    switch (txn->func) {
+        case 0x03:
+            // Bytes próprios do dispositivo depois dos dados não vão para o cliente
+            if (len < 3 || len < 3 + r[2]) {
+                return -1;
+            }
+            pdu[0] = r[1];
+            pdu[1] = r[2];
+            swap_pairs(pdu + 2, r + 3, r[2]);
+            return 2 + r[2];
+
+        case 0x06:
+        case 0x10:
+            // Endereço e valor (0x06) ou início e quantidade (0x10)
+            if (len < 6) {
+                return -1;
+            }
+            pdu[0] = r[1];
+            swap_pairs(pdu + 1, r + 2, 4);
+            return 5;
+
+        default:
+            if (len < 2 || len - 1 > MBAP_MAX_LENGTH - 1) {
+                return -1;
+            }
+            memcpy(pdu, r + 1, len - 1);
+            return len - 1;
+    }
+}
+
+static void release_request(gw_request_t *req) {
+    req->in_use = 0;
+    req->in_flight = 0;
+    req->followers = NULL;
+    req->next = NULL;
+}
+
+static void bus_done(modbus_txn_t *txn, void *user) {
+    modbus_gateway_t *gw = user;
+    gw_request_t *req = (gw_request_t *)txn;  // txn é o primeiro membro
+    uint8_t pdu[MBAP_MAX_LENGTH];
+    int pdu_len = -1;
+
+    if (txn->result == 0) {
+        pdu_len = response_to_pdu(txn, pdu);
+    }
+    if (pdu_len < 0) {
+        pdu[0] = req->func | 0x80;
+        pdu[1] = txn->result == 0 ? MODBUS_EXC_GATEWAY_TARGET : exception_for(txn);
+        pdu_len = 2;
+        gw->stats.exceptions++;
+    }
+
+    if (req->func != 0x03) {
+        // Mesmo sem resposta a escrita pode ter sido aplicada
+        gw->pending_writes[req->unit]--;
+        cache_invalidate_unit(gw, req->unit);
+    } else if (req->cacheable && pdu[0] == 0x03 && gw->cache_ttl_ms > 0 && gw->pending_writes[req->unit] == 0) {
+        // Leitura que estava no barramento antes de uma escrita não pode repor dados antigos
+        gw_cache_entry_t *entry = cache_slot(gw, req->key);
+        entry->valid = 1;
+        entry->key = req->key;
+        entry->time_us = retry_now_us();
+        memcpy(entry->pdu, pdu, pdu_len);
+        entry->pdu_len = pdu_len;
+    }
+
+    reply(gw, req->client, req->gen, req->tid, req->unit, pdu, pdu_len);
+    for (gw_request_t *f = req->followers; f != NULL;) {
+        gw_request_t *next = f->next;
+        reply(gw, f->client, f->gen, f->tid, f->unit, pdu, pdu_len);
+        release_request(f);
+        f = next;
+    }
+    release_request(req);
+}
+
+static gw_request_t *alloc_request(modbus_gateway_t *gw) {
+    for (int i = 0; i < MODBUS_GATEWAY_MAX_PENDING; i++) {
+        if (!gw->requests[i].in_use) {
+            gw->requests[i].in_use = 1;
+            return &gw->requests[i];
+        }
+    }
+    return NULL;
+}
+
+static gw_request_t *find_in_flight(modbus_gateway_t *gw, uint32_t key) {
+    for (int i = 0; i < MODBUS_GATEWAY_MAX_PENDING; i++) {
+        gw_request_t *req = &gw->requests[i];
+        if (req->in_flight && req->cacheable && req->key == key) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+// Traduz e encaminha um ADU completo (cabeçalho MBAP + PDU)
+static void handle_adu(modbus_gateway_t *gw, int index, const uint8_t *adu, int pdu_len) {
+    gw_client_t *c = &gw->clients[index];
+    uint16_t tid = (adu[0] << 8) | adu[1];
+    uint8_t unit = adu[6];
+    const uint8_t *pdu = adu + MBAP_HEADER;
+    uint8_t func = pdu[0];
+    const uint8_t *in = pdu + 1;
+    int in_len = pdu_len - 1;
+    uint8_t data[MBAP_MAX_LENGTH];
+    int cacheable = 0;
+    uint32_t key = 0;
+
+    gw->stats.requests++;
+
+    // Campos do PDU em big-endian -> little-endian do barramento
+    switch (func) {
+        case 0x03: {
+            if (in_len != 4) {
+                reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_ILLEGAL_DATA_VALUE);
+                return;
+            }
+            uint16_t start = (in[0] << 8) | in[1];
+            uint16_t count = (in[2] << 8) | in[3];
+            if (count == 0 || count > MODBUS_READ_MAX_REGS) {
+                reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_ILLEGAL_DATA_VALUE);
+                return;
+            }
+            swap_pairs(data, in, 4);
+            cacheable = 1;
+            key = cache_key(unit, start, count);
+            break;
+        }
+
+        case 0x06:
+            if (in_len != 4) {
+                reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_ILLEGAL_DATA_VALUE);
+                return;
+            }
+            swap_pairs(data, in, 4);
+            break;
+
+        case 0x10:
+            if (in_len < 5 || in[4] != ((in[2] << 8) | in[3]) * 2 || in_len != 5 + in[4]) {
+                reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_ILLEGAL_DATA_VALUE);
+                return;
+            }
+            swap_pairs(data, in, 4);
+            data[4] = in[4];
+            swap_pairs(data + 5, in + 5, in[4]);
+            break;
+
+        default:
+            memcpy(data, in, in_len);
+            break;
+    }
+
+    // Com escrita pendente no escravo, a leitura vai ao barramento depois dela
+    if (gw->pending_writes[unit] > 0) {
+        cacheable = 0;
+    }
+
+    if (cacheable && gw->cache_ttl_ms > 0) {
+        gw_cache_entry_t *entry = cache_slot(gw, key);
+        if (entry->valid && entry->key == key &&
+            retry_now_us() - entry->time_us < (int64_t)gw->cache_ttl_ms * 1000) {
+            gw->stats.cache_hits++;
+            reply(gw, index, c->gen, tid, unit, entry->pdu, entry->pdu_len);
+            return;
+        }
+    }
+
+    gw_request_t *req = alloc_request(gw);
+    if (req == NULL) {
+        reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_BUSY);
+        return;
+    }
+    req->client = index;
+    req->gen = c->gen;
+    req->tid = tid;
+    req->unit = unit;
+    req->func = func;
+    req->cacheable = cacheable;
+    req->key = key;
+
+    // Leitura igual já no barramento: aguarda a resposta dela
+    gw_request_t *leader = cacheable ? find_in_flight(gw, key) : NULL;
+    if (leader != NULL) {
+        gw->stats.joined++;
+        gw_request_t **tail = &leader->followers;
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+        *tail = req;
+        return;
+    }
+
+    if (modbus_txn_init(&req->txn, unit, func, data, in_len, MODBUS_PRIO_NORMAL) != 0) {
+        release_request(req);
+        reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_ILLEGAL_DATA_VALUE);
+        return;
+    }
+    modbus_txn_set_callback(&req->txn, bus_done, gw);
+
+    if (func != 0x03) {
+        cache_invalidate_unit(gw, unit);
+    }
+
+    if (modbus_async_submit(gw->bus, &req->txn) != 0) {
+        release_request(req);
+        reply_exception(gw, index, c->gen, tid, unit, func, MODBUS_EXC_GATEWAY_PATH);
+        return;
+    }
+    req->in_flight = 1;
+    if (func != 0x03) {
+        gw->pending_writes[unit]++;
+    }
+    gw->stats.bus_txns++;
+}
+
+static void client_readable(modbus_gateway_t *gw, int index) {
+    gw_client_t *c = &gw->clients[index];
+    uint32_t gen = c->gen;
+
+    for (;;) {
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            close_client(gw, index);
+            return;
+        }
+        if (n == 0) {
+            close_client(gw, index);
+            return;
+        }
+        c->rx_len += (int)n;
+
+        // Um ADU por vez; os clientes podem enviar várias requisições sem esperar
+        int offset = 0;
+        while (c->rx_len - offset >= MBAP_HEADER) {
+            const uint8_t *adu = c->rx + offset;
+            int protocol = (adu[2] << 8) | adu[3];
+            int length = (adu[4] << 8) | adu[5];
+
+            if (protocol != 0 || length < 2 || length > MBAP_MAX_LENGTH) {
+                close_client(gw, index);
+                return;
+            }
+            if (c->rx_len - offset < 6 + length) {
+                break;
+            }
+
+            handle_adu(gw, index, adu, length - 1);
+            if (c->fd < 0 || c->gen != gen) {
+                return;  // Fechado ao responder
+            }
+            offset += 6 + length;
+        }
+
+        memmove(c->rx, c->rx + offset, c->rx_len - offset);
+        c->rx_len -= offset;
+    }
+}
+
+static void accept_clients(modbus_gateway_t *gw) {
+    for (;;) {
+        int fd = accept4(gw->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                perror("Erro no accept");
+            }
+            return;
+        }
+
+        int index = -1;
+        for (int i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; i++) {
+            if (gw->clients[i].fd < 0) {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0) {
+            fprintf(stderr, "Gateway: limite de %d clientes atingido\n", MODBUS_GATEWAY_MAX_CLIENTS);
+            close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = GW_TAG_CLIENT + index };
+        if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("Erro no epoll do cliente");
+            close(fd);
+            continue;
+        }
+
+        gw->clients[index].fd = fd;
+        gw->stats.connections++;
+    }
+}
+
+static int dispatch(modbus_gateway_t *gw, int timeout_ms) {
+    struct epoll_event events[16];
+
+    int n = epoll_wait(gw->epoll_fd, events, 16, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("Erro no epoll do gateway");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t tag = events[i].data.u32;
+
+        if (tag == GW_TAG_LISTEN) {
+            accept_clients(gw);
+        } else if (tag == GW_TAG_BUS) {
+            if (modbus_async_process(gw->bus) < 0) {
+                return -1;
+            }
+        } else {
+            int index = tag - GW_TAG_CLIENT;
+            if (gw->clients[index].fd < 0) {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                client_flush(gw, index);
+            }
+            if (gw->clients[index].fd >= 0 && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                client_readable(gw, index);
+            }
+        }
+    }
+
+    return 0;
+}
+
+modbus_gateway_t *modbus_gateway_create(modbus_async_t *bus, const char *bind_addr, int port) {
+    modbus_gateway_t *gw = calloc(1, sizeof(*gw));
+    if (gw == NULL) {
+        return NULL;
+    }
+
+    gw->bus = bus;
+    gw->cache_ttl_ms = MODBUS_GATEWAY_DEFAULT_CACHE_MS;
+    for (int i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; i++) {
+        gw->clients[i].fd = -1;
+    }
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (inet_pton(AF_INET, bind_addr != NULL ? bind_addr : "127.0.0.1", &addr.sin_addr) != 1) {
+        fprintf(stderr, "Endereço de escuta inválido: %s\n", bind_addr);
+        free(gw);
+        return NULL;
+    }
+
+    gw->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    gw->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (gw->epoll_fd < 0 || gw->listen_fd < 0) {
+        perror("Erro ao criar o socket do gateway");
+        modbus_gateway_destroy(gw);
+        return NULL;
+    }
+
+    int one = 1;
+    setsockopt(gw->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(gw->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(gw->listen_fd, 16) < 0) {
+        perror("Erro ao abrir a porta do gateway");
+        modbus_gateway_destroy(gw);
+        return NULL;
+    }
+
+    struct epoll_event lev = { .events = EPOLLIN, .data.u32 = GW_TAG_LISTEN };
+    struct epoll_event bev = { .events = EPOLLIN, .data.u32 = GW_TAG_BUS };
+    if (epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, gw->listen_fd, &lev) < 0 ||
+        epoll_ctl(gw->epoll_fd, EPOLL_CTL_ADD, modbus_async_fd(bus), &bev) < 0) {
+        perror("Erro no epoll do gateway");
+        modbus_gateway_destroy(gw);
+        return NULL;
+    }
+
+    return gw;
+}
+
+void modbus_gateway_destroy(modbus_gateway_t *gw) {
+    if (gw == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < MODBUS_GATEWAY_MAX_CLIENTS; i++) {
+        if (gw->clients[i].fd >= 0) {
+            close_client(gw, i);
+        }
+    }
+
+    // Requisições ainda no barramento não podem ter a memória liberada
+    while (modbus_async_pending(gw->bus) > 0) {
+        if (dispatch(gw, 100) < 0) {
+            break;
+        }
+    }
+
+    if (gw->listen_fd >= 0) {
+        close(gw->listen_fd);
+    }
+    if (gw->epoll_fd >= 0) {
+        close(gw->epoll_fd);
+    }
+    free(gw);
+}
+
+void modbus_gateway_set_cache_ttl_ms(modbus_gateway_t *gw, int ttl_ms) {
+    gw->cache_ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+    if (gw->cache_ttl_ms == 0) {
+        memset(gw->cache, 0, sizeof(gw->cache));
+    }
+}
+
+void modbus_gateway_load_config(modbus_gateway_t *gw) {
+    modbus_gateway_set_cache_ttl_ms(gw, config_get_int("MODBUS_GATEWAY_CACHE_MS", MODBUS_GATEWAY_DEFAULT_CACHE_MS));
+}
+
+int modbus_gateway_fd(const modbus_gateway_t *gw) {
+    return gw->epoll_fd;
+}
+
+int modbus_gateway_process(modbus_gateway_t *gw) {
+    return dispatch(gw, 0);
+}
+
+int modbus_gateway_run(modbus_gateway_t *gw, volatile sig_atomic_t *stop) {
+    while (!*stop) {
+        if (dispatch(gw, 100) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void modbus_gateway_get_stats(const modbus_gateway_t *gw, modbus_gateway_stats_t *stats) {
+    *stats = gw->stats;
+}
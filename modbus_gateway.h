@@ -0,0 +1,98 @@
+#ifndef MODBUS_GATEWAY_H
+#define MODBUS_GATEWAY_H
+
+#include <stdint.h>
+#include <signal.h>
+#include "modbus_async.h"
+
+/*
+ * Gateway MODBUS TCP -> RTU: atende clientes MODBUS TCP (cabeçalho MBAP) numa
+ * porta local e traduz cada requisição para o barramento RS485, com trailer
+ * de matrícula e CRC. Tudo roda numa única thread: o socket de escuta, os
+ * clientes e o barramento (modbus_async) ficam no mesmo epoll, de modo que
+ * muitos clientes compartilham o barramento sem bloquear uns aos outros.
+ *
+ * Do lado TCP os campos seguem o padrão MODBUS (big-endian); do lado RTU, o
+ * formato little-endian dos escravos do estacionamento. A conversão é feita
+ * para 0x03, 0x06 e 0x10; as demais funções passam sem alteração.
+ *
+ * Leituras 0x03 repetidas (mesmo escravo, início e quantidade) são atendidas
+ * por um cache com TTL curto, e leituras iguais que chegam enquanto uma está
+ * no barramento aguardam a resposta dela. Escritas pelo gateway descartam o
+ * cache do escravo e, enquanto houver uma no barramento, as leituras dele não
+ * usam o cache nem se juntam a outra: uma leitura depois de uma escrita
+ * sempre vê o valor escrito.
+ */
+
+#define MODBUS_GATEWAY_DEFAULT_PORT 1502
+#define MODBUS_GATEWAY_MAX_CLIENTS 32
+#define MODBUS_GATEWAY_MAX_PENDING 64     // Requisições em andamento (todas as conexões)
+#define MODBUS_GATEWAY_CACHE_SLOTS 64     // Leituras distintas no cache (potência de 2)
+#define MODBUS_GATEWAY_DEFAULT_CACHE_MS 100
+
+// Exceções geradas pelo próprio gateway
+#define MODBUS_EXC_ILLEGAL_DATA_VALUE 0x03
+#define MODBUS_EXC_BUSY               0x06
+#define MODBUS_EXC_GATEWAY_PATH       0x0A  // Barramento indisponível
+#define MODBUS_EXC_GATEWAY_TARGET     0x0B  // Escravo não respondeu
+
+typedef struct modbus_gateway modbus_gateway_t;
+
+// Contadores do gateway
+typedef struct {
+    uint64_t connections;  // Conexões aceitas
+    uint64_t requests;     // Requisições recebidas
+    uint64_t cache_hits;   // Leituras respondidas pelo cache
+    uint64_t joined;       // Leituras que aguardaram uma igual já no barramento
+    uint64_t bus_txns;     // Transações enviadas ao barramento
+    uint64_t exceptions;   // Respostas de exceção (do escravo ou do gateway)
+} modbus_gateway_stats_t;
+
+/**
+ * @brief Cria o gateway e abre o socket de escuta
+ * @param bus Barramento (o gateway passa a ser o único usuário)
+ * @param bind_addr Endereço IPv4 de escuta (NULL = 127.0.0.1)
+ * @param port Porta TCP
+ * @return Handle ou NULL em caso de erro
+ */
+modbus_gateway_t *modbus_gateway_create(modbus_async_t *bus, const char *bind_addr, int port);
+
+/**
+ * @brief Fecha as conexões e o socket de escuta (o barramento não é liberado)
+ */
+void modbus_gateway_destroy(modbus_gateway_t *gw);
+
+/**
+ * @brief Define o TTL do cache de leituras 0x03
+ * @param ttl_ms Validade de uma resposta em ms (0 = sem cache; leituras iguais ainda são unidas)
+ */
+void modbus_gateway_set_cache_ttl_ms(modbus_gateway_t *gw, int ttl_ms);
+
+/**
+ * @brief Aplica MODBUS_GATEWAY_CACHE_MS da configuração
+ */
+void modbus_gateway_load_config(modbus_gateway_t *gw);
+
+/**
+ * @brief fd a registrar num laço externo (EPOLLIN)
+ */
+int modbus_gateway_fd(const modbus_gateway_t *gw);
+
+/**
+ * @brief Processa conexões, requisições e o barramento, sem bloquear
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int modbus_gateway_process(modbus_gateway_t *gw);
+
+/**
+ * @brief Laço do gateway até *stop ficar diferente de zero
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int modbus_gateway_run(modbus_gateway_t *gw, volatile sig_atomic_t *stop);
+
+/**
+ * @brief Lê os contadores
+ */
+void modbus_gateway_get_stats(const modbus_gateway_t *gw, modbus_gateway_stats_t *stats);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include "modbus_gateway.h"
+#include "modbus_parking.h"
+#include "config.h"
+#include "retry.h"
+#include "trace.h"
+#include "uart.h"
+#include "bus_capture.h"
+
+/*
+ * Gateway MODBUS TCP do servidor do térreo: o servidor central (ou qualquer
+ * cliente MODBUS TCP) acessa câmeras e placar por uma porta local. Uso típico:
+ *
+ *   ./modbus_sim -l /tmp/ttyMODBUS &
+ *   ./modbus_gatewayd -d /tmp/ttyMODBUS -p 1502
+ */
+
+#define MATRICULA "6383"
+
+static volatile sig_atomic_t stop;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s [opções]\n"
+            "  -d DISPOSITIVO  porta serial (padrão: UART_DEVICE ou /dev/serial0)\n"
+            "  -a ENDEREÇO     endereço IPv4 de escuta (padrão: MODBUS_GATEWAY_BIND ou 127.0.0.1)\n"
+            "  -p PORTA        porta TCP (padrão: MODBUS_GATEWAY_PORT ou %d)\n"
+            "  -c MS           TTL do cache de leituras 0x03 (padrão: MODBUS_GATEWAY_CACHE_MS ou %d)\n"
+            "  -m XXXX         matrícula do trailer (padrão: MATRICULA ou " MATRICULA ")\n",
+            prog, MODBUS_GATEWAY_DEFAULT_PORT, MODBUS_GATEWAY_DEFAULT_CACHE_MS);
+}
+
+int main(int argc, char *argv[]) {
+    const char *uart_device = "/dev/serial0";
+    const char *bind_addr = "127.0.0.1";
+    const char *matricula = MATRICULA;
+    uart_config_t uart_config;
+    int cache_ms = -1;
+    int opt;
+
+    int config_loaded = config_load(".env") >= 0;
+    uart_config_default(&uart_config);
+    if (config_loaded) {
+        uart_load_config(&uart_config);
+        modbus_load_timing_config();
+        retry_load_config();
+        trace_load_config();
+        bus_capture_load_config();
+        if (config_get("UART_DEVICE") != NULL) {
+            uart_device = config_get("UART_DEVICE");
+        }
+        if (config_get("MATRICULA") != NULL) {
+            matricula = config_get("MATRICULA");
+        }
+        if (config_get("MODBUS_GATEWAY_BIND") != NULL) {
+            bind_addr = config_get("MODBUS_GATEWAY_BIND");
+        }
+    }
+    int port = config_get_int("MODBUS_GATEWAY_PORT", MODBUS_GATEWAY_DEFAULT_PORT);
+
+    while ((opt = getopt(argc, argv, "d:a:p:c:m:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                uart_device = optarg;
+                break;
+            case 'a':
+                bind_addr = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                cache_ms = atoi(optarg);
+                break;
+            case 'm':
+                matricula = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (strlen(matricula) != 4) {
+        fprintf(stderr, "Matrícula deve ter 4 dígitos: %s\n", matricula);
+        return 1;
+    }
+
+    int uart_fd = open_uart_config(uart_device, &uart_config);
+    if (uart_fd < 0) {
+        fprintf(stderr, "Erro ao abrir UART %s\n", uart_device);
+        return 1;
+    }
+
+    modbus_async_t *bus = modbus_async_create(uart_fd, matricula);
+    if (bus == NULL) {
+        close_uart(uart_fd);
+        return 1;
+    }
+
+    modbus_gateway_t *gw = modbus_gateway_create(bus, bind_addr, port);
+    if (gw == NULL) {
+        modbus_async_destroy(bus);
+        close_uart(uart_fd);
+        return 1;
+    }
+    modbus_gateway_load_config(gw);
+    if (cache_ms >= 0) {
+        modbus_gateway_set_cache_ttl_ms(gw, cache_ms);
+    }
+
+    printf("Gateway MODBUS TCP em %s:%d -> %s (%d bps, matrícula %s)\n",
+           bind_addr, port, uart_device, uart_config.baudrate, matricula);
+    fflush(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ret = modbus_gateway_run(gw, &stop);
+
+    modbus_gateway_stats_t stats;
+    modbus_gateway_get_stats(gw, &stats);
+    printf("\nConexões: %llu, requisições: %llu, cache: %llu, unidas: %llu, barramento: %llu, exceções: %llu\n",
+           (unsigned long long)stats.connections, (unsigned long long)stats.requests,
+           (unsigned long long)stats.cache_hits, (unsigned long long)stats.joined,
+           (unsigned long long)stats.bus_txns, (unsigned long long)stats.exceptions);
+
+    modbus_gateway_destroy(gw);
+    modbus_async_destroy(bus);
+    bus_capture_close();
+    close_uart(uart_fd);
+    return ret == 0 ? 0 : 1;
+}
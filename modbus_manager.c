@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "modbus_manager.h"
+#include "config.h"
+#include "retry.h"
+#include "lpr_capture.h"
+
+typedef struct {
+    int uart_fd;
+    int owns_fd;  // Aberta pelo gerente (fechada em modbus_manager_destroy)
+    modbus_bus_t *bus;
+} manager_port_t;
+
+struct modbus_manager {
+    char matricula[5];
+    int port_count;
+    manager_port_t ports[MODBUS_MANAGER_MAX_PORTS];
+    uint8_t port_of[256];
+};
+
+modbus_manager_t *modbus_manager_create(const char *matricula) {
+    modbus_manager_t *mgr = calloc(1, sizeof(*mgr));
+    if (mgr == NULL) {
+        return NULL;
+    }
+
+    memcpy(mgr->matricula, matricula, 4);
+    mgr->matricula[4] = '\0';
+    return mgr;
+}
+
+void modbus_manager_destroy(modbus_manager_t *mgr) {
+    if (mgr == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < mgr->port_count; i++) {
+        modbus_bus_stop(mgr->ports[i].bus);
+        if (mgr->ports[i].owns_fd) {
+            close_uart(mgr->ports[i].uart_fd);
+        }
+    }
+
+    free(mgr);
+}
+
+static int add_port(modbus_manager_t *mgr, int uart_fd, int owns_fd) {
+    if (mgr->port_count >= MODBUS_MANAGER_MAX_PORTS) {
+        fprintf(stderr, "Limite de %d portas atingido\n", MODBUS_MANAGER_MAX_PORTS);
+        return -1;
+    }
+
+    modbus_bus_t *bus = modbus_bus_start(uart_fd, mgr->matricula);
+    if (bus == NULL) {
+        return -1;
+    }
+    modbus_bus_load_config(bus);
+
+    manager_port_t *port = &mgr->ports[mgr->port_count];
+    port->uart_fd = uart_fd;
+    port->owns_fd = owns_fd;
+    port->bus = bus;
+
+    return mgr->port_count++;
+}
+
+int modbus_manager_add_port(modbus_manager_t *mgr, const char *device, const uart_config_t *config) {
+    int uart_fd = open_uart_config(device, config);
+    if (uart_fd < 0) {
+        return -1;
+    }
+
+    int port = add_port(mgr, uart_fd, 1);
+    if (port < 0) {
+        close_uart(uart_fd);
+    }
+    return port;
+}
+
+int modbus_manager_add_fd(modbus_manager_t *mgr, int uart_fd) {
+    return add_port(mgr, uart_fd, 0);
+}
+
+int modbus_manager_map(modbus_manager_t *mgr, uint8_t addr, int port) {
+    if (port < 0 || port >= MODBUS_MANAGER_MAX_PORTS) {
+        return -1;
+    }
+
+    mgr->port_of[addr] = (uint8_t)port;
+    return 0;
+}
+
+int modbus_manager_load_config(modbus_manager_t *mgr) {
+    char devices[512];
+    char key[64];
+    uart_config_t base;
+
+    const char *list = config_get("MODBUS_PORTS");
+    if (list == NULL) {
+        list = config_get("UART_DEVICE");
+    }
+    if (list == NULL) {
+        fprintf(stderr, "Nenhuma porta configurada (MODBUS_PORTS ou UART_DEVICE)\n");
+        return -1;
+    }
+
+    uart_config_default(&base);
+    uart_load_config(&base);
+
+    snprintf(devices, sizeof(devices), "%s", list);
+    char *saveptr = NULL;
+    for (char *device = strtok_r(devices, ",", &saveptr); device != NULL;
+         device = strtok_r(NULL, ",", &saveptr)) {
+        while (*device == ' ') {
+            device++;
+        }
+
+        uart_config_t config = base;
+        snprintf(key, sizeof(key), "MODBUS_PORT%d_BAUDRATE", mgr->port_count);
+        config.baudrate = config_get_int(key, config.baudrate);
+
+        if (modbus_manager_add_port(mgr, device, &config) < 0) {
+            fprintf(stderr, "Erro ao abrir a porta %s\n", device);
+            return -1;
+        }
+    }
+
+    for (int addr = 1; addr < 256; addr++) {
+        snprintf(key, sizeof(key), "MODBUS_0x%02X_PORT", addr);
+        if (config_get(key) == NULL) {
+            continue;
+        }
+
+        int port = config_get_int(key, 0);
+        if (port >= mgr->port_count || modbus_manager_map(mgr, (uint8_t)addr, port) != 0) {
+            fprintf(stderr, "%s: porta %d inexistente\n", key, port);
+            return -1;
+        }
+    }
+
+    return mgr->port_count;
+}
+
+int modbus_manager_port_count(const modbus_manager_t *mgr) {
+    return mgr->port_count;
+}
+
+int modbus_manager_port_of(const modbus_manager_t *mgr, uint8_t addr) {
+    return mgr->port_of[addr];
+}
+
+modbus_bus_t *modbus_manager_bus(modbus_manager_t *mgr, uint8_t addr) {
+    int port = mgr->port_of[addr];
+    return port < mgr->port_count ? mgr->ports[port].bus : NULL;
+}
+
+int modbus_manager_submit(modbus_manager_t *mgr, modbus_txn_t *txn) {
+    modbus_bus_t *bus = modbus_manager_bus(mgr, txn->addr);
+    if (bus == NULL) {
+        return -1;
+    }
+
+    return modbus_bus_submit(bus, txn);
+}
+
+int modbus_manager_execute(modbus_manager_t *mgr, modbus_txn_t *txn) {
+    if (modbus_manager_submit(mgr, txn) != 0) {
+        return -1;
+    }
+
+    return modbus_txn_wait(txn);
+}
+
+// Operação encaminhada: leva o prazo da thread chamadora para a thread de E/S
+typedef struct {
+    modbus_txn_fn fn;
+    void *arg;
+    int64_t deadline_us;
+} routed_call_t;
+
+static int run_routed_call(int uart_fd, const char *matricula, void *arg) {
+    routed_call_t *call = arg;
+
+    int64_t previous = retry_set_deadline(call->deadline_us);
+    int ret = call->fn(uart_fd, matricula, call->arg);
+    retry_set_deadline(previous);
+
+    return ret;
+}
+
+int modbus_manager_call(modbus_manager_t *mgr, uint8_t addr, modbus_txn_fn fn, void *arg,
+                        modbus_prio_t priority) {
+    routed_call_t call = { .fn = fn, .arg = arg, .deadline_us = retry_get_deadline() };
+    modbus_txn_t txn;
+
+    modbus_txn_init_call(&txn, run_routed_call, &call, priority);
+    txn.addr = addr;
+    return modbus_manager_execute(mgr, &txn);
+}
+
+typedef struct {
+    uint8_t addr;
+    void *out;
+    const void *in;
+} device_call_t;
+
+// Um passo da captura (no máximo uma transação) na thread de E/S da porta
+static int call_capture_step(int uart_fd, const char *matricula, void *arg) {
+    lpr_capture_step(uart_fd, matricula, arg);
+    return 0;
+}
+
+static int call_read_status(int uart_fd, const char *matricula, void *arg) {
+    device_call_t *call = arg;
+    return lpr_read_status(uart_fd, call->addr, matricula, call->out);
+}
+
+static int call_read_data(int uart_fd, const char *matricula, void *arg) {
+    device_call_t *call = arg;
+    return lpr_read_data(uart_fd, call->addr, matricula, call->out);
+}
+
+static int call_placar_update(int uart_fd, const char *matricula, void *arg) {
+    device_call_t *call = arg;
+    return placar_update(uart_fd, matricula, call->in);
+}
+
+/*
+ * Como o ctx_capture de modbus_ctx.c: a máquina de estados avança na thread
+ * chamadora e cada passo vai para a thread de E/S como uma transação. Nas
+ * esperas do polling a porta atende as outras câmeras e o placar.
+ */
+int modbus_manager_capture_plate(modbus_manager_t *mgr, uint8_t camera_addr, lpr_data_t *data,
+                                 int max_retries, int timeout_ms) {
+    lpr_capture_t cap;
+    int ret;
+
+    if (modbus_manager_bus(mgr, camera_addr) == NULL) {
+        return -1;
+    }
+    int port_fd = mgr->ports[mgr->port_of[camera_addr]].uart_fd;
+
+    lpr_capture_init(&cap, camera_addr, max_retries, timeout_ms);
+    if (lpr_capture_cache_begin(port_fd, &cap, data, &ret) != LPR_CACHE_MISS) {
+        return ret;
+    }
+
+    while (!lpr_capture_finished(&cap)) {
+        int64_t wait = cap.next_action_us - retry_now_us();
+        if (wait > 0) {
+            usleep(wait);
+        }
+
+        // Barramento parando: a captura não termina
+        if (modbus_manager_call(mgr, camera_addr, call_capture_step, &cap, MODBUS_PRIO_CRITICAL) != 0) {
+            cap.state = LPR_CAPTURE_FAILED;
+        }
+    }
+
+    ret = cap.state == LPR_CAPTURE_DONE ? 0 : -1;
+    lpr_capture_cache_end(port_fd, camera_addr, ret, &cap.data);
+    if (ret == 0) {
+        *data = cap.data;
+    }
+    return ret;
+}
+
+int modbus_manager_read_status(modbus_manager_t *mgr, uint8_t camera_addr, uint8_t *status) {
+    device_call_t call = { .addr = camera_addr, .out = status };
+    return modbus_manager_call(mgr, camera_addr, call_read_status, &call, MODBUS_PRIO_CRITICAL);
+}
+
+int modbus_manager_read_data(modbus_manager_t *mgr, uint8_t camera_addr, lpr_data_t *data) {
+    device_call_t call = { .addr = camera_addr, .out = data };
+    return modbus_manager_call(mgr, camera_addr, call_read_data, &call, MODBUS_PRIO_CRITICAL);
+}
+
+int modbus_manager_placar_update(modbus_manager_t *mgr, const placar_data_t *data) {
+    device_call_t call = { .addr = PLACAR_VAGAS_ADDR, .in = data };
+    return modbus_manager_call(mgr, PLACAR_VAGAS_ADDR, call_placar_update, &call, MODBUS_PRIO_LOW);
+}
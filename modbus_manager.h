@@ -0,0 +1,133 @@
+#ifndef MODBUS_MANAGER_H
+#define MODBUS_MANAGER_H
+
+#include <stdint.h>
+#include "modbus_parking.h"
+#include "modbus_bus.h"
+#include "uart.h"
+
+/*
+ * Gerente de várias portas seriais: cada segmento RS485 tem sua UART e sua
+ * thread de E/S (modbus_bus), e cada escravo é atribuído a uma porta. As
+ * chamadas por endereço são encaminhadas à porta certa, então o tráfego de
+ * segmentos diferentes corre em paralelo.
+ */
+
+#define MODBUS_MANAGER_MAX_PORTS 8
+
+typedef struct modbus_manager modbus_manager_t;
+
+/**
+ * @brief Cria o gerente (sem portas)
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @return Handle ou NULL em caso de erro
+ */
+modbus_manager_t *modbus_manager_create(const char *matricula);
+
+/**
+ * @brief Para as threads de E/S e fecha as portas abertas pelo gerente
+ */
+void modbus_manager_destroy(modbus_manager_t *mgr);
+
+/**
+ * @brief Abre uma porta e inicia sua thread de E/S
+ * @param mgr Gerente
+ * @param device Caminho do dispositivo (ex: "/dev/ttyUSB1")
+ * @param config Parâmetros da linha
+ * @return Índice da porta ou -1 em caso de erro
+ */
+int modbus_manager_add_port(modbus_manager_t *mgr, const char *device, const uart_config_t *config);
+
+/**
+ * @brief Adiciona uma porta já aberta (o gerente não a fecha)
+ * @return Índice da porta ou -1 em caso de erro
+ */
+int modbus_manager_add_fd(modbus_manager_t *mgr, int uart_fd);
+
+/**
+ * @brief Atribui um escravo a uma porta (escravos sem atribuição ficam na porta 0)
+ *
+ * Deve ser feito na configuração, antes de submeter transações.
+ *
+ * @return 0 em caso de sucesso, -1 se a porta não existir
+ */
+int modbus_manager_map(modbus_manager_t *mgr, uint8_t addr, int port);
+
+/**
+ * @brief Abre as portas e aplica o mapa da configuração
+ *
+ * MODBUS_PORTS lista os dispositivos separados por vírgula (padrão:
+ * UART_DEVICE). Cada porta usa os parâmetros de uart_load_config(), com
+ * MODBUS_PORT<n>_BAUDRATE opcional. MODBUS_0x<ADDR>_PORT atribui um escravo
+ * à porta n. A junção de leituras de cada porta vem de modbus_bus_load_config().
+ *
+ * @return Número de portas abertas ou -1 em caso de erro
+ */
+int modbus_manager_load_config(modbus_manager_t *mgr);
+
+/**
+ * @brief Número de portas
+ */
+int modbus_manager_port_count(const modbus_manager_t *mgr);
+
+/**
+ * @brief Porta de um escravo
+ */
+int modbus_manager_port_of(const modbus_manager_t *mgr, uint8_t addr);
+
+/**
+ * @brief Barramento (thread de E/S) que atende um escravo
+ */
+modbus_bus_t *modbus_manager_bus(modbus_manager_t *mgr, uint8_t addr);
+
+/**
+ * @brief Submete uma transação à porta de txn->addr
+ *
+ * Para operações compostas (modbus_txn_init_call), defina txn->addr com o
+ * escravo envolvido ou use modbus_manager_call().
+ *
+ * @return 0 em caso de sucesso, -1 se o barramento estiver parando
+ */
+int modbus_manager_submit(modbus_manager_t *mgr, modbus_txn_t *txn);
+
+/**
+ * @brief Submete e aguarda (atalho síncrono)
+ */
+int modbus_manager_execute(modbus_manager_t *mgr, modbus_txn_t *txn);
+
+/**
+ * @brief Executa fn(uart_fd, matricula, arg) na thread de E/S da porta de addr
+ *
+ * O prazo da thread chamadora (retry_set_deadline) vale também durante fn.
+ *
+ * @return Valor retornado por fn ou -1 se o barramento estiver parando
+ */
+int modbus_manager_call(modbus_manager_t *mgr, uint8_t addr, modbus_txn_fn fn, void *arg,
+                        modbus_prio_t priority);
+
+/**
+ * @brief lpr_capture_plate() na porta da câmera (prioridade crítica)
+ *
+ * A porta é ocupada a cada passo da captura (trigger, leitura de status,
+ * leitura dos dados, reset), não durante ela inteira: enquanto a câmera
+ * processa a imagem, a thread de E/S atende as outras transações da porta.
+ */
+int modbus_manager_capture_plate(modbus_manager_t *mgr, uint8_t camera_addr, lpr_data_t *data,
+                                 int max_retries, int timeout_ms);
+
+/**
+ * @brief lpr_read_status() na porta da câmera
+ */
+int modbus_manager_read_status(modbus_manager_t *mgr, uint8_t camera_addr, uint8_t *status);
+
+/**
+ * @brief lpr_read_data() na porta da câmera
+ */
+int modbus_manager_read_data(modbus_manager_t *mgr, uint8_t camera_addr, lpr_data_t *data);
+
+/**
+ * @brief placar_update() na porta do placar (prioridade baixa)
+ */
+int modbus_manager_placar_update(modbus_manager_t *mgr, const placar_data_t *data);
+
+#endif
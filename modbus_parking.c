@@ -2,270 +2,775 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "modbus_parking.h"
 #include "crc16.h"
 #include "uart.h"
+#include "config.h"
+#include "lpr_capture.h"
+#include "modbus_frame.h"
+#include "trace.h"
+#include "metrics.h"
+#include "retry.h"
+#include "modbus_ctx.h"
 
-// Função auxiliar para construir mensagem MODBUS com matrícula
-static int build_modbus_message(uint8_t *buffer, uint8_t addr, uint8_t func, 
-                                 const uint8_t *data, int data_len, const char *matricula) {
-    uint8_t *ptr = buffer;
-    
-    // Endereço do dispositivo
-    *ptr++ = addr;
-    
-    // Código de função
-    *ptr++ = func;
-    
-    // Dados da requisição
-    if (data != NULL && data_len > 0) {
-        memcpy(ptr, data, data_len);
-        ptr += data_len;
+// Perfil padrão: sem tempo morto, leitura logo após o tcdrain()
+#define MODBUS_DEFAULT_TIMEOUT_MS 500
+
+static modbus_timing_t default_timing = {
+    .turnaround_us = 0,
+    .response_timeout_ms = MODBUS_DEFAULT_TIMEOUT_MS,
+    .frame_gap_us = 0,
+    .response_trailer = 0,
+};
+
+static modbus_timing_t device_timing[256];
+static uint8_t device_timing_set[256];
+
+void modbus_set_device_timing(uint8_t addr, const modbus_timing_t *timing) {
+    if (timing == NULL) {
+        device_timing_set[addr] = 0;
+        return;
     }
-    
-    // Adiciona os 4 últimos dígitos da matrícula
-    for (int i = 0; i < 4; i++) {
-        *ptr++ = (uint8_t)matricula[i];
+
+    device_timing[addr] = *timing;
+    device_timing_set[addr] = 1;
+}
+
+void modbus_get_device_timing(uint8_t addr, modbus_timing_t *timing) {
+    *timing = device_timing_set[addr] ? device_timing[addr] : default_timing;
+}
+
+void modbus_set_default_timing(const modbus_timing_t *timing) {
+    default_timing = *timing;
+}
+
+int modbus_load_timing_config(void) {
+    char key[64];
+    int overrides = 0;
+
+    default_timing.response_timeout_ms = config_get_int("MODBUS_TIMEOUT_MS", MODBUS_DEFAULT_TIMEOUT_MS);
+    default_timing.turnaround_us = config_get_int("MODBUS_TURNAROUND_US", 0);
+    default_timing.frame_gap_us = config_get_int("MODBUS_FRAME_GAP_US", 0);
+    default_timing.response_trailer = config_get_int("MODBUS_RESPONSE_TRAILER", 0);
+
+    for (int addr = 1; addr < 256; addr++) {
+        modbus_timing_t timing = default_timing;
+        int found = 0;
+
+        snprintf(key, sizeof(key), "MODBUS_0x%02X_TIMEOUT_MS", addr);
+        if (config_get(key) != NULL) {
+            timing.response_timeout_ms = config_get_int(key, timing.response_timeout_ms);
+            found = 1;
+        }
+
+        snprintf(key, sizeof(key), "MODBUS_0x%02X_TURNAROUND_US", addr);
+        if (config_get(key) != NULL) {
+            timing.turnaround_us = config_get_int(key, timing.turnaround_us);
+            found = 1;
+        }
+
+        snprintf(key, sizeof(key), "MODBUS_0x%02X_FRAME_GAP_US", addr);
+        if (config_get(key) != NULL) {
+            timing.frame_gap_us = config_get_int(key, timing.frame_gap_us);
+            found = 1;
+        }
+
+        snprintf(key, sizeof(key), "MODBUS_0x%02X_RESPONSE_TRAILER", addr);
+        if (config_get(key) != NULL) {
+            timing.response_trailer = config_get_int(key, timing.response_trailer);
+            found = 1;
+        }
+
+        if (found) {
+            modbus_set_device_timing((uint8_t)addr, &timing);
+            overrides++;
+        }
+    }
+
+    return overrides;
+}
+
+/*
+ * Buffer de transmissão reutilizável, alinhado em linha de cache. É por
+ * thread: com o mestre assíncrono (modbus_bus) há um por barramento.
+ */
+static _Thread_local modbus_frame_t tx_frame;
+
+// Recepção das requisições internas (a resposta é lida antes da próxima transação)
+static _Thread_local uint8_t rx_frame[MODBUS_MAX_FRAME] __attribute__((aligned(64)));
+
+// Com um contexto tomado pela thread (modbus_ctx_lock), usa o buffer dele
+static modbus_frame_t *current_frame(void) {
+    modbus_ctx_t *ctx = modbus_ctx_current();
+    return ctx != NULL ? modbus_ctx_frame(ctx) : &tx_frame;
+}
+
+static uint8_t *current_rx(void) {
+    modbus_ctx_t *ctx = modbus_ctx_current();
+    return ctx != NULL ? modbus_ctx_rx_buffer(ctx) : rx_frame;
+}
+
+// Fecha o quadro; com a matrícula do contexto, usa o trailer pré-formatado dele
+static int finish_frame(modbus_frame_t *frame, const char *matricula) {
+    modbus_ctx_t *ctx = modbus_ctx_current();
+
+    if (ctx != NULL) {
+        const modbus_trailer_t *trailer = modbus_ctx_trailer(ctx);
+        if (memcmp(trailer->bytes, matricula, 4) == 0) {
+            return modbus_frame_finish_trailer(frame, trailer);
+        }
+    }
+    return modbus_frame_finish(frame, matricula);
+}
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static _Thread_local modbus_error_t last_error;
+
+modbus_error_t modbus_last_error(void) {
+    return last_error;
+}
+
+const char *modbus_error_name(modbus_error_t err) {
+    static const char *const names[MODBUS_ERR_COUNT] = {
+        [MODBUS_OK] = "sucesso",
+        [MODBUS_ERR_TIMEOUT] = "timeout",
+        [MODBUS_ERR_CRC] = "CRC inválido",
+        [MODBUS_ERR_FRAME] = "resposta inválida",
+        [MODBUS_ERR_BUSY] = "escravo ocupado",
+        [MODBUS_ERR_EXCEPTION] = "exceção",
+        [MODBUS_ERR_IO] = "erro de E/S",
+        [MODBUS_ERR_DEADLINE] = "prazo esgotado",
+    };
+
+    return err >= 0 && err < MODBUS_ERR_COUNT ? names[err] : "desconhecido";
+}
+
+modbus_error_t modbus_rx_result(const modbus_rx_t *rx) {
+    uint8_t addr = rx->addr;
+    uint8_t func = rx->func;
+    const uint8_t *buffer = rx->buf;
+
+    switch (rx->status) {
+        case MODBUS_RX_OK:
+            return MODBUS_OK;
+
+        case MODBUS_RX_EXCEPTION:
+            TRACE_ERROR(TRACE_EV_EXCEPTION, addr, func, buffer[2], 0);
+            metrics_count_error(addr, func, METRICS_ERR_EXCEPTION);
+            // 0x05 (acknowledge) e 0x06 (slave device busy) são transitórias
+            return buffer[2] == 0x05 || buffer[2] == 0x06 ? MODBUS_ERR_BUSY : MODBUS_ERR_EXCEPTION;
+
+        case MODBUS_RX_BAD_CRC: {
+            // Só no caminho de erro: o CRC calculado entra no trace
+            uint16_t received_crc = (buffer[rx->len - 1] << 8) | buffer[rx->len - 2];
+            uint16_t calculated_crc = crc16_modbus(buffer, rx->len - 2);
+            TRACE_ERROR(TRACE_EV_CRC, addr, func, received_crc, calculated_crc);
+            metrics_count_error(addr, func, METRICS_ERR_CRC);
+            return MODBUS_ERR_CRC;
+        }
+
+        case MODBUS_RX_BAD_ADDR:
+            TRACE_ERROR(TRACE_EV_BAD_ADDR, addr, func, buffer[0], 0);
+            metrics_count_error(addr, func, METRICS_ERR_OTHER);
+            return MODBUS_ERR_FRAME;
+
+        case MODBUS_RX_BAD_FUNC:
+            TRACE_ERROR(TRACE_EV_BAD_FUNC, addr, func, buffer[1], 0);
+            metrics_count_error(addr, func, METRICS_ERR_OTHER);
+            return MODBUS_ERR_FRAME;
+
+        case MODBUS_RX_MISMATCH:
+            TRACE_ERROR(TRACE_EV_MISMATCH, addr, func, rx->len - 1, 0);
+            metrics_count_error(addr, func, METRICS_ERR_OTHER);
+            return MODBUS_ERR_FRAME;
+
+        default:
+            // Incompleto (silêncio antes do tamanho anunciado) ou maior que o buffer
+            TRACE_ERROR(TRACE_EV_SHORT, addr, func, rx->len, 0);
+            metrics_count_error(addr, func, METRICS_ERR_OTHER);
+            return MODBUS_ERR_FRAME;
+    }
+}
+
+modbus_error_t modbus_verify_response(const uint8_t *buffer, int len, uint8_t expected_addr, uint8_t expected_func) {
+    modbus_rx_t rx;
+
+    modbus_rx_init(&rx, (uint8_t *)buffer, len, expected_addr, expected_func);
+    modbus_rx_push(&rx, len);
+    modbus_rx_finish(&rx);
+
+    return modbus_rx_result(&rx);
+}
+
+/*
+ * Envia a requisição e lê a resposta conforme o perfil de tempo do
+ * dispositivo, com o timeout cortado para não passar do prazo. A resposta é
+ * validada enquanto chega (rx->status), procurando o quadro no fluxo depois
+ * do eco local e de bytes atrasados.
+ * Retorna o tamanho da resposta, 0 sem resposta ou -1 se o envio falhar.
+ */
+static int modbus_transact(int uart_fd, const uint8_t *tx_buffer, int tx_len,
+                           modbus_rx_t *rx, int64_t deadline_us) {
+    modbus_ctx_t *ctx = modbus_ctx_current();
+    modbus_timing_t timing;
+    if (ctx != NULL) {
+        modbus_ctx_get_timing(ctx, tx_buffer[0], &timing);
+    } else {
+        modbus_get_device_timing(tx_buffer[0], &timing);
+    }
+
+    uint64_t stage_us[METRICS_STAGE_COUNT];
+    int64_t start_us = monotonic_us();
+
+    TRACE_FRAME(TRACE_EV_TX, tx_buffer, tx_len);
+
+    // O que chegou antes do envio não é resposta a esta requisição
+    int stale = uart_discard_input(uart_fd);
+    if (stale > 0) {
+        rx->skipped += stale;
+    }
+
+    // send_uart_iov() só retorna após o tcdrain(): o quadro já saiu da linha
+    struct iovec iov = { .iov_base = (void *)tx_buffer, .iov_len = tx_len };
+    if (send_uart_iov(uart_fd, &iov, 1) < 0) {
+        return -1;
+    }
+    int64_t sent_us = monotonic_us();
+    if (timing.turnaround_us > 0) {
+        usleep(timing.turnaround_us);
+    }
+    int64_t listen_us = monotonic_us();
+
+    if (deadline_us != 0) {
+        int64_t remaining_ms = (deadline_us - listen_us) / 1000;
+        if (remaining_ms < timing.response_timeout_ms) {
+            timing.response_timeout_ms = remaining_ms > 0 ? (int)remaining_ms : 1;
+        }
+    }
+
+    modbus_rx_set_trailer(rx, timing.response_trailer);
+    int rx_len = receive_uart_frame(uart_fd, rx, timing.response_timeout_ms, timing.frame_gap_us);
+    int64_t end_us = monotonic_us();
+
+    stage_us[METRICS_STAGE_SEND] = sent_us - start_us;
+    stage_us[METRICS_STAGE_TURNAROUND] = listen_us - sent_us;
+    stage_us[METRICS_STAGE_RECEIVE] = end_us - listen_us;
+    stage_us[METRICS_STAGE_TOTAL] = end_us - start_us;
+    metrics_record_transaction(uart_fd, tx_buffer[0], tx_buffer[1], stage_us);
+
+    if (rx->skipped > 0 || rx->echo > 0) {
+        TRACE_INFO(TRACE_EV_RESYNC, tx_buffer[0], tx_buffer[1], rx->skipped, rx->echo);
+    }
+    if (rx_len > 0) {
+        TRACE_FRAME(TRACE_EV_RX, rx->buf, rx_len);
+    } else {
+        TRACE_ERROR(TRACE_EV_TIMEOUT, tx_buffer[0], tx_buffer[1], 0, 0);
+        metrics_count_error(tx_buffer[0], tx_buffer[1], METRICS_ERR_TIMEOUT);
+    }
+
+    return rx_len;
+}
+
+/*
+ * Transação completa com retentativas (retry.h): fecha o quadro com a
+ * matrícula e o CRC, valida a resposta e repete os erros transitórios dentro
+ * do prazo da thread. expected_bytes confere o byte count de uma leitura 0x03
+ * (-1 = não confere).
+ */
+static int modbus_exchange(int uart_fd, modbus_frame_t *frame, const char *matricula,
+                           uint8_t *rx_buffer, int rx_max, int expected_bytes) {
+    uint8_t addr = frame->buf[0];
+    uint8_t func = frame->buf[1];
+    modbus_ctx_t *ctx = modbus_ctx_current();
+    modbus_error_t err;
+    retry_t local;
+    retry_t *retry = retry_attached();
+    modbus_rx_t rx;
+
+    if (finish_frame(frame, matricula) < 0) {
+        last_error = MODBUS_ERR_FRAME;
+        return -1;
+    }
+
+    // Estado ligado (retry_attach): uma tentativa por chamada, quem ligou reagenda
+    if (retry == NULL) {
+        retry = &local;
+        retry_begin(retry, ctx != NULL ? modbus_ctx_retry_policy(ctx) : NULL, retry_get_deadline());
+    } else if (retry->delay_us >= 0) {
+        // Uma transação anterior da mesma operação já espera para ser refeita
+        return -1;
+    } else if (retry->attempt == 0) {
+        retry_begin(retry, ctx != NULL ? modbus_ctx_retry_policy(ctx) : NULL, retry_get_deadline());
+    }
+
+    for (;;) {
+        if (retry_remaining_us(retry->deadline_us) <= 0) {
+            err = MODBUS_ERR_DEADLINE;
+            break;
+        }
+
+        modbus_rx_init(&rx, rx_buffer, rx_max, addr, func);
+        modbus_rx_set_request(&rx, frame->buf, frame->len);
+        int rx_len = modbus_transact(uart_fd, frame->buf, frame->len, &rx, retry->deadline_us);
+        if (rx_len < 0) {
+            err = MODBUS_ERR_IO;
+        } else if (rx_len == 0) {
+            err = MODBUS_ERR_TIMEOUT;
+        } else {
+            err = modbus_rx_result(&rx);
+            if (err == MODBUS_OK && expected_bytes >= 0 &&
+                (rx_buffer[2] != expected_bytes || rx_len < 5 + expected_bytes)) {
+                TRACE_ERROR(TRACE_EV_BYTE_COUNT, addr, func, rx_buffer[2], expected_bytes);
+                metrics_count_error(addr, func, METRICS_ERR_OTHER);
+                err = MODBUS_ERR_FRAME;
+            }
+        }
+
+        if (err == MODBUS_OK) {
+            last_error = MODBUS_OK;
+            if (ctx != NULL) {
+                modbus_ctx_count(ctx, MODBUS_OK, retry == &local ? retry->attempt : 1);
+            }
+            return rx_len;
+        }
+
+        int64_t delay_us = retry_next_delay(retry, err);
+        if (delay_us < 0) {
+            break;
+        }
+        metrics_count_retry(addr, func);
+
+        if (retry != &local) {
+            retry->delay_us = delay_us;
+            last_error = err;
+            if (ctx != NULL) {
+                modbus_ctx_count_retry(ctx);
+            }
+            return -1;
+        }
+        if (delay_us > 0) {
+            usleep(delay_us);
+        }
     }
+
+    // Falha transitória que esgotou o tempo: o motivo da desistência é o prazo
+    if (retry_is_retryable(err) && retry_remaining_us(retry->deadline_us) <= 0) {
+        err = MODBUS_ERR_DEADLINE;
+    }
+
+    last_error = err;
+    if (ctx != NULL) {
+        modbus_ctx_count(ctx, err, retry == &local ? retry->attempt : 1);
+    }
+    return -1;
+}
+
+int modbus_request(int uart_fd, uint8_t addr, uint8_t func, const uint8_t *data, int data_len,
+                   const char *matricula, uint8_t *rx_buffer, int rx_max) {
+    modbus_frame_t *frame = current_frame();
+
+    modbus_frame_begin(frame, addr, func);
+    modbus_frame_put_bytes(frame, data, data_len);
+
+    return modbus_exchange(uart_fd, frame, matricula, rx_buffer, rx_max, -1);
+}
+
+int lpr_trigger_capture(int uart_fd, uint8_t camera_addr, const char *matricula) {
+    modbus_frame_t *frame = current_frame();
     
-    // Calcula e adiciona o CRC
-    int msg_len = ptr - buffer;
-    uint16_t crc = crc16_modbus(buffer, msg_len);
-    *ptr++ = crc & 0xFF;        // CRC Low
-    *ptr++ = (crc >> 8) & 0xFF; // CRC High
+    // Prepara dados: Write Single Register (0x06) ou Write Multiple Registers (0x10)
+    // Usando 0x10 para escrever no offset 1 (Trigger), campos em little-endian
+    modbus_frame_begin(frame, camera_addr, MODBUS_WRITE_MULTIPLE_REGS);
+    modbus_frame_put_u16(frame, LPR_TRIGGER_OFFSET);  // Starting Address (offset 1)
+    modbus_frame_put_u16(frame, 1);                   // Quantity of Registers (1)
+    modbus_frame_put_u8(frame, 2);                    // Byte Count (2 bytes)
+    modbus_frame_put_u16(frame, 1);                   // Register Value (1 = trigger)
     
-    return ptr - buffer;
+    TRACE_INFO(TRACE_EV_TRIGGER, camera_addr, MODBUS_WRITE_MULTIPLE_REGS, 0, 0);
+    
+    return modbus_exchange(uart_fd, frame, matricula, current_rx(), MODBUS_MAX_FRAME, -1) > 0 ? 0 : -1;
 }
 
-// Função auxiliar para verificar resposta MODBUS
-static int verify_modbus_response(const uint8_t *buffer, int len, uint8_t expected_addr, uint8_t expected_func) {
-    if (len < 5) {  // Mínimo: addr + func + 1 byte data + 2 bytes CRC
-        printf("Resposta muito curta: %d bytes\n", len);
+int modbus_read_holding_registers(int uart_fd, uint8_t addr, uint16_t start, uint16_t count,
+                                  const char *matricula, uint16_t *values) {
+    modbus_frame_t *frame = current_frame();
+    uint8_t *rx_buffer = current_rx();
+    
+    if (count == 0 || count > MODBUS_READ_MAX_REGS) {
+        last_error = MODBUS_ERR_FRAME;
         return -1;
     }
     
-    // Verifica CRC (little-endian)
-    uint16_t received_crc = (buffer[len-1] << 8) | buffer[len-2];
-    uint16_t calculated_crc = crc16_modbus(buffer, len - 2);
+    // Read Holding Registers: endereço inicial e quantidade em little-endian
+    modbus_frame_begin(frame, addr, MODBUS_READ_HOLDING_REGS);
+    modbus_frame_put_u16(frame, start);  // Starting Address
+    modbus_frame_put_u16(frame, count);  // Quantity of Registers
     
-    if (received_crc != calculated_crc) {
-        printf("Erro de CRC: recebido=0x%04X, calculado=0x%04X\n", received_crc, calculated_crc);
+    // Formato resposta: [addr][func][byte_count][data...][crc_lo][crc_hi]
+    if (modbus_exchange(uart_fd, frame, matricula, rx_buffer, MODBUS_MAX_FRAME, count * 2) < 0) {
         return -1;
     }
     
-    // Verifica endereço e função
-    if (buffer[0] != expected_addr) {
-        printf("Endereço incorreto: esperado=0x%02X, recebido=0x%02X\n", expected_addr, buffer[0]);
-        return -1;
+    for (int i = 0; i < count; i++) {
+        values[i] = rx_buffer[3 + i * 2] | (rx_buffer[4 + i * 2] << 8);  // Low byte first
     }
     
-    if (buffer[1] != expected_func) {
-        // Verifica se é uma exceção MODBUS (função | 0x80)
-        if (buffer[1] == (expected_func | 0x80)) {
-            printf("Exceção MODBUS: código=0x%02X\n", buffer[2]);
-            return -1;
-        }
-        printf("Função incorreta: esperado=0x%02X, recebido=0x%02X\n", expected_func, buffer[1]);
+    return 0;
+}
+
+int lpr_read_status(int uart_fd, uint8_t camera_addr, const char *matricula, uint8_t *status) {
+    uint16_t value;
+    
+    // Registrador 0 (Status)
+    if (modbus_read_holding_registers(uart_fd, camera_addr, LPR_STATUS_OFFSET, 1, matricula, &value) != 0) {
         return -1;
     }
     
+    *status = value & 0xFF;
     return 0;
 }
 
-int lpr_trigger_capture(int uart_fd, uint8_t camera_addr, const char *matricula) {
-    uint8_t tx_buffer[32];
-    uint8_t rx_buffer[32];
-    
-    // Prepara dados: Write Single Register (0x06) ou Write Multiple Registers (0x10)
-    // Usando 0x10 para escrever no offset 1 (Trigger)
-    uint8_t data[] = {
-        0x01, 0x00,  // Starting Address (offset 1) - little-endian
-        0x01, 0x00,  // Quantity of Registers (1) - little-endian
-        0x02,        // Byte Count (2 bytes)
-        0x01, 0x00   // Register Value (1 = trigger) - little-endian
-    };
+int lpr_read_data(int uart_fd, uint8_t camera_addr, const char *matricula, lpr_data_t *data) {
+    uint16_t regs[8];
     
-    int tx_len = build_modbus_message(tx_buffer, camera_addr, MODBUS_WRITE_MULTIPLE_REGS, 
-                                      data, sizeof(data), matricula);
+    TRACE_INFO(TRACE_EV_READ_DATA, camera_addr, MODBUS_READ_HOLDING_REGS, 0, 0);
     
-    printf("Enviando trigger para câmera 0x%02X...\n", camera_addr);
-    print_buffer(tx_buffer, tx_len);
+    // Offsets 0 a 7: status + trigger + placa[4] + confiança + erro
+    if (modbus_read_holding_registers(uart_fd, camera_addr, LPR_STATUS_OFFSET, 8, matricula, regs) != 0) {
+        return -1;
+    }
     
-    send_uart(uart_fd, tx_buffer, tx_len);
-    usleep(50000); // 50ms delay
+    data->status = regs[LPR_STATUS_OFFSET];
     
-    int rx_len = receive_uart(uart_fd, rx_buffer, sizeof(rx_buffer));
-    if (rx_len > 0) {
-        print_buffer(rx_buffer, rx_len);
-        return verify_modbus_response(rx_buffer, rx_len, camera_addr, MODBUS_WRITE_MULTIPLE_REGS);
+    // Placa (offset 2-5): 4 registradores, 2 caracteres cada, low byte primeiro
+    for (int i = 0; i < 4; i++) {
+        data->placa[i * 2] = regs[LPR_PLACA_OFFSET + i] & 0xFF;
+        data->placa[i * 2 + 1] = (regs[LPR_PLACA_OFFSET + i] >> 8) & 0xFF;
     }
+    data->placa[8] = '\0';
     
-    printf("Timeout: nenhuma resposta recebida\n");
-    return -1;
+    data->confianca = regs[LPR_CONFIANCA_OFFSET];
+    data->erro = regs[LPR_ERRO_OFFSET];
+    
+    return 0;
 }
 
-int lpr_read_status(int uart_fd, uint8_t camera_addr, const char *matricula, uint8_t *status) {
-    uint8_t tx_buffer[32];
-    uint8_t rx_buffer[32];
+int lpr_reset_trigger(int uart_fd, uint8_t camera_addr, const char *matricula) {
+    modbus_frame_t *frame = current_frame();
     
-    // Read Holding Registers: offset 0, quantidade 1
-    uint8_t data[] = {
-        0x00, 0x00,  // Starting Address (offset 0 = Status) - little-endian  
-        0x01, 0x00   // Quantity of Registers (1) - little-endian
-    };
+    // Write Multiple Registers: escrever 0 no offset 1 (Trigger), little-endian
+    modbus_frame_begin(frame, camera_addr, MODBUS_WRITE_MULTIPLE_REGS);
+    modbus_frame_put_u16(frame, LPR_TRIGGER_OFFSET);  // Starting Address (offset 1)
+    modbus_frame_put_u16(frame, 1);                   // Quantity of Registers (1)
+    modbus_frame_put_u8(frame, 2);                    // Byte Count (2 bytes)
+    modbus_frame_put_u16(frame, 0);                   // Register Value (0 = reset)
     
-    int tx_len = build_modbus_message(tx_buffer, camera_addr, MODBUS_READ_HOLDING_REGS, 
-                                      data, sizeof(data), matricula);
+    return modbus_exchange(uart_fd, frame, matricula, current_rx(), MODBUS_MAX_FRAME, -1) > 0 ? 0 : -1;
+}
+
+// Placares com cópia própria (um por porta, no mesmo endereço ou não)
+#define PLACAR_MAX_SHADOWS 8
+
+/*
+ * Cópia do último conteúdo escrito com sucesso num placar, identificado pela
+ * UART e pelo endereço: escritas para outra porta nunca são comparadas com
+ * esta cópia. O lock da entrada é mantido durante a escrita.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    int uart_fd;  // -1 = entrada livre
+    uint8_t addr;
+    uint16_t shadow[PLACAR_NUM_REGS];
+    int shadow_valid;
+    placar_data_t pending;
+    int has_pending;
+    int64_t last_write_us;
+} placar_shadow_t;
+
+static struct {
+    pthread_mutex_t lock;  // Protege a tabela (não as entradas)
+    placar_shadow_t entries[PLACAR_MAX_SHADOWS];
+    int count;
+    atomic_int min_interval_ms;
+} placar_state = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Entrada de (uart_fd, addr), já com o lock da entrada; com create, criada no
+ * primeiro uso (numa entrada livre ou no fim da tabela). NULL se não existe ou
+ * com a tabela cheia. A entrada é conferida depois do lock: close_uart() pode
+ * tê-la liberado e outra porta, ocupado.
+ */
+static placar_shadow_t *placar_shadow(int uart_fd, uint8_t addr, int create) {
+    for (;;) {
+        placar_shadow_t *entry = NULL;
+        placar_shadow_t *free_entry = NULL;
+
+        pthread_mutex_lock(&placar_state.lock);
+        for (int i = 0; i < placar_state.count; i++) {
+            placar_shadow_t *e = &placar_state.entries[i];
+            if (e->uart_fd == uart_fd && e->addr == addr) {
+                entry = e;
+                break;
+            }
+            if (e->uart_fd < 0 && free_entry == NULL) {
+                free_entry = e;
+            }
+        }
+        if (entry == NULL && create) {
+            if (free_entry == NULL && placar_state.count < PLACAR_MAX_SHADOWS) {
+                free_entry = &placar_state.entries[placar_state.count++];
+                pthread_mutex_init(&free_entry->lock, NULL);
+            }
+            if (free_entry != NULL) {
+                pthread_mutex_lock(&free_entry->lock);
+                free_entry->uart_fd = uart_fd;
+                free_entry->addr = addr;
+                free_entry->shadow_valid = 0;
+                free_entry->has_pending = 0;
+                free_entry->last_write_us = 0;
+                pthread_mutex_unlock(&free_entry->lock);
+                entry = free_entry;
+            }
+        }
+        pthread_mutex_unlock(&placar_state.lock);
+
+        if (entry == NULL) {
+            return NULL;
+        }
+
+        pthread_mutex_lock(&entry->lock);
+        if (entry->uart_fd == uart_fd && entry->addr == addr) {
+            return entry;
+        }
+        pthread_mutex_unlock(&entry->lock);
+    }
+}
+
+// Libera as cópias dos placares de uart_fd (close_uart)
+static void placar_port_closed(int uart_fd) {
+    pthread_mutex_lock(&placar_state.lock);
+    for (int i = 0; i < placar_state.count; i++) {
+        placar_shadow_t *entry = &placar_state.entries[i];
+        pthread_mutex_lock(&entry->lock);
+        if (entry->uart_fd == uart_fd) {
+            entry->uart_fd = -1;
+            entry->shadow_valid = 0;
+            entry->has_pending = 0;
+        }
+        pthread_mutex_unlock(&entry->lock);
+    }
+    pthread_mutex_unlock(&placar_state.lock);
+}
+
+__attribute__((constructor))
+static void placar_register_close_hook(void) {
+    uart_register_close_hook(placar_port_closed);
+}
+
+// Ordem dos campos segue os offsets PLACAR_* do mapa de registradores
+static void placar_to_regs(const placar_data_t *data, uint16_t *regs) {
+    regs[PLACAR_VAGAS_TERREO_PNE] = data->vagas_terreo_pne;
+    regs[PLACAR_VAGAS_TERREO_IDOSO] = data->vagas_terreo_idoso;
+    regs[PLACAR_VAGAS_TERREO_COMUNS] = data->vagas_terreo_comuns;
+    regs[PLACAR_VAGAS_1ANDAR_PNE] = data->vagas_1andar_pne;
+    regs[PLACAR_VAGAS_1ANDAR_IDOSO] = data->vagas_1andar_idoso;
+    regs[PLACAR_VAGAS_1ANDAR_COMUNS] = data->vagas_1andar_comuns;
+    regs[PLACAR_VAGAS_2ANDAR_PNE] = data->vagas_2andar_pne;
+    regs[PLACAR_VAGAS_2ANDAR_IDOSO] = data->vagas_2andar_idoso;
+    regs[PLACAR_VAGAS_2ANDAR_COMUNS] = data->vagas_2andar_comuns;
+    regs[PLACAR_CARROS_TERREO] = data->carros_terreo;
+    regs[PLACAR_CARROS_1ANDAR] = data->carros_1andar;
+    regs[PLACAR_CARROS_2ANDAR] = data->carros_2andar;
+    regs[PLACAR_FLAGS] = data->flags;
+}
+
+// Escreve os registradores [start, start + count) do placar
+static int placar_write_range(int uart_fd, const char *matricula, const uint16_t *regs, int start, int count) {
+    modbus_frame_t *frame = current_frame();
+    
+    // Write Multiple Registers - endereço, quantidade e valores em little-endian
+    modbus_frame_begin(frame, PLACAR_VAGAS_ADDR, MODBUS_WRITE_MULTIPLE_REGS);
+    modbus_frame_put_u16(frame, start);      // Starting Address
+    modbus_frame_put_u16(frame, count);      // Quantity of Registers
+    modbus_frame_put_u8(frame, count * 2);   // Byte Count
+    for (int i = start; i < start + count; i++) {
+        modbus_frame_put_u16(frame, regs[i]);
+    }
     
-    send_uart(uart_fd, tx_buffer, tx_len);
-    usleep(50000); // 50ms delay
+    TRACE_INFO(TRACE_EV_PLACAR, PLACAR_VAGAS_ADDR, MODBUS_WRITE_MULTIPLE_REGS, start, start + count - 1);
     
-    int rx_len = receive_uart(uart_fd, rx_buffer, sizeof(rx_buffer));
-    if (rx_len > 0) {
-        if (verify_modbus_response(rx_buffer, rx_len, camera_addr, MODBUS_READ_HOLDING_REGS) == 0) {
-            // Formato resposta: [addr][func][byte_count][data_lo][data_hi][crc_lo][crc_hi]
-            *status = rx_buffer[3]; // Low byte do registrador (little-endian)
+    return modbus_exchange(uart_fd, frame, matricula, current_rx(), MODBUS_MAX_FRAME, -1) > 0 ? 0 : -1;
+}
+
+/*
+ * Escreve só o trecho contíguo alterado em relação à cópia; chamar com o lock
+ * da entrada. Sem entrada (tabela cheia), escreve tudo.
+ */
+static int placar_write_delta(int uart_fd, const char *matricula, placar_shadow_t *entry,
+                              const placar_data_t *data) {
+    uint16_t regs[PLACAR_NUM_REGS];
+    int first = 0;
+    int last = PLACAR_NUM_REGS - 1;
+    
+    placar_to_regs(data, regs);
+    
+    if (entry != NULL && entry->shadow_valid) {
+        while (first < PLACAR_NUM_REGS && regs[first] == entry->shadow[first]) {
+            first++;
+        }
+        
+        // Nada mudou: nenhuma transação no barramento
+        if (first == PLACAR_NUM_REGS) {
             return 0;
         }
+        
+        while (regs[last] == entry->shadow[last]) {
+            last--;
+        }
     }
     
-    return -1;
+    /*
+     * Um único quadro cobrindo do primeiro ao último registrador alterado:
+     * cada registrador intermediário custa 2 bytes, enquanto um quadro extra
+     * custa cabeçalho, matrícula, CRC, resposta e turnaround.
+     */
+    int count = last - first + 1;
+    if (placar_write_range(uart_fd, matricula, regs, first, count) != 0) {
+        return -1;
+    }
+    
+    if (entry != NULL) {
+        memcpy(&entry->shadow[first], &regs[first], count * sizeof(uint16_t));
+        if (first == 0 && count == PLACAR_NUM_REGS) {
+            entry->shadow_valid = 1;
+        }
+        entry->last_write_us = monotonic_us();
+    }
+    
+    return 0;
 }
 
-int lpr_read_data(int uart_fd, uint8_t camera_addr, const char *matricula, lpr_data_t *data) {
-    uint8_t tx_buffer[32];
-    uint8_t rx_buffer[64];
+int placar_update(int uart_fd, const char *matricula, const placar_data_t *data) {
+    placar_shadow_t *entry = placar_shadow(uart_fd, PLACAR_VAGAS_ADDR, 1);
+    if (entry == NULL) {
+        return placar_write_delta(uart_fd, matricula, NULL, data);
+    }
     
-    // Read Holding Registers: offset 0, quantidade 8 (status + trigger + placa[4] + confiança + erro)
-    uint8_t req_data[] = {
-        0x00, 0x00,  // Starting Address (offset 0) - little-endian
-        0x08, 0x00   // Quantity of Registers (8) - little-endian
-    };
+    int ret = placar_write_delta(uart_fd, matricula, entry, data);
+    if (ret == 0) {
+        entry->has_pending = 0;
+    }
+    pthread_mutex_unlock(&entry->lock);
     
-    int tx_len = build_modbus_message(tx_buffer, camera_addr, MODBUS_READ_HOLDING_REGS, 
-                                      req_data, sizeof(req_data), matricula);
+    return ret;
+}
+
+int placar_update_coalesced(int uart_fd, const char *matricula, const placar_data_t *data) {
+    placar_shadow_t *entry = placar_shadow(uart_fd, PLACAR_VAGAS_ADDR, 1);
+    if (entry == NULL) {
+        return placar_write_delta(uart_fd, matricula, NULL, data);
+    }
     
-    printf("Lendo dados da câmera 0x%02X...\n", camera_addr);
-    print_buffer(tx_buffer, tx_len);
+    entry->pending = *data;
+    entry->has_pending = 1;
+    pthread_mutex_unlock(&entry->lock);
     
-    send_uart(uart_fd, tx_buffer, tx_len);
-    usleep(50000); // 50ms delay
+    return placar_flush(uart_fd, matricula, 0);
+}
+
+// µs até a escrita agrupada pendente vencer (0 = já venceu); chamar com o lock da entrada
+static int64_t placar_pending_wait(const placar_shadow_t *entry) {
+    int64_t due_us = entry->last_write_us + (int64_t)atomic_load(&placar_state.min_interval_ms) * 1000;
+    int64_t wait_us = due_us - monotonic_us();
+    return wait_us > 0 ? wait_us : 0;
+}
+
+int placar_flush(int uart_fd, const char *matricula, int force) {
+    placar_shadow_t *entry = placar_shadow(uart_fd, PLACAR_VAGAS_ADDR, 0);
+    int ret = 0;
     
-    int rx_len = receive_uart(uart_fd, rx_buffer, sizeof(rx_buffer));
-    if (rx_len > 0) {
-        print_buffer(rx_buffer, rx_len);
-        
-        if (verify_modbus_response(rx_buffer, rx_len, camera_addr, MODBUS_READ_HOLDING_REGS) == 0) {
-            // Formato resposta: [addr][func][byte_count][data...][crc_lo][crc_hi]
-            int byte_count = rx_buffer[2];
-            
-            if (byte_count >= 16) { // 8 registradores * 2 bytes
-                // Status (offset 0) - little-endian
-                data->status = rx_buffer[3] | (rx_buffer[4] << 8); // Low byte first
-                
-                // Placa (offset 2-5): 4 registradores, 2 bytes cada = 8 chars
-                for (int i = 0; i < 8; i++) {
-                    data->placa[i] = rx_buffer[7 + i]; // Começa no offset 2 (byte 7)
-                }
-                data->placa[8] = '\0';
-                
-                // Confiança (offset 6) - little-endian
-                data->confianca = rx_buffer[15] | (rx_buffer[16] << 8); // Low byte first
-                
-                // Erro (offset 7) - little-endian
-                data->erro = rx_buffer[17] | (rx_buffer[18] << 8); // Low byte first
-                
-                return 0;
-            }
+    if (entry == NULL) {
+        return 0;
+    }
+    
+    if (entry->has_pending && (force || placar_pending_wait(entry) == 0)) {
+        ret = placar_write_delta(uart_fd, matricula, entry, &entry->pending);
+        if (ret == 0) {
+            entry->has_pending = 0;
         }
     }
     
-    return -1;
+    pthread_mutex_unlock(&entry->lock);
+    return ret;
 }
 
-int lpr_reset_trigger(int uart_fd, uint8_t camera_addr, const char *matricula) {
-    uint8_t tx_buffer[32];
-    uint8_t rx_buffer[32];
-    
-    // Write Multiple Registers: escrever 0 no offset 1 (Trigger)
-    uint8_t data[] = {
-        0x01, 0x00,  // Starting Address (offset 1) - little-endian
-        0x01, 0x00,  // Quantity of Registers (1) - little-endian
-        0x02,        // Byte Count (2 bytes)
-        0x00, 0x00   // Register Value (0 = reset) - little-endian
-    };
-    
-    int tx_len = build_modbus_message(tx_buffer, camera_addr, MODBUS_WRITE_MULTIPLE_REGS, 
-                                      data, sizeof(data), matricula);
+int placar_flush_one(int uart_fd, const char *matricula) {
+    placar_shadow_t *entry = placar_shadow(uart_fd, PLACAR_VAGAS_ADDR, 0);
+    int ret = 0;
     
-    send_uart(uart_fd, tx_buffer, tx_len);
-    usleep(50000); // 50ms delay
+    if (entry == NULL) {
+        return 0;
+    }
     
-    int rx_len = receive_uart(uart_fd, rx_buffer, sizeof(rx_buffer));
-    if (rx_len > 0) {
-        return verify_modbus_response(rx_buffer, rx_len, camera_addr, MODBUS_WRITE_MULTIPLE_REGS);
+    if (entry->has_pending && placar_pending_wait(entry) == 0) {
+        // Uma tentativa só; se falhar, a próxima fica para depois do intervalo
+        retry_t retry;
+        retry_reset(&retry);
+        retry_t *previous = retry_attach(&retry);
+        if (placar_write_delta(uart_fd, matricula, entry, &entry->pending) == 0) {
+            entry->has_pending = 0;
+            ret = 1;
+        } else {
+            entry->last_write_us = monotonic_us();
+        }
+        retry_attach(previous);
     }
     
-    return -1;
+    pthread_mutex_unlock(&entry->lock);
+    return ret;
 }
 
-int placar_update(int uart_fd, const char *matricula, const placar_data_t *data) {
-    uint8_t tx_buffer[64];
-    uint8_t rx_buffer[32];
-    
-    // Write Multiple Registers: escrever 13 registradores (offset 0-12)
-    uint8_t req_data[31]; // 5 bytes cabeçalho + 26 bytes dados
-    req_data[0] = 0x00; // Starting Address Lo
-    req_data[1] = 0x00; // Starting Address Hi (offset 0) - little-endian
-    req_data[2] = 0x0D; // Quantity of Registers Lo
-    req_data[3] = 0x00; // Quantity of Registers Hi (13) - little-endian
-    req_data[4] = 0x1A; // Byte Count (26 bytes = 13 regs * 2)
-    
-    // Preenche os dados dos registradores (little-endian)
-    int idx = 5;
-    req_data[idx++] = data->vagas_terreo_pne & 0xFF;
-    req_data[idx++] = (data->vagas_terreo_pne >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_terreo_idoso & 0xFF;
-    req_data[idx++] = (data->vagas_terreo_idoso >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_terreo_comuns & 0xFF;
-    req_data[idx++] = (data->vagas_terreo_comuns >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_1andar_pne & 0xFF;
-    req_data[idx++] = (data->vagas_1andar_pne >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_1andar_idoso & 0xFF;
-    req_data[idx++] = (data->vagas_1andar_idoso >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_1andar_comuns & 0xFF;
-    req_data[idx++] = (data->vagas_1andar_comuns >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_2andar_pne & 0xFF;
-    req_data[idx++] = (data->vagas_2andar_pne >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_2andar_idoso & 0xFF;
-    req_data[idx++] = (data->vagas_2andar_idoso >> 8) & 0xFF;
-    req_data[idx++] = data->vagas_2andar_comuns & 0xFF;
-    req_data[idx++] = (data->vagas_2andar_comuns >> 8) & 0xFF;
-    req_data[idx++] = data->carros_terreo & 0xFF;
-    req_data[idx++] = (data->carros_terreo >> 8) & 0xFF;
-    req_data[idx++] = data->carros_1andar & 0xFF;
-    req_data[idx++] = (data->carros_1andar >> 8) & 0xFF;
-    req_data[idx++] = data->carros_2andar & 0xFF;
-    req_data[idx++] = (data->carros_2andar >> 8) & 0xFF;
-    req_data[idx++] = data->flags & 0xFF;
-    req_data[idx++] = (data->flags >> 8) & 0xFF;
-    
-    int tx_len = build_modbus_message(tx_buffer, PLACAR_VAGAS_ADDR, MODBUS_WRITE_MULTIPLE_REGS, 
-                                      req_data, sizeof(req_data), matricula);
-    
-    printf("Atualizando placar de vagas...\n");
-    print_buffer(tx_buffer, tx_len);
-    
-    send_uart(uart_fd, tx_buffer, tx_len);
-    usleep(50000);
-    
-    int rx_len = receive_uart(uart_fd, rx_buffer, sizeof(rx_buffer));
-    if (rx_len > 0) {
-        print_buffer(rx_buffer, rx_len);
-        return verify_modbus_response(rx_buffer, rx_len, PLACAR_VAGAS_ADDR, MODBUS_WRITE_MULTIPLE_REGS);
-    }
+int64_t placar_pending_wait_us(int uart_fd) {
+    placar_shadow_t *entry = placar_shadow(uart_fd, PLACAR_VAGAS_ADDR, 0);
+    int64_t wait_us = -1;
     
-    return -1;
+    if (entry == NULL) {
+        return -1;
+    }
+    if (entry->has_pending) {
+        wait_us = placar_pending_wait(entry);
+    }
+    pthread_mutex_unlock(&entry->lock);
+    return wait_us;
+}
+
+void placar_set_min_interval_ms(int interval_ms) {
+    atomic_store(&placar_state.min_interval_ms, interval_ms);
+}
+
+void placar_load_config(void) {
+    placar_set_min_interval_ms(config_get_int("PLACAR_MIN_INTERVAL_MS", 0));
+}
+
+void placar_invalidate_cache(void) {
+    pthread_mutex_lock(&placar_state.lock);
+    int count = placar_state.count;
+    pthread_mutex_unlock(&placar_state.lock);
+    
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&placar_state.entries[i].lock);
+        placar_state.entries[i].shadow_valid = 0;
+        pthread_mutex_unlock(&placar_state.entries[i].lock);
+    }
 }
 
 void print_buffer(const uint8_t *buffer, int len) {
@@ -276,58 +781,33 @@ void print_buffer(const uint8_t *buffer, int len) {
     printf("\n");
 }
 
-int lpr_capture_plate(int uart_fd, uint8_t camera_addr, const char *matricula, 
-                      lpr_data_t *data, int max_retries, int timeout_ms) {
-    int retry = 0;
-    
-    while (retry < max_retries) {
-        printf("\n=== Tentativa %d/%d ===\n", retry + 1, max_retries);
-        
-        // 1. Disparar trigger
-        if (lpr_trigger_capture(uart_fd, camera_addr, matricula) != 0) {
-            printf("Erro ao disparar trigger\n");
-            retry++;
-            usleep(100000 * (1 << retry)); // Backoff exponencial
-            continue;
-        }
-        
-        // 2. Polling do status
-        int poll_count = 0;
-        int max_polls = timeout_ms / 100; // Poll a cada 100ms
-        uint8_t status = LPR_STATUS_PRONTO;
-        
-        while (poll_count < max_polls) {
-            if (lpr_read_status(uart_fd, camera_addr, matricula, &status) == 0) {
-                printf("Status: %d\n", status);
-                
-                if (status == LPR_STATUS_OK) {
-                    // 3. Ler dados completos
-                    if (lpr_read_data(uart_fd, camera_addr, matricula, data) == 0) {
-                        printf("Placa capturada: %s (confiança: %d%%)\n", data->placa, data->confianca);
-                        
-                        // 4. Resetar trigger
-                        lpr_reset_trigger(uart_fd, camera_addr, matricula);
-                        
-                        return 0;
-                    }
-                } else if (status == LPR_STATUS_ERRO) {
-                    printf("Erro na captura\n");
-                    break;
-                }
-            }
-            
-            usleep(100000); // 100ms
-            poll_count++;
-        }
-        
-        retry++;
-        if (retry < max_retries) {
-            int backoff = 100000 * (1 << retry); // Backoff exponencial
-            printf("Aguardando %d ms antes de tentar novamente...\n", backoff / 1000);
-            usleep(backoff);
-        }
+// Captura passando pelo cache de debounce e pela união de pedidos simultâneos
+static int capture_plate_cached(int uart_fd, uint8_t camera_addr, const char *matricula,
+                                lpr_data_t *data, int max_retries, int timeout_ms, int fast_path) {
+    lpr_capture_t cap;
+    int ret;
+    
+    lpr_capture_init(&cap, camera_addr, max_retries, timeout_ms);
+    if (lpr_capture_cache_begin(uart_fd, &cap, data, &ret) != LPR_CACHE_MISS) {
+        return ret;
     }
     
-    printf("Falha após %d tentativas\n", max_retries);
-    return -1;
+    lpr_capture_set_fast_path(&cap, fast_path);
+    ret = lpr_capture_run(uart_fd, matricula, &cap, 1) == 1 ? 0 : -1;
+    lpr_capture_cache_end(uart_fd, camera_addr, ret, &cap.data);
+    
+    if (ret == 0) {
+        *data = cap.data;
+    }
+    return ret;
+}
+
+int lpr_capture_plate(int uart_fd, uint8_t camera_addr, const char *matricula, 
+                      lpr_data_t *data, int max_retries, int timeout_ms) {
+    return capture_plate_cached(uart_fd, camera_addr, matricula, data, max_retries, timeout_ms, 0);
+}
+
+int lpr_capture_plate_fast(int uart_fd, uint8_t camera_addr, const char *matricula,
+                           lpr_data_t *data, int max_retries, int timeout_ms) {
+    return capture_plate_cached(uart_fd, camera_addr, matricula, data, max_retries, timeout_ms, 1);
 }
@@ -10,7 +10,15 @@
 
 // Códigos de função MODBUS
 #define MODBUS_READ_HOLDING_REGS   0x03
+#define MODBUS_WRITE_SINGLE_REG    0x06
 #define MODBUS_WRITE_MULTIPLE_REGS 0x10
+#define MODBUS_READ_WRITE_REGS     0x17
+
+// Tamanho máximo de um quadro RTU
+#define MODBUS_MAX_FRAME 256
+
+// Máximo de registradores numa leitura 0x03 (limite do protocolo)
+#define MODBUS_READ_MAX_REGS 125
 
 // Offsets dos registradores - Câmeras LPR
 #define LPR_STATUS_OFFSET      0
@@ -39,6 +47,20 @@
 #define PLACAR_CARROS_1ANDAR         10
 #define PLACAR_CARROS_2ANDAR         11
 #define PLACAR_FLAGS                 12
+#define PLACAR_NUM_REGS              13
+
+// Resultado da última transação da thread (modbus_last_error)
+typedef enum {
+    MODBUS_OK = 0,
+    MODBUS_ERR_TIMEOUT,    // Nenhuma resposta
+    MODBUS_ERR_CRC,        // Resposta corrompida
+    MODBUS_ERR_FRAME,      // Resposta curta, de outro escravo ou fora do formato
+    MODBUS_ERR_BUSY,       // Exceção 0x05/0x06: escravo ocupado
+    MODBUS_ERR_EXCEPTION,  // Demais exceções (função, endereço, valor, falha do escravo)
+    MODBUS_ERR_IO,         // Falha ao escrever na UART
+    MODBUS_ERR_DEADLINE,   // Prazo esgotado antes de obter resposta válida
+    MODBUS_ERR_COUNT
+} modbus_error_t;
 
 // Estrutura para dados da câmera LPR
 typedef struct {
@@ -65,6 +87,100 @@ typedef struct {
     uint16_t flags;
 } placar_data_t;
 
+// Perfil de tempo de resposta de um dispositivo
+typedef struct {
+    int turnaround_us;        // Espera após o tcdrain() antes de começar a ler
+    int response_timeout_ms;  // Tempo máximo até o primeiro byte da resposta
+    int frame_gap_us;         // Silêncio de fim de quadro (0 = t3.5 pelo baudrate)
+    int response_trailer;     // Bytes próprios do dispositivo entre a resposta e o CRC
+} modbus_timing_t;
+
+/**
+ * @brief Define o perfil de tempo de um dispositivo
+ * @param addr Endereço do dispositivo
+ * @param timing Perfil a usar (NULL volta ao perfil padrão)
+ */
+void modbus_set_device_timing(uint8_t addr, const modbus_timing_t *timing);
+
+/**
+ * @brief Lê o perfil de tempo em uso por um dispositivo
+ * @param addr Endereço do dispositivo
+ * @param timing Ponteiro para armazenar o perfil
+ */
+void modbus_get_device_timing(uint8_t addr, modbus_timing_t *timing);
+
+/**
+ * @brief Define o perfil de tempo padrão (dispositivos sem perfil próprio)
+ * @param timing Perfil padrão
+ */
+void modbus_set_default_timing(const modbus_timing_t *timing);
+
+/**
+ * @brief Carrega os perfis de tempo da configuração (ver config_load)
+ *
+ * Chaves globais: MODBUS_TIMEOUT_MS, MODBUS_TURNAROUND_US, MODBUS_FRAME_GAP_US,
+ * MODBUS_RESPONSE_TRAILER. Por dispositivo: MODBUS_0x11_TIMEOUT_MS,
+ * MODBUS_0x11_TURNAROUND_US, MODBUS_0x11_FRAME_GAP_US,
+ * MODBUS_0x11_RESPONSE_TRAILER (endereço em hexadecimal maiúsculo).
+ *
+ * @return Número de dispositivos com perfil próprio
+ */
+int modbus_load_timing_config(void);
+
+/**
+ * @brief Classificação do erro da última transação desta thread
+ *
+ * As funções da biblioteca retornam -1 em qualquer erro; esta função diz
+ * qual foi (ex: exceção do escravo versus timeout).
+ */
+modbus_error_t modbus_last_error(void);
+
+/**
+ * @brief Nome legível de um erro
+ */
+const char *modbus_error_name(modbus_error_t err);
+
+/**
+ * @brief Valida uma resposta (tamanho, CRC, endereço, função e exceção)
+ *
+ * Erros são registrados no trace e nas métricas do dispositivo.
+ *
+ * @param buffer Resposta completa (com endereço e CRC)
+ * @param len Tamanho da resposta
+ * @param addr Endereço esperado
+ * @param func Código de função esperado
+ * @return MODBUS_OK ou a classificação do erro
+ */
+modbus_error_t modbus_verify_response(const uint8_t *buffer, int len, uint8_t addr, uint8_t func);
+
+/**
+ * @brief Executa uma requisição MODBUS genérica (com matrícula e CRC)
+ * @param uart_fd File descriptor da UART
+ * @param addr Endereço do dispositivo
+ * @param func Código de função
+ * @param data Dados da requisição (após o código de função)
+ * @param data_len Tamanho dos dados
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param rx_buffer Buffer para a resposta completa (com endereço e CRC)
+ * @param rx_max Tamanho do buffer de resposta
+ * @return Tamanho da resposta validada ou -1 em caso de erro
+ */
+int modbus_request(int uart_fd, uint8_t addr, uint8_t func, const uint8_t *data, int data_len,
+                   const char *matricula, uint8_t *rx_buffer, int rx_max);
+
+/**
+ * @brief Lê holding registers (0x03) e decodifica os valores (little-endian)
+ * @param uart_fd File descriptor da UART
+ * @param addr Endereço do dispositivo
+ * @param start Primeiro registrador
+ * @param count Quantidade de registradores (1 a MODBUS_READ_MAX_REGS)
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param values Vetor para os count valores lidos
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int modbus_read_holding_registers(int uart_fd, uint8_t addr, uint16_t start, uint16_t count,
+                                  const char *matricula, uint16_t *values);
+
 /**
  * @brief Dispara a captura de placa na câmera LPR
  * @param uart_fd File descriptor da UART
@@ -105,6 +221,12 @@ int lpr_reset_trigger(int uart_fd, uint8_t camera_addr, const char *matricula);
 
 /**
  * @brief Atualiza os dados do placar de vagas
+ *
+ * A biblioteca guarda uma cópia do último conteúdo escrito com sucesso em
+ * cada placar, identificado pela UART e pelo endereço, e envia apenas o
+ * trecho contíguo de registradores que mudou. Sem mudanças, nenhuma
+ * transação é feita.
+ *
  * @param uart_fd File descriptor da UART
  * @param matricula Últimos 4 dígitos da matrícula
  * @param data Ponteiro para estrutura placar_data_t com os dados a escrever
@@ -112,6 +234,65 @@ int lpr_reset_trigger(int uart_fd, uint8_t camera_addr, const char *matricula);
  */
 int placar_update(int uart_fd, const char *matricula, const placar_data_t *data);
 
+/**
+ * @brief Atualiza o placar agrupando atualizações rápidas
+ *
+ * Se a última escrita foi há menos que o intervalo mínimo, os dados ficam
+ * pendentes e só o conteúdo mais recente é escrito quando o intervalo vence:
+ * pela thread ociosa do modbus_bus (e do modbus_manager) ou, sem ela, em
+ * placar_flush().
+ *
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param data Ponteiro para estrutura placar_data_t com os dados a escrever
+ * @return 0 em caso de sucesso (escrito ou adiado), -1 em caso de erro
+ */
+int placar_update_coalesced(int uart_fd, const char *matricula, const placar_data_t *data);
+
+/**
+ * @brief Escreve a atualização pendente do placar, se houver
+ * @param uart_fd File descriptor da UART
+ * @param matricula Últimos 4 dígitos da matrícula
+ * @param force 1 para escrever mesmo antes do intervalo mínimo
+ * @return 0 em caso de sucesso ou nada pendente, -1 em caso de erro
+ */
+int placar_flush(int uart_fd, const char *matricula, int force);
+
+/**
+ * @brief Escreve a atualização pendente se o intervalo já venceu (para laços ociosos)
+ *
+ * Faz uma única tentativa, sem backoff; se falhar, a próxima fica para
+ * depois de mais um intervalo.
+ *
+ * @return 1 se escreveu, 0 se não havia pendente vencida ou se falhou
+ */
+int placar_flush_one(int uart_fd, const char *matricula);
+
+/**
+ * @brief Tempo até a atualização pendente do placar vencer
+ * @return µs (0 = já venceu) ou -1 sem atualização pendente
+ */
+int64_t placar_pending_wait_us(int uart_fd);
+
+/**
+ * @brief Define o intervalo mínimo entre escritas agrupadas do placar
+ * @param interval_ms Intervalo em milissegundos (0 = sem agrupamento)
+ */
+void placar_set_min_interval_ms(int interval_ms);
+
+/**
+ * @brief Carrega PLACAR_MIN_INTERVAL_MS da configuração (ver config_load)
+ */
+void placar_load_config(void);
+
+/**
+ * @brief Descarta as cópias locais de todos os placares: a próxima
+ *        atualização reescreve tudo (ex: após reinício do placar)
+ *
+ * As cópias de uma porta são descartadas sozinhas em close_uart().
+ */
+void placar_invalidate_cache(void);
+
 /**
  * @brief Função auxiliar para imprimir buffer (debug)
  * @param buffer Buffer a imprimir
@@ -132,4 +313,16 @@ void print_buffer(const uint8_t *buffer, int len);
 int lpr_capture_plate(int uart_fd, uint8_t camera_addr, const char *matricula, 
                       lpr_data_t *data, int max_retries, int timeout_ms);
 
+/**
+ * @brief Captura no modo rápido: retorna assim que a placa é lida
+ *
+ * O polling lê os 8 registradores da câmera, então a resposta com status OK
+ * já traz a placa. O reset do trigger é adiado (ver lpr_capture_flush_resets
+ * em lpr_capture.h): a cancela pode abrir sem esperar por ele.
+ *
+ * Parâmetros e retorno iguais aos de lpr_capture_plate().
+ */
+int lpr_capture_plate_fast(int uart_fd, uint8_t camera_addr, const char *matricula,
+                           lpr_data_t *data, int max_retries, int timeout_ms);
+
 #endif
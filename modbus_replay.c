@@ -0,0 +1,592 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bus_capture.h"
+#include "modbus_parking.h"
+#include "modbus_rx.h"
+#include "crc16.h"
+#include "config.h"
+#include "uart.h"
+
+/*
+ * Reprodução de uma gravação do barramento (bus_capture.h). Cada requisição
+ * gravada e os bytes recebidos depois dela (eco, ruído e respostas atrasadas
+ * incluídos) formam uma troca. Uso típico:
+ *
+ *   ./modbus_replay portao.cap            reenvia as requisições e valida as respostas gravadas
+ *   ./modbus_replay -x 10 portao.cap      o mesmo, dez vezes mais rápido
+ *   ./modbus_replay -c 0x11 portao.cap    captura de placa contra as respostas gravadas
+ *   ./modbus_replay -l /tmp/ttyREPLAY portao.cap   só o escravo: outro programa faz as requisições
+ *   ./modbus_replay -b portao.cap         benchmark do validador sobre o tráfego gravado
+ *   ./modbus_replay -d portao.cap         lista os registros
+ *
+ * Nos modos com PTY o escravo responde a cada requisição recebida com os
+ * bytes da próxima troca, nos mesmos intervalos da gravação (divididos pela
+ * velocidade), contados a partir da chegada da requisição.
+ */
+
+// Bytes recebidos numa leitura, relativos ao envio da requisição da troca
+typedef struct {
+    uint64_t offset_ns;
+    const uint8_t *data;
+    int len;
+} chunk_t;
+
+typedef struct {
+    uint64_t tx_ns;  // Instante do envio na gravação
+    uint8_t tx[MODBUS_MAX_FRAME];
+    int tx_len;
+    int first_chunk;
+    int chunk_count;
+} exchange_t;
+
+typedef struct {
+    exchange_t *exchanges;
+    int count;
+    chunk_t *chunks;
+    int chunk_count;
+    uint32_t baudrate;
+} replay_t;
+
+// Escravo no lado mestre do PTY
+typedef struct {
+    const replay_t *rp;
+    int master_fd;
+    double speed;  // 0 = sem esperas
+    int verbose;
+    atomic_int stop;
+    atomic_int done;  // Todas as trocas servidas
+    int served;
+    int diverged;     // Requisições diferentes da gravada
+    uint8_t req[MODBUS_MAX_FRAME];
+    int req_len;
+    int64_t req_at_ns;
+} server_t;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void sleep_until_ns(int64_t at_ns) {
+    int64_t wait = at_ns - now_ns();
+    if (wait > 0) {
+        struct timespec ts = { .tv_sec = wait / 1000000000ll, .tv_nsec = wait % 1000000000ll };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int64_t scaled_ns(uint64_t ns, double speed) {
+    return speed > 0 ? (int64_t)(ns / speed) : 0;
+}
+
+static void print_bytes(const uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        printf(" %02X", data[i]);
+    }
+    printf("\n");
+}
+
+/*
+ * Agrupa os registros de uma porta em trocas. Envios seguidos que ainda não
+ * fecham um CRC (escrita parcial do mestre assíncrono) formam uma requisição
+ * só; bytes recebidos antes da primeira requisição são ignorados.
+ */
+static int replay_load(replay_t *rp, bus_capture_reader_t *reader, int port) {
+    bus_capture_record_t rec;
+    const uint8_t *data;
+    int max_exchanges = 0;
+    int max_chunks = 0;
+
+    memset(rp, 0, sizeof(*rp));
+    while (bus_capture_reader_next(reader, &rec, &data)) {
+        if (port < 0 && rec.dir == BUS_CAPTURE_TX) {
+            port = rec.port;
+        }
+        max_exchanges += rec.dir == BUS_CAPTURE_TX;
+        max_chunks += rec.dir == BUS_CAPTURE_RX;
+    }
+    bus_capture_reader_rewind(reader);
+
+    rp->exchanges = calloc(max_exchanges > 0 ? max_exchanges : 1, sizeof(exchange_t));
+    rp->chunks = calloc(max_chunks > 0 ? max_chunks : 1, sizeof(chunk_t));
+    if (rp->exchanges == NULL || rp->chunks == NULL) {
+        return -1;
+    }
+
+    exchange_t *ex = NULL;
+    while (bus_capture_reader_next(reader, &rec, &data)) {
+        if (rec.port != port) {
+            continue;
+        }
+        if (rec.baudrate != 0 && rp->baudrate == 0) {
+            rp->baudrate = rec.baudrate;
+        }
+
+        if (rec.dir == BUS_CAPTURE_TX) {
+            int partial = ex != NULL && ex->chunk_count == 0 && crc16_modbus(ex->tx, ex->tx_len) != 0;
+            if (!partial) {
+                ex = &rp->exchanges[rp->count++];
+                ex->tx_ns = rec.timestamp_ns;
+                ex->first_chunk = rp->chunk_count;
+            }
+            int len = rec.len;
+            if (ex->tx_len + len > MODBUS_MAX_FRAME) {
+                len = MODBUS_MAX_FRAME - ex->tx_len;
+            }
+            memcpy(ex->tx + ex->tx_len, data, len);
+            ex->tx_len += len;
+        } else if (rec.dir == BUS_CAPTURE_RX && ex != NULL) {
+            chunk_t *chunk = &rp->chunks[rp->chunk_count++];
+            chunk->offset_ns = rec.timestamp_ns - ex->tx_ns;
+            chunk->data = data;
+            chunk->len = rec.len;
+            ex->chunk_count++;
+        }
+    }
+
+    return port;
+}
+
+static void replay_free(replay_t *rp) {
+    free(rp->exchanges);
+    free(rp->chunks);
+}
+
+// Lê o que chegou do mestre; marca o início de cada requisição
+static int server_read(server_t *sv, int timeout_ms) {
+    struct pollfd pfd = { .fd = sv->master_fd, .events = POLLIN };
+
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0 || !(pfd.revents & POLLIN)) {
+        return ready < 0 ? -1 : 0;
+    }
+
+    if (sv->req_len == MODBUS_MAX_FRAME) {
+        sv->req_len = 0;  // Lixo sem CRC válido: recomeça
+    }
+    int n = read(sv->master_fd, sv->req + sv->req_len, MODBUS_MAX_FRAME - sv->req_len);
+    if (n <= 0) {
+        return n < 0 ? -1 : 0;
+    }
+    if (sv->req_len == 0) {
+        sv->req_at_ns = now_ns();
+    }
+    sv->req_len += n;
+    return n;
+}
+
+static int server_request_ready(const server_t *sv) {
+    return sv->req_len >= 4 && crc16_modbus(sv->req, sv->req_len) == 0;
+}
+
+static void *server_main(void *arg) {
+    server_t *sv = arg;
+    const replay_t *rp = sv->rp;
+
+    for (int i = 0; i < rp->count && !atomic_load(&sv->stop); i++) {
+        const exchange_t *ex = &rp->exchanges[i];
+
+        while (!server_request_ready(sv)) {
+            if (atomic_load(&sv->stop) || server_read(sv, 100) < 0) {
+                return NULL;
+            }
+        }
+
+        if (sv->req_len != ex->tx_len || memcmp(sv->req, ex->tx, ex->tx_len) != 0) {
+            sv->diverged++;
+            if (sv->verbose) {
+                printf("  troca %d: requisição diferente da gravada\n    gravada:", i);
+                print_bytes(ex->tx, ex->tx_len);
+                printf("    recebida:");
+                print_bytes(sv->req, sv->req_len);
+            }
+        }
+        int64_t base_ns = sv->req_at_ns;
+        sv->req_len = 0;
+
+        for (int c = 0; c < ex->chunk_count; c++) {
+            const chunk_t *chunk = &rp->chunks[ex->first_chunk + c];
+            int64_t due_ns = base_ns + scaled_ns(chunk->offset_ns, sv->speed);
+
+            // Enquanto espera, a próxima requisição pode chegar (resposta atrasada desta troca)
+            for (int64_t left = due_ns - now_ns(); left > 0; left = due_ns - now_ns()) {
+                if (server_read(sv, (int)((left + 999999) / 1000000)) < 0) {
+                    return NULL;
+                }
+            }
+            if (write(sv->master_fd, chunk->data, chunk->len) != chunk->len) {
+                perror("Erro ao escrever no pseudo-terminal");
+                return NULL;
+            }
+        }
+        sv->served++;
+    }
+
+    atomic_store(&sv->done, 1);
+    return NULL;
+}
+
+static int open_pty(int *master_fd, char *slave_path, size_t size) {
+    struct termios tty;
+
+    *master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (*master_fd < 0) {
+        perror("Erro ao abrir o pseudo-terminal");
+        return -1;
+    }
+    if (grantpt(*master_fd) != 0 || unlockpt(*master_fd) != 0 ||
+        ptsname_r(*master_fd, slave_path, size) != 0) {
+        perror("Erro ao preparar o pseudo-terminal");
+        close(*master_fd);
+        return -1;
+    }
+
+    tcgetattr(*master_fd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(*master_fd, TCSANOW, &tty);
+    return 0;
+}
+
+// Resultado de uma troca, como em modbus_exchange()
+static modbus_error_t classify(modbus_rx_t *rx, int rx_len) {
+    if (rx_len < 0) {
+        return MODBUS_ERR_IO;
+    }
+    if (rx_len == 0) {
+        return MODBUS_ERR_TIMEOUT;
+    }
+    return modbus_rx_result(rx);
+}
+
+static void print_results(const char *title, const int *results, int total) {
+    printf("%s: %d trocas\n", title, total);
+    for (int e = 0; e < MODBUS_ERR_COUNT; e++) {
+        if (results[e] > 0) {
+            printf("  %-24s %d\n", modbus_error_name((modbus_error_t)e), results[e]);
+        }
+    }
+}
+
+/*
+ * Reenvia cada requisição gravada no mesmo instante relativo e valida a
+ * resposta com receive_uart_frame(), como a biblioteca faz a cada tentativa.
+ */
+static int run_transactions(const replay_t *rp, int uart_fd, double speed, int timeout_ms, int verbose) {
+    int results[MODBUS_ERR_COUNT] = { 0 };
+    uint8_t rx_buffer[MODBUS_MAX_FRAME];
+    int64_t start_ns = now_ns();
+
+    for (int i = 0; i < rp->count; i++) {
+        const exchange_t *ex = &rp->exchanges[i];
+        modbus_timing_t timing;
+        modbus_rx_t rx;
+
+        sleep_until_ns(start_ns + scaled_ns(ex->tx_ns - rp->exchanges[0].tx_ns, speed));
+
+        modbus_get_device_timing(ex->tx[0], &timing);
+        if (timeout_ms > 0) {
+            timing.response_timeout_ms = timeout_ms;
+        }
+
+        modbus_rx_init(&rx, rx_buffer, sizeof(rx_buffer), ex->tx[0], ex->tx[1]);
+        modbus_rx_set_request(&rx, ex->tx, ex->tx_len);
+        modbus_rx_set_trailer(&rx, timing.response_trailer);
+
+        int stale = uart_discard_input(uart_fd);
+        if (stale > 0) {
+            rx.skipped += stale;
+        }
+
+        int64_t sent_ns = now_ns();
+        send_uart(uart_fd, ex->tx, ex->tx_len);
+        int rx_len = receive_uart_frame(uart_fd, &rx, timing.response_timeout_ms, timing.frame_gap_us);
+        int64_t elapsed_us = (now_ns() - sent_ns) / 1000;
+
+        modbus_error_t err = classify(&rx, rx_len);
+        results[err]++;
+
+        if (verbose) {
+            printf("%4d %10.3f ms  0x%02X/0x%02X  %-20s %6lld µs  descartados %d, eco %d\n", i,
+                   (ex->tx_ns - rp->exchanges[0].tx_ns) / 1e6, ex->tx[0], ex->tx[1],
+                   modbus_error_name(err), (long long)elapsed_us, rx.skipped, rx.echo);
+        }
+    }
+
+    print_results("Reprodução", results, rp->count);
+    printf("  duração: %.1f ms\n", (now_ns() - start_ns) / 1e6);
+    return 0;
+}
+
+/*
+ * Passa os bytes gravados pelo validador em memória, simulando o silêncio de
+ * fim de quadro pelos intervalos gravados, e mede o tempo de processamento.
+ */
+static void validate_exchange(const replay_t *rp, const exchange_t *ex, uint64_t t35_ns, int *results) {
+    uint8_t rx_buffer[MODBUS_MAX_FRAME];
+    modbus_rx_t rx;
+    uint64_t last_ns = 0;
+    modbus_error_t err = MODBUS_ERR_TIMEOUT;
+
+    modbus_rx_init(&rx, rx_buffer, sizeof(rx_buffer), ex->tx[0], ex->tx[1]);
+    modbus_rx_set_request(&rx, ex->tx, ex->tx_len);
+
+    for (int c = 0; c < ex->chunk_count; c++) {
+        const chunk_t *chunk = &rp->chunks[ex->first_chunk + c];
+
+        if (rx.avail > 0 && chunk->offset_ns - last_ns > t35_ns &&
+            modbus_rx_finish(&rx) == MODBUS_RX_MORE) {
+            modbus_rx_discard(&rx);
+        }
+        if (modbus_rx_done(&rx)) {
+            break;
+        }
+
+        int len = chunk->len;
+        if (len > rx.max - rx.avail) {
+            len = rx.max - rx.avail;
+        }
+        memcpy(rx.buf + rx.avail, chunk->data, len);
+        modbus_rx_push(&rx, len);
+        last_ns = chunk->offset_ns;
+        if (modbus_rx_done(&rx)) {
+            break;
+        }
+    }
+
+    modbus_rx_finish(&rx);
+    if (rx.avail > 0 || modbus_rx_done(&rx)) {
+        err = modbus_rx_result(&rx);
+    }
+    if (results != NULL) {
+        results[err]++;
+    }
+}
+
+static int run_benchmark(const replay_t *rp) {
+    int results[MODBUS_ERR_COUNT] = { 0 };
+    uint64_t bytes = 0;
+    int baudrate = rp->baudrate > 0 ? (int)rp->baudrate : 9600;
+    uint64_t t35_ns = (uint64_t)uart_frame_gap_us(baudrate) * 1000;
+
+    if (rp->count == 0) {
+        printf("Gravação sem requisições\n");
+        return 1;
+    }
+
+    // Sem trace nem métricas das falhas repetidas a cada passada
+    for (int i = 0; i < rp->count; i++) {
+        validate_exchange(rp, &rp->exchanges[i], t35_ns, results);
+    }
+    for (int c = 0; c < rp->chunk_count; c++) {
+        bytes += rp->chunks[c].len;
+    }
+
+    int passes = 0;
+    int64_t start_ns = now_ns();
+    int64_t elapsed_ns;
+    do {
+        for (int i = 0; i < rp->count; i++) {
+            validate_exchange(rp, &rp->exchanges[i], t35_ns, NULL);
+        }
+        passes++;
+        elapsed_ns = now_ns() - start_ns;
+    } while (elapsed_ns < 500000000ll);
+
+    print_results("Validação", results, rp->count);
+    printf("  %.1f ns por troca, %.1f MB/s (%d passadas, %llu bytes recebidos por passada)\n",
+           (double)elapsed_ns / ((double)passes * rp->count),
+           (double)bytes * passes / (elapsed_ns / 1e9) / 1e6, passes, (unsigned long long)bytes);
+    return 0;
+}
+
+static void dump_records(bus_capture_reader_t *reader) {
+    bus_capture_record_t rec;
+    const uint8_t *data;
+    time_t start = (time_t)(reader->header.start_realtime_ns / 1000000000ll);
+    char when[64];
+
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("Gravação iniciada em %s\n", when);
+
+    while (bus_capture_reader_next(reader, &rec, &data)) {
+        printf("[%12.6f] fd %d %6u bps %s (%u bytes):", rec.timestamp_ns / 1e9, rec.port, rec.baudrate,
+               rec.dir == BUS_CAPTURE_TX ? "TX" : "RX", rec.len);
+        print_bytes(data, rec.len);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s [opções] ARQUIVO\n"
+            "  -x FATOR     velocidade da reprodução (padrão 1; 0 = sem esperas)\n"
+            "  -P FD        fd da porta gravada a reproduzir (padrão: o da primeira requisição)\n"
+            "  -t MS        timeout da resposta (padrão: perfil de tempo do .env)\n"
+            "  -c ADDR      roda a captura de placa da câmera ADDR contra a gravação\n"
+            "  -l CAMINHO   só o escravo: cria um link para o PTY e responde a outro programa\n"
+            "  -b           benchmark do validador sobre o tráfego gravado (sem PTY)\n"
+            "  -d           lista os registros da gravação\n"
+            "  -v           detalha cada troca\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *link_path = NULL;
+    double speed = 1.0;
+    int port = -1;
+    int timeout_ms = 0;
+    int camera = -1;
+    int bench = 0;
+    int dump = 0;
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:P:t:c:l:bdvh")) != -1) {
+        switch (opt) {
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'P':
+                port = atoi(optarg);
+                break;
+            case 't':
+                timeout_ms = atoi(optarg);
+                break;
+            case 'c':
+                camera = (int)strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                link_path = optarg;
+                break;
+            case 'b':
+                bench = 1;
+                break;
+            case 'd':
+                dump = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bus_capture_reader_t reader;
+    if (bus_capture_reader_open(&reader, argv[optind]) != 0) {
+        return 1;
+    }
+    if (dump) {
+        dump_records(&reader);
+        bus_capture_reader_close(&reader);
+        return 0;
+    }
+
+    replay_t rp;
+    port = replay_load(&rp, &reader, port);
+    if (port < 0 || rp.count == 0) {
+        if (port >= 0) {
+            fprintf(stderr, "Nenhuma requisição gravada no fd %d\n", port);
+        } else {
+            fprintf(stderr, "Nenhuma requisição gravada\n");
+        }
+        bus_capture_reader_close(&reader);
+        return 1;
+    }
+    printf("%d trocas do fd %d (%u bps), %.1f s gravados\n", rp.count, port, rp.baudrate,
+           (rp.exchanges[rp.count - 1].tx_ns - rp.exchanges[0].tx_ns) / 1e9);
+
+    if (config_load(".env") >= 0) {
+        modbus_load_timing_config();
+    }
+
+    if (bench) {
+        int ret = run_benchmark(&rp);
+        replay_free(&rp);
+        bus_capture_reader_close(&reader);
+        return ret;
+    }
+
+    server_t sv = { .rp = &rp, .speed = speed, .verbose = verbose };
+    char slave_path[128];
+    if (open_pty(&sv.master_fd, slave_path, sizeof(slave_path)) != 0) {
+        return 1;
+    }
+
+    uart_config_t uart_config;
+    uart_config_default(&uart_config);
+    if (rp.baudrate > 0) {
+        uart_config.baudrate = (int)rp.baudrate;
+    }
+
+    // Mantém o lado escravo aberto: sem ele o PTY fecha entre duas aberturas
+    int uart_fd = open_uart_config(slave_path, &uart_config);
+    if (uart_fd < 0) {
+        close(sv.master_fd);
+        return 1;
+    }
+
+    pthread_t server;
+    pthread_create(&server, NULL, server_main, &sv);
+
+    int ret = 0;
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(slave_path, link_path) != 0) {
+            perror("Erro ao criar o link simbólico");
+            ret = 1;
+        } else {
+            printf("Escravo gravado em %s -> %s\n", slave_path, link_path);
+            fflush(stdout);
+            while (!atomic_load(&sv.done)) {
+                usleep(100000);
+            }
+            unlink(link_path);
+        }
+    } else if (camera >= 0) {
+        // Matrícula do trailer da primeira requisição: [... matrícula(4)][crc(2)]
+        const exchange_t *first = &rp.exchanges[0];
+        char matricula[5] = "0000";
+        if (first->tx_len >= 8) {
+            memcpy(matricula, first->tx + first->tx_len - 6, 4);
+        }
+
+        int64_t start_ns = now_ns();
+        for (int n = 1; !atomic_load(&sv.done); n++) {
+            lpr_data_t data;
+            if (lpr_capture_plate(uart_fd, (uint8_t)camera, matricula, &data, 3, 2000) == 0) {
+                printf("Captura %d: %.8s (confiança %d%%)\n", n, data.placa, data.confianca);
+            } else {
+                printf("Captura %d: falha (%s)\n", n, modbus_error_name(modbus_last_error()));
+            }
+        }
+        printf("Reprodução da captura: %.1f ms\n", (now_ns() - start_ns) / 1e6);
+    } else {
+        ret = run_transactions(&rp, uart_fd, speed, timeout_ms, verbose);
+    }
+
+    atomic_store(&sv.stop, 1);
+    pthread_join(server, NULL);
+    printf("Escravo: %d de %d trocas servidas, %d requisições diferentes da gravação\n",
+           sv.served, rp.count, sv.diverged);
+
+    close_uart(uart_fd);
+    close(sv.master_fd);
+    replay_free(&rp);
+    bus_capture_reader_close(&reader);
+    return ret;
+}
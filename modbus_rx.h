@@ -0,0 +1,298 @@
+#ifndef MODBUS_RX_H
+#define MODBUS_RX_H
+
+#include <stdint.h>
+#include <string.h>
+#include "crc16.h"
+#include "modbus_parking.h"
+
+/*
+ * Validação incremental da resposta RTU, byte a byte, à medida que chega:
+ * o CRC é acumulado a cada byte, endereço e função são conferidos nos dois
+ * primeiros bytes e o tamanho do quadro sai do cabeçalho. Um quadro de outro
+ * escravo ou com função inesperada é rejeitado logo no início, e um quadro
+ * correto é reconhecido exatamente no byte que fecha o CRC (resíduo zero),
+ * sem esperar o silêncio de fim de quadro nem percorrer o buffer de novo.
+ *
+ * Com a requisição informada (modbus_rx_set_request), a recepção procura o
+ * quadro dentro do fluxo em vez de exigir que ele comece no primeiro byte: o
+ * eco local do quadro enviado (adaptadores RS485 sem cancelamento de eco) é
+ * removido, e ruído ou respostas atrasadas de outra requisição são descartados
+ * até o próximo byte com o endereço esperado. A resposta também precisa
+ * corresponder à requisição (byte count da 0x03, endereço e valor/quantidade
+ * ecoados na 0x06/0x10), então uma resposta atrasada da mesma função para
+ * outros registradores não é confundida com a atual.
+ */
+
+typedef enum {
+    MODBUS_RX_MORE = 0,   // Quadro incompleto
+    MODBUS_RX_OK,         // Completo, com CRC válido
+    MODBUS_RX_EXCEPTION,  // Exceção completa e válida (código em buf[2])
+    MODBUS_RX_BAD_ADDR,   // Primeiro byte não é o escravo esperado
+    MODBUS_RX_BAD_FUNC,   // Segundo byte não é a função nem a exceção dela
+    MODBUS_RX_BAD_CRC,    // Tamanho completo, mas o CRC não fecha
+    MODBUS_RX_OVERFLOW,   // Tamanho anunciado não cabe no buffer
+    MODBUS_RX_MISMATCH    // Quadro válido de outra requisição
+} modbus_rx_status_t;
+
+typedef struct {
+    uint8_t *buf;
+    int max;
+    int avail;     // Bytes no buffer
+    int len;       // Bytes já validados do quadro em buf[0]
+    uint8_t addr;  // Escravo esperado
+    uint8_t func;  // Função esperada
+    uint16_t crc;  // CRC dos len primeiros bytes
+    int expected;  // Tamanho total pelo cabeçalho (0 = ainda desconhecido, -1 = imprevisível)
+    int trailer;   // Bytes do dispositivo antes do CRC (modbus_timing_t.response_trailer)
+    modbus_rx_status_t status;
+
+    const uint8_t *req;  // Requisição enviada (NULL = quadro deve começar em buf[0])
+    int req_len;
+    int echo_checked;    // Início do fluxo já comparado com a requisição
+    int echo;            // Bytes de eco local removidos
+    int skipped;         // Bytes descartados (ruído, respostas atrasadas)
+} modbus_rx_t;
+
+/**
+ * @brief Prepara a recepção da resposta a uma requisição
+ * @param rx Estado
+ * @param buf Buffer onde os bytes são lidos
+ * @param max Tamanho do buffer
+ * @param addr Endereço da requisição
+ * @param func Código de função da requisição
+ */
+static inline void modbus_rx_init(modbus_rx_t *rx, uint8_t *buf, int max, uint8_t addr, uint8_t func) {
+    rx->buf = buf;
+    rx->max = max;
+    rx->avail = 0;
+    rx->len = 0;
+    rx->addr = addr;
+    rx->func = func;
+    rx->crc = CRC16_MODBUS_INIT;
+    rx->expected = 0;
+    rx->trailer = 0;
+    rx->status = MODBUS_RX_MORE;
+    rx->req = NULL;
+    rx->req_len = 0;
+    rx->echo_checked = 1;
+    rx->echo = 0;
+    rx->skipped = 0;
+}
+
+/**
+ * @brief Define quantos bytes próprios do dispositivo vêm antes do CRC da resposta
+ */
+static inline void modbus_rx_set_trailer(modbus_rx_t *rx, int trailer) {
+    rx->trailer = trailer > 0 ? trailer : 0;
+}
+
+/**
+ * @brief Informa o quadro enviado: liga a remoção do eco, a ressincronização
+ *        e a conferência da resposta com a requisição
+ * @param req Quadro enviado (deve continuar válido durante a recepção)
+ * @param req_len Tamanho do quadro
+ */
+static inline void modbus_rx_set_request(modbus_rx_t *rx, const uint8_t *req, int req_len) {
+    rx->req = req;
+    rx->req_len = req_len;
+    rx->echo_checked = 0;
+}
+
+/**
+ * @brief Prevê o tamanho da resposta pelo cabeçalho
+ *
+ * Exceção (função | 0x80): 5 bytes. Leituras (0x01-0x04, 0x17): byte count
+ * em hdr[2] + 5. Escritas (0x05, 0x06, 0x0F, 0x10): eco de 8 bytes. O trailer
+ * do dispositivo, quando há, é somado em todos os casos.
+ *
+ * @param hdr Primeiros bytes da resposta
+ * @param len Bytes disponíveis em hdr
+ * @param trailer Bytes do dispositivo entre a resposta e o CRC
+ * @return Tamanho total, 0 se o cabeçalho ainda está incompleto ou -1 se a
+ *         função não tem tamanho previsível (só o CRC e o silêncio delimitam)
+ */
+static inline int modbus_rx_predict_length(const uint8_t *hdr, int len, int trailer) {
+    if (len < 2) {
+        return 0;
+    }
+    if (hdr[1] & 0x80) {
+        return 5 + trailer;
+    }
+
+    switch (hdr[1]) {
+        case 0x01:
+        case 0x02:
+        case MODBUS_READ_HOLDING_REGS:
+        case 0x04:
+        case MODBUS_READ_WRITE_REGS:
+            // [addr][func][byte_count][dados...][crc_lo][crc_hi]
+            return len < 3 ? 0 : 5 + hdr[2] + trailer;
+        case 0x05:
+        case MODBUS_WRITE_SINGLE_REG:  // Eco de endereço e valor
+        case 0x0F:
+        case MODBUS_WRITE_MULTIPLE_REGS:  // Início e quantidade
+            return 8 + trailer;
+        default:
+            return -1;
+    }
+}
+
+// Valida o próximo byte do quadro em buf[0]
+static inline void modbus_rx_byte(modbus_rx_t *rx) {
+    int i = rx->len++;
+    uint8_t b = rx->buf[i];
+    rx->crc = crc16_modbus_byte(rx->crc, b);
+
+    if (i == 0) {
+        if (b != rx->addr) {
+            rx->status = MODBUS_RX_BAD_ADDR;
+        }
+    } else if (i == 1) {
+        if (b != rx->func && b != (rx->func | 0x80)) {
+            rx->status = MODBUS_RX_BAD_FUNC;
+        }
+    } else if (i == 2 && rx->expected == 0 && rx->req != NULL && rx->req_len >= 6 &&
+               (rx->func == MODBUS_READ_HOLDING_REGS || rx->func == 0x04 || rx->func == MODBUS_READ_WRITE_REGS) &&
+               b != 2 * (rx->req[4] | (rx->req[5] << 8))) {
+        // Quantidade lida pedida (little-endian) não bate com o byte count
+        rx->status = MODBUS_RX_MISMATCH;
+    } else if (i < 6 && rx->req != NULL && rx->req_len >= 6 && !(rx->buf[1] & 0x80) &&
+               (rx->func == MODBUS_WRITE_SINGLE_REG || rx->func == MODBUS_WRITE_MULTIPLE_REGS) &&
+               b != rx->req[i]) {
+        // 0x06 ecoa endereço e valor; 0x10 ecoa início e quantidade
+        rx->status = MODBUS_RX_MISMATCH;
+    }
+
+    // O tamanho sai do cabeçalho assim que ele chega (byte 1 ou 2)
+    if (rx->status == MODBUS_RX_MORE && rx->expected == 0) {
+        rx->expected = modbus_rx_predict_length(rx->buf, rx->len, rx->trailer);
+        if (rx->expected > rx->max) {
+            rx->status = MODBUS_RX_OVERFLOW;
+        }
+    }
+
+    if (rx->status == MODBUS_RX_MORE && rx->expected > 0 && rx->len == rx->expected) {
+        if (rx->crc != 0) {
+            rx->status = MODBUS_RX_BAD_CRC;
+        } else {
+            rx->status = rx->buf[1] & 0x80 ? MODBUS_RX_EXCEPTION : MODBUS_RX_OK;
+        }
+    }
+}
+
+/**
+ * @brief Indica se o quadro foi rejeitado antes do fim (resto deve ser descartado)
+ */
+static inline int modbus_rx_rejected(const modbus_rx_t *rx) {
+    return rx->status == MODBUS_RX_BAD_ADDR || rx->status == MODBUS_RX_BAD_FUNC ||
+           rx->status == MODBUS_RX_OVERFLOW || rx->status == MODBUS_RX_MISMATCH;
+}
+
+// Remove os n primeiros bytes do buffer e recomeça a validação do quadro
+static inline void modbus_rx_drop(modbus_rx_t *rx, int n) {
+    memmove(rx->buf, rx->buf + n, rx->avail - n);
+    rx->avail -= n;
+    rx->len = 0;
+    rx->crc = CRC16_MODBUS_INIT;
+    rx->expected = 0;
+    rx->status = MODBUS_RX_MORE;
+}
+
+// Valida os bytes pendentes, ressincronizando no fluxo se houver requisição
+static inline modbus_rx_status_t modbus_rx_scan(modbus_rx_t *rx) {
+    for (;;) {
+        if (!rx->echo_checked) {
+            int m = 0;
+            while (m < rx->avail && m < rx->req_len && rx->buf[m] == rx->req[m]) {
+                m++;
+            }
+            if (m == rx->req_len) {
+                // Eco local do quadro inteiro: a resposta vem depois dele
+                modbus_rx_drop(rx, m);
+                rx->echo += m;
+            } else if (m == rx->avail) {
+                return rx->status;  // Ainda pode ser o eco
+            }
+            rx->echo_checked = 1;
+        }
+
+        while (rx->status == MODBUS_RX_MORE && rx->len < rx->avail) {
+            modbus_rx_byte(rx);
+        }
+
+        // Quadro inteiro com o CRC errado é a resposta corrompida: só a retentativa resolve
+        if (rx->req == NULL || !modbus_rx_rejected(rx)) {
+            return rx->status;
+        }
+
+        // Não é a resposta: procura o próximo início possível
+        int p = 1;
+        while (p < rx->avail && rx->buf[p] != rx->addr) {
+            p++;
+        }
+        modbus_rx_drop(rx, p);
+        rx->skipped += p;
+    }
+}
+
+/**
+ * @brief Valida n bytes recém-lidos em buf + avail
+ *
+ * Bytes além do fim de um quadro já concluído são mantidos em avail, sem
+ * validação.
+ *
+ * @return Estado após os novos bytes (MODBUS_RX_MORE enquanto incompleto)
+ */
+static inline modbus_rx_status_t modbus_rx_push(modbus_rx_t *rx, int n) {
+    rx->avail += n;
+    return modbus_rx_scan(rx);
+}
+
+/**
+ * @brief Descarta os bytes pendentes (quadro interrompido por silêncio)
+ *
+ * Com requisição informada, a recepção continua esperando a resposta.
+ */
+static inline void modbus_rx_discard(modbus_rx_t *rx) {
+    rx->skipped += rx->avail;
+    rx->echo_checked = 1;
+    modbus_rx_drop(rx, rx->avail);
+}
+
+/**
+ * @brief Fecha a recepção após o silêncio de fim de quadro
+ *
+ * Para funções sem tamanho conhecido, o quadro é válido se o CRC acumulado
+ * fecha (resíduo zero).
+ */
+static inline modbus_rx_status_t modbus_rx_finish(modbus_rx_t *rx) {
+    if (!rx->echo_checked) {
+        // Silêncio antes do fim do eco: os bytes são resposta
+        rx->echo_checked = 1;
+        modbus_rx_scan(rx);
+    }
+    if (rx->status == MODBUS_RX_MORE && rx->expected < 0 && rx->len >= 4 && rx->crc == 0) {
+        rx->status = MODBUS_RX_OK;
+    }
+    return rx->status;
+}
+
+/**
+ * @brief Indica se a recepção terminou (quadro completo ou rejeitado)
+ */
+static inline int modbus_rx_done(const modbus_rx_t *rx) {
+    return rx->status != MODBUS_RX_MORE;
+}
+
+/**
+ * @brief Classifica o resultado da recepção (implementada em modbus_parking.c)
+ *
+ * Registra o erro no trace e nas métricas do dispositivo, como
+ * modbus_verify_response(), sem recalcular o CRC de um quadro válido.
+ *
+ * @return MODBUS_OK ou a classificação do erro
+ */
+modbus_error_t modbus_rx_result(const modbus_rx_t *rx);
+
+#endif
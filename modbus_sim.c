@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include "sim_device.h"
+
+/*
+ * Simulador do barramento do estacionamento (câmeras 0x11/0x12 e placar 0x20)
+ * num pseudo-terminal. Uso típico:
+ *
+ *   ./modbus_sim -l /tmp/ttyMODBUS &
+ *   ./example_parking /tmp/ttyMODBUS
+ */
+
+static sim_device_t *sim;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    sim_stop(sim);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s [opções]\n"
+            "  -l CAMINHO   cria um link simbólico para o lado escravo do PTY\n"
+            "  -m XXXX      matrícula exigida no trailer (padrão: aceita qualquer)\n"
+            "  -p MS        tempo de processamento das câmeras (padrão 300)\n"
+            "  -d US        atraso do escravo antes de responder (padrão 0)\n"
+            "  -b BAUD      taxa simulada da linha (padrão: sem limite)\n"
+            "  -e TAXA      probabilidade de erro por bit na resposta (ex: 1e-4)\n"
+            "  -x TAXA      probabilidade de não responder\n"
+            "  -E TAXA      probabilidade de responder com exceção 0x04\n"
+            "  -s SEMENTE   semente das falhas injetadas\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    sim_config_t config;
+    const char *link_path = NULL;
+    char slave_path[128];
+    int opt;
+
+    sim_config_default(&config);
+
+    while ((opt = getopt(argc, argv, "l:m:p:d:b:e:x:E:s:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                link_path = optarg;
+                break;
+            case 'm':
+                snprintf(config.matricula, sizeof(config.matricula), "%s", optarg);
+                break;
+            case 'p':
+                config.processing_ms = atoi(optarg);
+                break;
+            case 'd':
+                config.response_delay_us = atoi(optarg);
+                break;
+            case 'b':
+                config.baudrate = atoi(optarg);
+                break;
+            case 'e':
+                config.bit_error_rate = atof(optarg);
+                break;
+            case 'x':
+                config.drop_rate = atof(optarg);
+                break;
+            case 'E':
+                config.exception_rate = atof(optarg);
+                break;
+            case 's':
+                config.seed = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    sim = sim_create(&config);
+    if (sim == NULL || sim_open_pty(sim, slave_path, sizeof(slave_path)) != 0) {
+        fprintf(stderr, "Erro ao iniciar o simulador\n");
+        return 1;
+    }
+
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(slave_path, link_path) != 0) {
+            perror("Erro ao criar o link simbólico");
+            return 1;
+        }
+    }
+
+    printf("Simulador MODBUS em %s%s%s\n", slave_path, link_path ? " -> " : "", link_path ? link_path : "");
+    printf("Câmeras 0x%02X/0x%02X (processamento %d ms), placar 0x%02X\n",
+           CAMERA_ENTRADA_ADDR, CAMERA_SAIDA_ADDR, config.processing_ms, PLACAR_VAGAS_ADDR);
+    fflush(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    sim_run(sim);
+
+    sim_stats_t stats;
+    sim_get_stats(sim, &stats);
+    printf("\nRequisições: %llu, respostas: %llu, CRC inválido: %llu, matrícula inválida: %llu\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.replies,
+           (unsigned long long)stats.crc_errors, (unsigned long long)stats.matricula_errors);
+    printf("Falhas injetadas: %llu descartadas, %llu exceções, %llu corrompidas\n",
+           (unsigned long long)stats.dropped, (unsigned long long)stats.exceptions,
+           (unsigned long long)stats.corrupted);
+
+    if (link_path != NULL) {
+        unlink(link_path);
+    }
+    sim_destroy(sim);
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "retry.h"
+#include "config.h"
+
+static retry_policy_t library_policy = {
+    .max_attempts = RETRY_DEFAULT_MAX_ATTEMPTS,
+    .base_backoff_ms = RETRY_DEFAULT_BACKOFF_MS,
+    .max_backoff_ms = RETRY_DEFAULT_MAX_BACKOFF_MS,
+};
+
+static _Thread_local int64_t thread_deadline_us;
+static _Thread_local uint64_t jitter_state;
+static _Thread_local retry_t *thread_retry;
+
+void retry_policy_default(retry_policy_t *policy) {
+    policy->max_attempts = RETRY_DEFAULT_MAX_ATTEMPTS;
+    policy->base_backoff_ms = RETRY_DEFAULT_BACKOFF_MS;
+    policy->max_backoff_ms = RETRY_DEFAULT_MAX_BACKOFF_MS;
+}
+
+void retry_set_policy(const retry_policy_t *policy) {
+    library_policy = *policy;
+    if (library_policy.max_attempts < 1) {
+        library_policy.max_attempts = 1;
+    }
+}
+
+void retry_get_policy(retry_policy_t *policy) {
+    *policy = library_policy;
+}
+
+void retry_load_config(void) {
+    retry_policy_t policy;
+
+    policy.max_attempts = config_get_int("MODBUS_MAX_RETRIES", RETRY_DEFAULT_MAX_ATTEMPTS);
+    policy.base_backoff_ms = config_get_int("MODBUS_BACKOFF_MS", RETRY_DEFAULT_BACKOFF_MS);
+    policy.max_backoff_ms = config_get_int("MODBUS_MAX_BACKOFF_MS", RETRY_DEFAULT_MAX_BACKOFF_MS);
+    retry_set_policy(&policy);
+}
+
+int64_t retry_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t retry_deadline_after_ms(int ms) {
+    return ms > 0 ? retry_now_us() + (int64_t)ms * 1000 : 0;
+}
+
+int64_t retry_set_deadline(int64_t deadline_us) {
+    int64_t previous = thread_deadline_us;
+    thread_deadline_us = deadline_us;
+    return previous;
+}
+
+int64_t retry_get_deadline(void) {
+    return thread_deadline_us;
+}
+
+int64_t retry_remaining_us(int64_t deadline_us) {
+    if (deadline_us == 0) {
+        return INT64_MAX;
+    }
+    return deadline_us - retry_now_us();
+}
+
+int retry_is_retryable(modbus_error_t err) {
+    switch (err) {
+        case MODBUS_ERR_TIMEOUT:
+        case MODBUS_ERR_CRC:
+        case MODBUS_ERR_FRAME:
+        case MODBUS_ERR_BUSY:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// xorshift64 por thread, semeado no primeiro uso
+static uint64_t jitter_next(void) {
+    if (jitter_state == 0) {
+        jitter_state = (uint64_t)retry_now_us() ^ ((uint64_t)pthread_self() << 1) ^ 0x9E3779B97F4A7C15ULL;
+    }
+    jitter_state ^= jitter_state << 13;
+    jitter_state ^= jitter_state >> 7;
+    jitter_state ^= jitter_state << 17;
+    return jitter_state;
+}
+
+int64_t retry_backoff_us(const retry_policy_t *policy, int attempt) {
+    if (attempt < 1 || policy->base_backoff_ms <= 0) {
+        return 0;
+    }
+
+    int64_t backoff_us = (int64_t)policy->base_backoff_ms * 1000;
+    for (int i = 1; i < attempt && backoff_us < (int64_t)policy->max_backoff_ms * 1000; i++) {
+        backoff_us *= 2;
+    }
+    if (policy->max_backoff_ms > 0 && backoff_us > (int64_t)policy->max_backoff_ms * 1000) {
+        backoff_us = (int64_t)policy->max_backoff_ms * 1000;
+    }
+
+    // Metade fixa, metade sorteada
+    int64_t half = backoff_us / 2;
+    return half + (half > 0 ? (int64_t)(jitter_next() % (uint64_t)(half + 1)) : 0);
+}
+
+void retry_begin(retry_t *retry, const retry_policy_t *policy, int64_t deadline_us) {
+    retry->policy = policy != NULL ? *policy : library_policy;
+    retry->deadline_us = deadline_us;
+    retry->attempt = 1;
+    retry->delay_us = -1;
+}
+
+int64_t retry_next_delay(retry_t *retry, modbus_error_t err) {
+    if (!retry_is_retryable(err) || retry->attempt >= retry->policy.max_attempts) {
+        return -1;
+    }
+
+    int64_t backoff_us = retry_backoff_us(&retry->policy, retry->attempt);
+
+    // Só vale esperar se ainda sobrar tempo para a tentativa depois da espera
+    if (retry_remaining_us(retry->deadline_us) <= backoff_us) {
+        return -1;
+    }
+
+    retry->attempt++;
+    return backoff_us;
+}
+
+int retry_next(retry_t *retry, modbus_error_t err) {
+    int64_t backoff_us = retry_next_delay(retry, err);
+    if (backoff_us < 0) {
+        return 0;
+    }
+
+    if (backoff_us > 0) {
+        usleep(backoff_us);
+    }
+    return 1;
+}
+
+void retry_reset(retry_t *retry) {
+    retry->attempt = 0;
+    retry->delay_us = -1;
+}
+
+retry_t *retry_attach(retry_t *retry) {
+    retry_t *previous = thread_retry;
+
+    if (retry != NULL) {
+        retry->delay_us = -1;
+    }
+    thread_retry = retry;
+    return previous;
+}
+
+retry_t *retry_attached(void) {
+    return thread_retry;
+}
@@ -0,0 +1,158 @@
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <stdint.h>
+#include "modbus_parking.h"
+
+/*
+ * Retentativas com prazo absoluto. Toda transação da biblioteca passa por
+ * aqui: erros transitórios (timeout, CRC, quadro inválido, escravo ocupado)
+ * são repetidos com backoff exponencial com jitter; exceções do escravo não.
+ *
+ * O prazo é da thread (retry_set_deadline): o timeout de cada tentativa é
+ * cortado para caber no tempo restante e nenhuma espera de backoff passa do
+ * prazo, de modo que a operação retorna antes dele.
+ *
+ * Threads compartilhadas (a de E/S do barramento, um laço de capturas, quem
+ * segura o lock de um contexto) não podem dormir no backoff. Elas ligam um
+ * estado à thread (retry_attach): cada transação faz uma única tentativa e,
+ * se couber outra, retorna -1 com a espera em delay_us; quem chamou reagenda
+ * a operação e a refaz depois. Sem estado ligado, a espera é feita ali mesmo
+ * (API bloqueante por fd).
+ */
+
+#define RETRY_DEFAULT_MAX_ATTEMPTS 3
+#define RETRY_DEFAULT_BACKOFF_MS 100
+#define RETRY_DEFAULT_MAX_BACKOFF_MS 1000
+
+// Política de retentativas
+typedef struct {
+    int max_attempts;     // Tentativas por transação (1 = sem retry)
+    int base_backoff_ms;  // Espera média antes da 2ª tentativa (dobra a cada tentativa)
+    int max_backoff_ms;   // Limite da espera
+} retry_policy_t;
+
+// Estado de uma operação com retentativas
+typedef struct {
+    retry_policy_t policy;
+    int64_t deadline_us;  // CLOCK_MONOTONIC absoluto (0 = sem prazo)
+    int attempt;          // Tentativas já feitas (0 = operação ainda não iniciada)
+    int64_t delay_us;     // Com retry_attach: espera antes de refazer a operação (-1 = nenhuma)
+} retry_t;
+
+/**
+ * @brief Preenche a política padrão (3 tentativas, 100 ms, limite de 1 s)
+ */
+void retry_policy_default(retry_policy_t *policy);
+
+/**
+ * @brief Define a política usada pelas transações da biblioteca
+ */
+void retry_set_policy(const retry_policy_t *policy);
+
+/**
+ * @brief Copia a política usada pelas transações da biblioteca
+ */
+void retry_get_policy(retry_policy_t *policy);
+
+/**
+ * @brief Aplica MODBUS_MAX_RETRIES, MODBUS_BACKOFF_MS e MODBUS_MAX_BACKOFF_MS da configuração
+ *
+ * MODBUS_MAX_RETRIES é o número de tentativas (1 = sem retry).
+ */
+void retry_load_config(void);
+
+/**
+ * @brief Instante atual em µs (CLOCK_MONOTONIC), na mesma base dos prazos
+ */
+int64_t retry_now_us(void);
+
+/**
+ * @brief Prazo absoluto daqui a ms milissegundos (ms <= 0: sem prazo)
+ */
+int64_t retry_deadline_after_ms(int ms);
+
+/**
+ * @brief Define o prazo das transações desta thread
+ * @param deadline_us Prazo absoluto (0 = sem prazo)
+ * @return Prazo anterior, para restaurar ao fim da operação
+ */
+int64_t retry_set_deadline(int64_t deadline_us);
+
+/**
+ * @brief Prazo das transações desta thread (0 = sem prazo)
+ */
+int64_t retry_get_deadline(void);
+
+/**
+ * @brief Tempo restante até o prazo em µs (INT64_MAX sem prazo, <= 0 se esgotado)
+ */
+int64_t retry_remaining_us(int64_t deadline_us);
+
+/**
+ * @brief Indica se vale a pena repetir uma transação que falhou com err
+ */
+int retry_is_retryable(modbus_error_t err);
+
+/**
+ * @brief Espera da tentativa attempt (1 = antes da 2ª), com jitter
+ *
+ * Sorteia entre metade e o valor cheio de base * 2^(attempt-1), limitado a
+ * max_backoff_ms: tentativas de vários mestres não ficam sincronizadas.
+ */
+int64_t retry_backoff_us(const retry_policy_t *policy, int attempt);
+
+/**
+ * @brief Inicia uma operação
+ * @param retry Estado
+ * @param policy Política (NULL = política da biblioteca)
+ * @param deadline_us Prazo absoluto (0 = sem prazo)
+ */
+void retry_begin(retry_t *retry, const retry_policy_t *policy, int64_t deadline_us);
+
+/**
+ * @brief Decide se há nova tentativa depois de uma falha, sem esperar
+ *
+ * Para laços de eventos: o chamador agenda a próxima tentativa para daqui a
+ * delay µs (timer) em vez de dormir.
+ *
+ * @param retry Estado
+ * @param err Erro da tentativa que acabou de falhar
+ * @return Espera em µs antes da próxima tentativa ou -1 se deve desistir
+ */
+int64_t retry_next_delay(retry_t *retry, modbus_error_t err);
+
+/**
+ * @brief Decide se há nova tentativa depois de uma falha e faz a espera
+ *
+ * @param retry Estado
+ * @param err Erro da tentativa que acabou de falhar
+ * @return 1 se deve tentar de novo (a espera já foi feita), 0 se deve desistir
+ */
+int retry_next(retry_t *retry, modbus_error_t err);
+
+/**
+ * @brief Zera o estado para uma nova operação (a política e o prazo são lidos na 1ª tentativa)
+ */
+void retry_reset(retry_t *retry);
+
+/**
+ * @brief Liga um estado às transações desta thread, que passam a não esperar
+ *
+ * Cada transação faz uma tentativa. Se falhar e couber outra, retorna -1 com
+ * a espera em retry->delay_us (e as transações seguintes da mesma operação
+ * falham logo); o chamador refaz a operação inteira depois da espera, então
+ * ela deve poder ser repetida. As tentativas se acumulam no estado até
+ * retry_reset(): o limite da política vale para a operação inteira.
+ *
+ * @param retry Estado (NULL desliga); delay_us é zerado para -1
+ * @return Estado ligado antes, para restaurar ao fim da operação
+ */
+retry_t *retry_attach(retry_t *retry);
+
+/**
+ * @brief Estado ligado a esta thread (NULL se as transações esperam no backoff)
+ */
+retry_t *retry_attached(void);
+
+#endif
@@ -0,0 +1,481 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "sim_device.h"
+#include "crc16.h"
+#include "modbus_frame.h"
+
+// Códigos de exceção MODBUS
+#define SIM_EXC_ILLEGAL_FUNCTION 0x01
+#define SIM_EXC_ILLEGAL_ADDRESS  0x02
+#define SIM_EXC_ILLEGAL_VALUE    0x03
+#define SIM_EXC_DEVICE_FAILURE   0x04
+
+// Silêncio que descarta uma requisição incompleta
+#define SIM_PARTIAL_TIMEOUT_MS 50
+
+typedef struct {
+    uint16_t regs[SIM_CAMERA_REGS];
+    int64_t trigger_us;
+    char plate[9];
+    int confidence;
+} sim_camera_t;
+
+struct sim_device {
+    sim_config_t config;
+    pthread_mutex_t lock;  // Registradores e contadores
+    sim_camera_t cameras[2];
+    uint16_t placar[PLACAR_NUM_REGS];
+    sim_stats_t stats;
+    unsigned int rng;
+
+    int master_fd;
+    int slave_fd;          // Mantido aberto para o mestre poder reabrir a porta
+    pthread_t thread;
+    int thread_started;
+    atomic_int stopping;
+};
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sim_config_default(sim_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->processing_ms = 300;
+    config->seed = 1;
+}
+
+sim_device_t *sim_create(const sim_config_t *config) {
+    sim_device_t *sim = calloc(1, sizeof(*sim));
+    if (sim == NULL) {
+        return NULL;
+    }
+
+    sim->config = *config;
+    sim->rng = config->seed;
+    sim->master_fd = -1;
+    sim->slave_fd = -1;
+    pthread_mutex_init(&sim->lock, NULL);
+
+    sim_set_plate(sim, CAMERA_ENTRADA_ADDR, "ABC1D23", 90);
+    sim_set_plate(sim, CAMERA_SAIDA_ADDR, "XYZ9K87", 85);
+
+    return sim;
+}
+
+void sim_destroy(sim_device_t *sim) {
+    if (sim == NULL) {
+        return;
+    }
+
+    sim_stop(sim);
+    if (sim->master_fd >= 0) {
+        close(sim->master_fd);
+    }
+    if (sim->slave_fd >= 0) {
+        close(sim->slave_fd);
+    }
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
+
+static sim_camera_t *camera_for(sim_device_t *sim, uint8_t addr) {
+    if (addr == CAMERA_ENTRADA_ADDR) {
+        return &sim->cameras[0];
+    }
+    if (addr == CAMERA_SAIDA_ADDR) {
+        return &sim->cameras[1];
+    }
+    return NULL;
+}
+
+void sim_set_plate(sim_device_t *sim, uint8_t camera_addr, const char *plate, int confidence) {
+    sim_camera_t *cam = camera_for(sim, camera_addr);
+    if (cam == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&sim->lock);
+    snprintf(cam->plate, sizeof(cam->plate), "%-8.8s", plate);
+    cam->confidence = confidence;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+uint16_t sim_placar_register(sim_device_t *sim, int index) {
+    uint16_t value = 0;
+
+    if (index >= 0 && index < PLACAR_NUM_REGS) {
+        pthread_mutex_lock(&sim->lock);
+        value = sim->placar[index];
+        pthread_mutex_unlock(&sim->lock);
+    }
+
+    return value;
+}
+
+// Conclui a captura quando o tempo de processamento já passou
+static void camera_update(sim_device_t *sim, sim_camera_t *cam) {
+    if (cam->regs[LPR_STATUS_OFFSET] != LPR_STATUS_PROCESSANDO) {
+        return;
+    }
+    if (monotonic_us() - cam->trigger_us < (int64_t)sim->config.processing_ms * 1000) {
+        return;
+    }
+
+    cam->regs[LPR_STATUS_OFFSET] = LPR_STATUS_OK;
+    for (int i = 0; i < 4; i++) {
+        cam->regs[LPR_PLACA_OFFSET + i] = (uint8_t)cam->plate[i * 2] | ((uint8_t)cam->plate[i * 2 + 1] << 8);
+    }
+    cam->regs[LPR_CONFIANCA_OFFSET] = cam->confidence;
+    cam->regs[LPR_ERRO_OFFSET] = 0;
+}
+
+static void camera_write_trigger(sim_camera_t *cam, uint16_t value) {
+    cam->regs[LPR_TRIGGER_OFFSET] = value;
+
+    if (value == 1) {
+        cam->regs[LPR_STATUS_OFFSET] = LPR_STATUS_PROCESSANDO;
+        cam->trigger_us = monotonic_us();
+        memset(&cam->regs[LPR_PLACA_OFFSET], 0, 6 * sizeof(uint16_t));
+    } else {
+        cam->regs[LPR_STATUS_OFFSET] = LPR_STATUS_PRONTO;
+    }
+}
+
+static int finish_response(uint8_t *response, int len) {
+    uint16_t crc = crc16_modbus(response, len);
+    response[len++] = crc & 0xFF;
+    response[len++] = (crc >> 8) & 0xFF;
+    return len;
+}
+
+static int exception_response(uint8_t *response, uint8_t addr, uint8_t func, uint8_t code) {
+    response[0] = addr;
+    response[1] = func | 0x80;
+    response[2] = code;
+    return finish_response(response, 3);
+}
+
+// Tamanho esperado da requisição (com matrícula e CRC); 0 se ainda não dá para saber
+static int expected_request_len(const uint8_t *buf, int len) {
+    if (len < 2) {
+        return 0;
+    }
+
+    switch (buf[1]) {
+        case MODBUS_READ_HOLDING_REGS:
+            return 6 + MODBUS_FRAME_TRAILER;
+        case MODBUS_WRITE_MULTIPLE_REGS:
+            return len >= 7 ? 7 + buf[6] + MODBUS_FRAME_TRAILER : 0;
+        default:
+            return 0;
+    }
+}
+
+int sim_handle_frame(sim_device_t *sim, const uint8_t *request, int len, uint8_t *response, int max) {
+    if (max < 5 + PLACAR_NUM_REGS * 2 || len < 4 + MODBUS_FRAME_TRAILER) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&sim->lock);
+    sim->stats.frames++;
+
+    // CRC inválido: o escravo fica em silêncio, como no barramento real
+    if (crc16_modbus(request, len) != 0) {
+        sim->stats.crc_errors++;
+        pthread_mutex_unlock(&sim->lock);
+        return 0;
+    }
+
+    const uint8_t *matricula = request + len - MODBUS_FRAME_TRAILER;
+    if (sim->config.matricula[0] != '\0' && memcmp(matricula, sim->config.matricula, 4) != 0) {
+        sim->stats.matricula_errors++;
+        pthread_mutex_unlock(&sim->lock);
+        return 0;
+    }
+
+    uint8_t addr = request[0];
+    uint8_t func = request[1];
+    sim_camera_t *cam = camera_for(sim, addr);
+    uint16_t *regs;
+    int num_regs;
+
+    if (cam != NULL) {
+        camera_update(sim, cam);
+        regs = cam->regs;
+        num_regs = SIM_CAMERA_REGS;
+    } else if (addr == PLACAR_VAGAS_ADDR) {
+        regs = sim->placar;
+        num_regs = PLACAR_NUM_REGS;
+    } else {
+        pthread_mutex_unlock(&sim->lock);
+        return 0;
+    }
+
+    // Campos em little-endian, como na biblioteca
+    int start = request[2] | (request[3] << 8);
+    int count = request[4] | (request[5] << 8);
+    int rlen = 0;
+
+    if (func == MODBUS_READ_HOLDING_REGS) {
+        if (count == 0 || start + count > num_regs) {
+            rlen = exception_response(response, addr, func, SIM_EXC_ILLEGAL_ADDRESS);
+        } else {
+            response[rlen++] = addr;
+            response[rlen++] = func;
+            response[rlen++] = count * 2;
+            for (int i = start; i < start + count; i++) {
+                response[rlen++] = regs[i] & 0xFF;
+                response[rlen++] = (regs[i] >> 8) & 0xFF;
+            }
+            rlen = finish_response(response, rlen);
+        }
+    } else if (func == MODBUS_WRITE_MULTIPLE_REGS) {
+        int writable = cam != NULL ? (start == LPR_TRIGGER_OFFSET && count == 1)
+                                   : (count > 0 && start + count <= num_regs);
+
+        if (request[6] != count * 2 || len != 7 + count * 2 + MODBUS_FRAME_TRAILER) {
+            rlen = exception_response(response, addr, func, SIM_EXC_ILLEGAL_VALUE);
+        } else if (!writable) {
+            rlen = exception_response(response, addr, func, SIM_EXC_ILLEGAL_ADDRESS);
+        } else {
+            for (int i = 0; i < count; i++) {
+                uint16_t value = request[7 + i * 2] | (request[8 + i * 2] << 8);
+                if (cam != NULL) {
+                    camera_write_trigger(cam, value);
+                } else {
+                    regs[start + i] = value;
+                }
+            }
+            memcpy(response, request, 6);
+            rlen = finish_response(response, 6);
+        }
+    } else {
+        rlen = exception_response(response, addr, func, SIM_EXC_ILLEGAL_FUNCTION);
+    }
+
+    pthread_mutex_unlock(&sim->lock);
+    return rlen;
+}
+
+int sim_open_pty(sim_device_t *sim, char *slave_path, size_t size) {
+    struct termios tty;
+
+    sim->master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (sim->master_fd < 0) {
+        perror("Erro ao abrir o pseudo-terminal");
+        return -1;
+    }
+
+    if (grantpt(sim->master_fd) != 0 || unlockpt(sim->master_fd) != 0 ||
+        ptsname_r(sim->master_fd, slave_path, size) != 0) {
+        perror("Erro ao preparar o pseudo-terminal");
+        close(sim->master_fd);
+        sim->master_fd = -1;
+        return -1;
+    }
+
+    // Modo binário nos dois lados
+    tcgetattr(sim->master_fd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(sim->master_fd, TCSANOW, &tty);
+
+    sim->slave_fd = open(slave_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (sim->slave_fd >= 0) {
+        tcgetattr(sim->slave_fd, &tty);
+        cfmakeraw(&tty);
+        tcsetattr(sim->slave_fd, TCSANOW, &tty);
+    }
+
+    return 0;
+}
+
+static double sim_random(sim_device_t *sim) {
+    return (double)rand_r(&sim->rng) / ((double)RAND_MAX + 1.0);
+}
+
+// Aplica as falhas configuradas; retorna o tamanho final (0 = sem resposta)
+static int inject_faults(sim_device_t *sim, uint8_t *response, int len) {
+    const sim_config_t *cfg = &sim->config;
+
+    pthread_mutex_lock(&sim->lock);
+
+    if (cfg->drop_rate > 0 && sim_random(sim) < cfg->drop_rate) {
+        sim->stats.dropped++;
+        len = 0;
+    } else if (cfg->exception_rate > 0 && sim_random(sim) < cfg->exception_rate) {
+        sim->stats.exceptions++;
+        len = exception_response(response, response[0], response[1] & 0x7F, SIM_EXC_DEVICE_FAILURE);
+    }
+
+    if (len > 0 && cfg->bit_error_rate > 0) {
+        int flipped = 0;
+        for (int i = 0; i < len * 8; i++) {
+            if (sim_random(sim) < cfg->bit_error_rate) {
+                response[i / 8] ^= 1 << (i % 8);
+                flipped = 1;
+            }
+        }
+        sim->stats.corrupted += flipped;
+    }
+
+    if (len > 0) {
+        sim->stats.replies++;
+    }
+
+    pthread_mutex_unlock(&sim->lock);
+    return len;
+}
+
+// Tempo de linha de n bytes (11 bits por caractere)
+static int64_t line_time_us(const sim_config_t *cfg, int bytes) {
+    if (cfg->baudrate <= 0) {
+        return 0;
+    }
+    return (int64_t)bytes * 11 * 1000000 / cfg->baudrate;
+}
+
+static int write_all(int fd, const uint8_t *buf, int len) {
+    int total = 0;
+
+    while (total < len) {
+        ssize_t n = write(fd, buf + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += n;
+    }
+
+    return 0;
+}
+
+static void serve_request(sim_device_t *sim, const uint8_t *request, int len) {
+    uint8_t response[MODBUS_MAX_FRAME];
+    int rlen = sim_handle_frame(sim, request, len, response, sizeof(response));
+    if (rlen <= 0) {
+        return;
+    }
+
+    rlen = inject_faults(sim, response, rlen);
+    if (rlen <= 0) {
+        return;
+    }
+
+    // Requisição e resposta ocupam a linha pelo tempo de transmissão simulado
+    int64_t delay_us = sim->config.response_delay_us + line_time_us(&sim->config, len + rlen);
+    if (delay_us > 0) {
+        usleep(delay_us);
+    }
+
+    if (write_all(sim->master_fd, response, rlen) != 0) {
+        perror("Erro ao escrever no pseudo-terminal");
+    }
+}
+
+int sim_run(sim_device_t *sim) {
+    uint8_t buf[MODBUS_MAX_FRAME * 2];
+    int len = 0;
+
+    if (sim->master_fd < 0) {
+        return -1;
+    }
+
+    while (!atomic_load(&sim->stopping)) {
+        struct pollfd pfd = { .fd = sim->master_fd, .events = POLLIN };
+        int timeout_ms = len > 0 ? SIM_PARTIAL_TIMEOUT_MS : 100;
+        int ret = poll(&pfd, 1, timeout_ms);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erro no poll do simulador");
+            return -1;
+        }
+
+        if (ret == 0) {
+            // Silêncio com requisição incompleta: processa o que chegou (o CRC decide)
+            if (len > 0) {
+                serve_request(sim, buf, len);
+                len = 0;
+            }
+            continue;
+        }
+
+        ssize_t n = read(sim->master_fd, buf + len, sizeof(buf) - len);
+        if (n <= 0) {
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            // Sem o lado escravo aberto o master retorna EIO: aguarda o mestre
+            usleep(10000);
+            continue;
+        }
+        len += n;
+
+        // Separa requisições completas pelo tamanho esperado
+        for (;;) {
+            int expected = expected_request_len(buf, len);
+            if (expected == 0 || len < expected) {
+                break;
+            }
+
+            serve_request(sim, buf, expected);
+            memmove(buf, buf + expected, len - expected);
+            len -= expected;
+        }
+
+        if (len == (int)sizeof(buf)) {
+            len = 0;
+        }
+    }
+
+    return 0;
+}
+
+static void *sim_thread(void *arg) {
+    sim_run(arg);
+    return NULL;
+}
+
+int sim_start(sim_device_t *sim) {
+    atomic_store(&sim->stopping, 0);
+
+    if (pthread_create(&sim->thread, NULL, sim_thread, sim) != 0) {
+        fprintf(stderr, "Erro ao criar a thread do simulador\n");
+        return -1;
+    }
+
+    sim->thread_started = 1;
+    return 0;
+}
+
+void sim_stop(sim_device_t *sim) {
+    atomic_store(&sim->stopping, 1);
+
+    if (sim->thread_started) {
+        pthread_join(sim->thread, NULL);
+        sim->thread_started = 0;
+    }
+}
+
+void sim_get_stats(sim_device_t *sim, sim_stats_t *stats) {
+    pthread_mutex_lock(&sim->lock);
+    *stats = sim->stats;
+    pthread_mutex_unlock(&sim->lock);
+}
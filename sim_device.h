@@ -0,0 +1,101 @@
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbus_parking.h"
+
+/*
+ * Escravos MODBUS simulados num pseudo-terminal: câmeras LPR (0x11 e 0x12,
+ * com o tempo de processamento da captura) e o placar de vagas (0x20, 13
+ * registradores). Permite rodar a biblioteca e os benchmarks sem RS485.
+ */
+
+#define SIM_CAMERA_REGS 8
+
+typedef struct {
+    int processing_ms;      // Tempo da câmera entre o trigger e o status OK
+    int response_delay_us;  // Atraso do escravo antes de responder
+    int baudrate;           // Taxa simulada da linha (0 = sem limite)
+    double bit_error_rate;  // Probabilidade de inverter cada bit da resposta
+    double drop_rate;       // Probabilidade de não responder
+    double exception_rate;  // Probabilidade de responder com exceção 0x04
+    char matricula[5];      // Trailer exigido ("" aceita qualquer um)
+    unsigned int seed;      // Semente das falhas injetadas
+} sim_config_t;
+
+typedef struct {
+    uint64_t frames;            // Requisições recebidas
+    uint64_t replies;           // Respostas enviadas
+    uint64_t crc_errors;        // Requisições com CRC inválido (ignoradas)
+    uint64_t matricula_errors;  // Trailer diferente do configurado (ignoradas)
+    uint64_t dropped;           // Respostas descartadas de propósito
+    uint64_t exceptions;        // Exceções enviadas
+    uint64_t corrupted;         // Respostas com bits invertidos
+} sim_stats_t;
+
+typedef struct sim_device sim_device_t;
+
+/**
+ * @brief Preenche a configuração padrão (300 ms de processamento, sem falhas)
+ */
+void sim_config_default(sim_config_t *config);
+
+/**
+ * @brief Cria os escravos simulados
+ * @return Handle ou NULL em caso de erro
+ */
+sim_device_t *sim_create(const sim_config_t *config);
+
+/**
+ * @brief Libera os escravos (para a thread e fecha o PTY, se abertos)
+ */
+void sim_destroy(sim_device_t *sim);
+
+/**
+ * @brief Define a placa e a confiança retornadas por uma câmera
+ * @param plate Até 8 caracteres (completados com espaço)
+ */
+void sim_set_plate(sim_device_t *sim, uint8_t camera_addr, const char *plate, int confidence);
+
+/**
+ * @brief Lê um registrador do placar simulado
+ */
+uint16_t sim_placar_register(sim_device_t *sim, int index);
+
+/**
+ * @brief Processa uma requisição completa e monta a resposta (sem falhas injetadas)
+ * @return Tamanho da resposta, 0 se o escravo não deve responder
+ */
+int sim_handle_frame(sim_device_t *sim, const uint8_t *request, int len, uint8_t *response, int max);
+
+/**
+ * @brief Abre o par de pseudo-terminais
+ * @param slave_path Recebe o caminho do lado escravo (para open_uart())
+ * @param size Tamanho de slave_path
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int sim_open_pty(sim_device_t *sim, char *slave_path, size_t size);
+
+/**
+ * @brief Atende requisições no PTY até sim_stop() (bloqueante)
+ */
+int sim_run(sim_device_t *sim);
+
+/**
+ * @brief Atende requisições numa thread própria
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int sim_start(sim_device_t *sim);
+
+/**
+ * @brief Para o atendimento (sim_run retorna, a thread de sim_start termina)
+ */
+void sim_stop(sim_device_t *sim);
+
+/**
+ * @brief Copia os contadores
+ */
+void sim_get_stats(sim_device_t *sim, sim_stats_t *stats);
+
+#endif
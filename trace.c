@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+#include "config.h"
+
+// Ring SPSC: a thread dona escreve em head, a drenagem avança tail
+typedef struct trace_ring {
+    trace_record_t records[TRACE_RING_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    atomic_uint dropped;          // Registros perdidos com o ring cheio
+    unsigned int dropped_seen;    // Já reportados (só a drenagem acessa)
+    atomic_int in_use;            // 0 após a saída da thread: pode ser reaproveitado
+    uint16_t id;
+    struct trace_ring *next;      // Lista global (só cresce)
+} trace_ring_t;
+
+_Static_assert(sizeof(trace_record_t) == 64, "trace_record_t deve ocupar uma linha de cache");
+
+// Registros por passada de drenagem (ordenados por tempo antes de imprimir)
+#define TRACE_DRAIN_BATCH 4096
+
+atomic_int trace_runtime_level = TRACE_LEVEL_ERROR;
+
+static _Atomic(trace_ring_t *) rings;
+static atomic_int ring_count;
+static _Thread_local trace_ring_t *local_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static uint64_t trace_epoch_ns;
+
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_record_t drain_batch[TRACE_DRAIN_BATCH];
+
+static struct {
+    pthread_t thread;
+    FILE *out;
+    int interval_ms;
+    atomic_int running;
+} drainer;
+
+static const char *event_names[TRACE_EV_COUNT] = {
+    [TRACE_EV_TX] = "TX",
+    [TRACE_EV_RX] = "RX",
+    [TRACE_EV_TIMEOUT] = "Timeout: nenhuma resposta recebida",
+    [TRACE_EV_SHORT] = "Resposta muito curta",
+    [TRACE_EV_CRC] = "Erro de CRC",
+    [TRACE_EV_BAD_ADDR] = "Endereço incorreto",
+    [TRACE_EV_BAD_FUNC] = "Função incorreta",
+    [TRACE_EV_EXCEPTION] = "Exceção MODBUS",
+    [TRACE_EV_BYTE_COUNT] = "Byte count inesperado",
+    [TRACE_EV_TRIGGER] = "Enviando trigger",
+    [TRACE_EV_READ_DATA] = "Lendo dados",
+    [TRACE_EV_PLACAR] = "Atualizando placar de vagas",
+    [TRACE_EV_CAPTURE_TRY] = "Tentativa de captura",
+    [TRACE_EV_CAPTURE_STATUS] = "Status",
+    [TRACE_EV_CAPTURE_ERROR] = "Erro na captura",
+    [TRACE_EV_TRIGGER_FAIL] = "Erro ao disparar trigger",
+    [TRACE_EV_CAPTURE_OK] = "Placa capturada",
+    [TRACE_EV_CAPTURE_BACKOFF] = "Aguardando antes de tentar novamente",
+    [TRACE_EV_CAPTURE_FAILED] = "Falha na captura",
+    [TRACE_EV_CAPTURE_ESTIMATE] = "Processamento da câmera",
+    [TRACE_EV_CAPTURE_DEADLINE] = "Prazo da captura esgotado",
+    [TRACE_EV_CAPTURE_CACHED] = "Captura reaproveitada",
+    [TRACE_EV_RESYNC] = "Resposta ressincronizada",
+    [TRACE_EV_MISMATCH] = "Resposta não corresponde à requisição",
+};
+
+// Formatadores registrados pelos módulos que emitem cada evento
+static _Atomic(trace_formatter_t) formatters[TRACE_EV_COUNT];
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+__attribute__((constructor))
+static void trace_init(void) {
+    trace_epoch_ns = monotonic_ns();
+}
+
+// Destrutor do pthread_key: libera o ring para outra thread (o conteúdo ainda será drenado)
+static void ring_release(void *arg) {
+    trace_ring_t *ring = arg;
+    atomic_store(&ring->in_use, 0);
+}
+
+static void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+static trace_ring_t *attach_ring(void) {
+    trace_ring_t *ring;
+
+    pthread_once(&ring_key_once, ring_key_create);
+
+    // Reaproveita o ring de uma thread que já terminou
+    for (ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ring->in_use, &expected, 1)) {
+            break;
+        }
+    }
+
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL) {
+            return NULL;
+        }
+        atomic_store(&ring->in_use, 1);
+        ring->id = (uint16_t)atomic_fetch_add(&ring_count, 1);
+
+        trace_ring_t *head = atomic_load(&rings);
+        do {
+            ring->next = head;
+        } while (!atomic_compare_exchange_weak(&rings, &head, ring));
+    }
+
+    pthread_setspecific(ring_key, ring);
+    local_ring = ring;
+    return ring;
+}
+
+void trace_emit(int level, int event, uint8_t addr, uint8_t func,
+                int32_t arg0, int32_t arg1, const void *data, int data_len) {
+    trace_ring_t *ring = local_ring != NULL ? local_ring : attach_ring();
+    if (ring == NULL) {
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    // Ring cheio: descarta em vez de bloquear o barramento
+    if (head - tail >= TRACE_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    trace_record_t *rec = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    rec->timestamp_ns = monotonic_ns();
+    rec->event = (uint16_t)event;
+    rec->level = (uint8_t)level;
+    rec->addr = addr;
+    rec->func = func;
+    rec->thread = ring->id;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+
+    if (data_len > TRACE_DATA_MAX) {
+        data_len = TRACE_DATA_MAX;
+    }
+    rec->data_len = data_len > 0 ? (uint8_t)data_len : 0;
+    if (rec->data_len > 0) {
+        memcpy(rec->data, data, rec->data_len);
+    }
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_set_level(int level) {
+    if (level < TRACE_LEVEL_OFF) {
+        level = TRACE_LEVEL_OFF;
+    }
+    if (level > TRACE_COMPILE_LEVEL) {
+        level = TRACE_COMPILE_LEVEL;
+    }
+
+    atomic_store(&trace_runtime_level, level);
+}
+
+int trace_load_config(void) {
+    int level = TRACE_LEVEL_ERROR;
+
+    if (config_get_int("DEBUG_MODBUS", 0)) {
+        level = TRACE_LEVEL_INFO;
+    }
+    if (config_get_int("PRINT_BUFFERS", 0)) {
+        level = TRACE_LEVEL_FRAMES;
+    }
+
+    trace_set_level(level);
+    return atomic_load(&trace_runtime_level);
+}
+
+static int format_bytes(char *buffer, int size, const trace_record_t *rec) {
+    int n = snprintf(buffer, size, "(%d bytes):", rec->arg0);
+
+    for (int i = 0; i < rec->data_len && n < size; i++) {
+        n += snprintf(buffer + n, size - n, " 0x%02X", rec->data[i]);
+    }
+    if (rec->arg0 > rec->data_len && n < size) {
+        n += snprintf(buffer + n, size - n, " ...");
+    }
+
+    return n;
+}
+
+void trace_register_formatter(int event, trace_formatter_t formatter) {
+    if (event > 0 && event < TRACE_EV_COUNT) {
+        atomic_store(&formatters[event], formatter);
+    }
+}
+
+int trace_format(const trace_record_t *rec, char *buffer, int size) {
+    const char *name = "?";
+    uint64_t elapsed_us = (rec->timestamp_ns - trace_epoch_ns) / 1000;
+    int n;
+
+    if (rec->event > 0 && rec->event < TRACE_EV_COUNT && event_names[rec->event] != NULL) {
+        name = event_names[rec->event];
+    }
+
+    n = snprintf(buffer, size, "[%6llu.%06llu] T%u 0x%02X %s",
+                 (unsigned long long)(elapsed_us / 1000000), (unsigned long long)(elapsed_us % 1000000),
+                 rec->thread, rec->addr, name);
+    if (n >= size) {
+        return size - 1;
+    }
+
+    switch (rec->event) {
+        case TRACE_EV_TX:
+        case TRACE_EV_RX:
+            n += snprintf(buffer + n, size - n, " ");
+            n += format_bytes(buffer + n, size - n, rec);
+            break;
+        case TRACE_EV_SHORT:
+            n += snprintf(buffer + n, size - n, ": %d bytes", rec->arg0);
+            break;
+        case TRACE_EV_CRC:
+            n += snprintf(buffer + n, size - n, ": recebido=0x%04X, calculado=0x%04X", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_BAD_ADDR:
+            n += snprintf(buffer + n, size - n, ": recebido=0x%02X", rec->arg0);
+            break;
+        case TRACE_EV_BAD_FUNC:
+            n += snprintf(buffer + n, size - n, ": esperado=0x%02X, recebido=0x%02X", rec->func, rec->arg0);
+            break;
+        case TRACE_EV_EXCEPTION:
+            n += snprintf(buffer + n, size - n, ": código=0x%02X", rec->arg0);
+            break;
+        case TRACE_EV_BYTE_COUNT:
+            n += snprintf(buffer + n, size - n, ": %d bytes de dados, esperado %d", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_PLACAR:
+            n += snprintf(buffer + n, size - n, " (registradores %d-%d)", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_CAPTURE_TRY:
+            n += snprintf(buffer + n, size - n, " %d/%d", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_CAPTURE_STATUS:
+            n += snprintf(buffer + n, size - n, " %d", rec->arg0);
+            break;
+        case TRACE_EV_CAPTURE_OK:
+            n += snprintf(buffer + n, size - n, ": %.*s (confiança: %d%%)", rec->data_len,
+                          (const char *)rec->data, rec->arg0);
+            break;
+        case TRACE_EV_CAPTURE_BACKOFF:
+            n += snprintf(buffer + n, size - n, " (%d ms)", rec->arg0);
+            break;
+        case TRACE_EV_CAPTURE_FAILED:
+            n += snprintf(buffer + n, size - n, " após %d tentativas", rec->arg0);
+            break;
+        case TRACE_EV_CAPTURE_ESTIMATE:
+            n += snprintf(buffer + n, size - n, ": ~%d ms (%d leituras de status)", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_CAPTURE_DEADLINE:
+            n += snprintf(buffer + n, size - n, " na tentativa %d", rec->arg0);
+            break;
+        case TRACE_EV_RESYNC:
+            n += snprintf(buffer + n, size - n, ": %d bytes descartados, %d de eco", rec->arg0, rec->arg1);
+            break;
+        case TRACE_EV_MISMATCH:
+            n += snprintf(buffer + n, size - n, ": byte %d", rec->arg0);
+            break;
+        default:
+            if (rec->event > 0 && rec->event < TRACE_EV_COUNT) {
+                trace_formatter_t formatter = atomic_load(&formatters[rec->event]);
+                if (formatter != NULL) {
+                    n += formatter(rec, buffer + n, size - n);
+                }
+            }
+            break;
+    }
+
+    return n < size ? n : size - 1;
+}
+
+static int compare_records(const void *a, const void *b) {
+    const trace_record_t *ra = a;
+    const trace_record_t *rb = b;
+
+    if (ra->timestamp_ns != rb->timestamp_ns) {
+        return ra->timestamp_ns < rb->timestamp_ns ? -1 : 1;
+    }
+    return 0;
+}
+
+int trace_drain(FILE *out) {
+    char line[512];
+    int total = 0;
+
+    pthread_mutex_lock(&drain_lock);
+
+    for (;;) {
+        int count = 0;
+
+        for (trace_ring_t *ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+            uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+            while (tail != head && count < TRACE_DRAIN_BATCH) {
+                drain_batch[count++] = ring->records[tail & (TRACE_RING_SIZE - 1)];
+                tail++;
+            }
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+            unsigned int dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+            if (dropped != ring->dropped_seen) {
+                fprintf(out, "Trace: %u registros descartados na thread T%u\n",
+                        dropped - ring->dropped_seen, ring->id);
+                ring->dropped_seen = dropped;
+            }
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        // Intercala as threads pela ordem em que os eventos aconteceram
+        qsort(drain_batch, count, sizeof(trace_record_t), compare_records);
+        for (int i = 0; i < count; i++) {
+            trace_format(&drain_batch[i], line, sizeof(line));
+            fprintf(out, "%s\n", line);
+        }
+        total += count;
+
+        if (count < TRACE_DRAIN_BATCH) {
+            break;
+        }
+    }
+
+    fflush(out);
+    pthread_mutex_unlock(&drain_lock);
+    return total;
+}
+
+static void *drainer_thread(void *arg) {
+    (void)arg;
+
+    while (atomic_load(&drainer.running)) {
+        trace_drain(drainer.out);
+        usleep(drainer.interval_ms * 1000);
+    }
+
+    return NULL;
+}
+
+int trace_start_drainer(FILE *out, int interval_ms) {
+    if (atomic_load(&drainer.running)) {
+        return 0;
+    }
+
+    drainer.out = out;
+    drainer.interval_ms = interval_ms > 0 ? interval_ms : 50;
+    atomic_store(&drainer.running, 1);
+
+    if (pthread_create(&drainer.thread, NULL, drainer_thread, NULL) != 0) {
+        fprintf(stderr, "Erro ao criar a thread de trace\n");
+        atomic_store(&drainer.running, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+void trace_stop_drainer(void) {
+    if (!atomic_exchange(&drainer.running, 0)) {
+        return;
+    }
+
+    pthread_join(drainer.thread, NULL);
+    trace_drain(drainer.out);
+}
@@ -0,0 +1,161 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Rastreamento de baixo custo: cada thread grava registros binários de
+ * tamanho fixo num ring buffer próprio (sem lock, sem formatação, sem E/S)
+ * e uma thread de drenagem os converte em texto fora do caminho crítico.
+ */
+
+// Níveis (cumulativos)
+#define TRACE_LEVEL_OFF    0
+#define TRACE_LEVEL_ERROR  1  // Timeouts, CRC, exceções
+#define TRACE_LEVEL_INFO   2  // Eventos de alto nível (DEBUG_MODBUS=1)
+#define TRACE_LEVEL_FRAMES 3  // Bytes de cada quadro (PRINT_BUFFERS=1)
+
+// Níveis acima deste somem do binário (ex: -DTRACE_COMPILE_LEVEL=1)
+#ifndef TRACE_COMPILE_LEVEL
+#define TRACE_COMPILE_LEVEL TRACE_LEVEL_FRAMES
+#endif
+
+// Registros por thread (potência de 2)
+#define TRACE_RING_SIZE 1024
+
+// Bytes de quadro guardados por registro (o tamanho real fica em arg0)
+#define TRACE_DATA_MAX 40
+
+// Eventos
+typedef enum {
+    TRACE_EV_TX = 1,         // data = quadro enviado
+    TRACE_EV_RX,             // data = quadro recebido
+    TRACE_EV_TIMEOUT,        // nenhuma resposta
+    TRACE_EV_SHORT,          // arg0 = bytes recebidos
+    TRACE_EV_CRC,            // arg0 = recebido, arg1 = calculado
+    TRACE_EV_BAD_ADDR,       // arg0 = endereço recebido
+    TRACE_EV_BAD_FUNC,       // arg0 = função recebida
+    TRACE_EV_EXCEPTION,      // arg0 = código de exceção
+    TRACE_EV_BYTE_COUNT,     // arg0 = recebido, arg1 = esperado
+    TRACE_EV_TRIGGER,        // disparo de captura
+    TRACE_EV_READ_DATA,      // leitura dos dados da câmera
+    TRACE_EV_PLACAR,         // arg0 = primeiro, arg1 = último registrador
+    TRACE_EV_CAPTURE_TRY,    // arg0 = tentativa, arg1 = máximo
+    TRACE_EV_CAPTURE_STATUS, // arg0 = status
+    TRACE_EV_CAPTURE_ERROR,  // câmera reportou erro
+    TRACE_EV_TRIGGER_FAIL,   // arg0 = modbus_error_t
+    TRACE_EV_CAPTURE_OK,     // data = placa, arg0 = confiança
+    TRACE_EV_CAPTURE_BACKOFF,// arg0 = espera em ms
+    TRACE_EV_CAPTURE_FAILED, // arg0 = tentativas
+    TRACE_EV_CAPTURE_ESTIMATE,// arg0 = processamento observado em ms, arg1 = leituras de status
+    TRACE_EV_CAPTURE_DEADLINE,// arg0 = tentativa em andamento
+    TRACE_EV_CAPTURE_CACHED, // arg0 = idade em ms, arg1 = lpr_cache_result_t
+    TRACE_EV_RESYNC,         // arg0 = bytes descartados, arg1 = bytes de eco removidos
+    TRACE_EV_MISMATCH,       // resposta de outra requisição (arg0 = byte divergente)
+    TRACE_EV_COUNT
+} trace_event_t;
+
+// Registro binário (64 bytes, uma linha de cache)
+typedef struct {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    uint16_t event;
+    uint8_t level;
+    uint8_t addr;
+    uint8_t func;
+    uint8_t data_len;
+    uint16_t thread;        // Índice do ring de origem
+    int32_t arg0;
+    int32_t arg1;
+    uint8_t data[TRACE_DATA_MAX];
+} trace_record_t;
+
+// Nível em tempo de execução (lido sem lock pelas macros)
+extern atomic_int trace_runtime_level;
+
+/**
+ * @brief Grava um registro no ring da thread atual (use as macros TRACE_*)
+ */
+void trace_emit(int level, int event, uint8_t addr, uint8_t func,
+                int32_t arg0, int32_t arg1, const void *data, int data_len);
+
+/*
+ * O teste do nível de compilação é constante: com o nível desligado a
+ * chamada inteira (e a avaliação dos argumentos) é descartada.
+ */
+#define TRACE(level, event, addr, func, arg0, arg1, data, data_len)                           \
+    do {                                                                                      \
+        if ((level) <= TRACE_COMPILE_LEVEL &&                                                 \
+            (level) <= atomic_load_explicit(&trace_runtime_level, memory_order_relaxed)) {    \
+            trace_emit((level), (event), (addr), (func), (arg0), (arg1), (data), (data_len)); \
+        }                                                                                     \
+    } while (0)
+
+#define TRACE_ERROR(event, addr, func, arg0, arg1) \
+    TRACE(TRACE_LEVEL_ERROR, event, addr, func, arg0, arg1, NULL, 0)
+#define TRACE_INFO(event, addr, func, arg0, arg1) \
+    TRACE(TRACE_LEVEL_INFO, event, addr, func, arg0, arg1, NULL, 0)
+#define TRACE_FRAME(event, buffer, len) \
+    TRACE(TRACE_LEVEL_FRAMES, event, (buffer)[0], (buffer)[1], len, 0, buffer, len)
+
+/**
+ * @brief Define o nível em tempo de execução (limitado por TRACE_COMPILE_LEVEL)
+ * @param level TRACE_LEVEL_OFF a TRACE_LEVEL_FRAMES
+ */
+void trace_set_level(int level);
+
+/**
+ * @brief Define o nível a partir de DEBUG_MODBUS e PRINT_BUFFERS
+ *
+ * Sem nenhuma das chaves só erros são registrados; DEBUG_MODBUS=1 inclui os
+ * eventos e PRINT_BUFFERS=1 inclui os bytes de cada quadro.
+ *
+ * @return Nível aplicado
+ */
+int trace_load_config(void);
+
+/**
+ * @brief Formata os argumentos de um evento, anexando ao texto já escrito
+ * @return Número de caracteres escritos
+ */
+typedef int (*trace_formatter_t)(const trace_record_t *rec, char *buffer, int size);
+
+/**
+ * @brief Registra o formatador de um evento cujos argumentos pertencem a outro módulo
+ *
+ * Quem emite o evento registra como exibir seus argumentos (ex: o nome de um
+ * enum próprio), assim o trace não depende dos cabeçalhos de cada camada.
+ * Eventos sem formatador aparecem só com o nome.
+ *
+ * @param event Evento (TRACE_EV_*)
+ * @param formatter Função de formatação (NULL remove)
+ */
+void trace_register_formatter(int event, trace_formatter_t formatter);
+
+/**
+ * @brief Converte um registro em texto (sem quebra de linha)
+ * @return Número de caracteres escritos
+ */
+int trace_format(const trace_record_t *rec, char *buffer, int size);
+
+/**
+ * @brief Esvazia os rings de todas as threads, em ordem de tempo, para out
+ * @return Número de registros escritos
+ */
+int trace_drain(FILE *out);
+
+/**
+ * @brief Inicia a thread que drena os rings periodicamente
+ * @param out Destino do texto (ex: stdout)
+ * @param interval_ms Intervalo entre drenagens
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int trace_start_drainer(FILE *out, int interval_ms);
+
+/**
+ * @brief Para a thread de drenagem após uma última drenagem
+ */
+void trace_stop_drainer(void);
+
+#endif
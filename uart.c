@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,12 +6,124 @@
 #include <termios.h>
 #include <string.h>
 #include <stdint.h>
-#include <sys/select.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 #include "uart.h"
+#include "crc16.h"
+#include "config.h"
+#include "bus_capture.h"
 
 #define UART_DEVICE "/dev/serial0"
 
+// Espera pelo primeiro byte em receive_uart()
+#define UART_RECEIVE_TIMEOUT_MS 1500
+
+// read() que também grava os bytes lidos, quando há gravação do barramento
+static ssize_t uart_read(int fd, void *buffer, size_t len) {
+    ssize_t bytes_read = read(fd, buffer, len);
+
+    if (bytes_read > 0) {
+        bus_capture_frame(fd, BUS_CAPTURE_RX, buffer, (int)bytes_read);
+    }
+    return bytes_read;
+}
+
+static const struct {
+    speed_t code;
+    int baudrate;
+} baud_table[] = {
+    { B1200, 1200 }, { B2400, 2400 }, { B4800, 4800 }, { B9600, 9600 },
+    { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 }, { B115200, 115200 },
+    { B230400, 230400 }, { B460800, 460800 }, { B921600, 921600 },
+};
+
+static speed_t baud_to_speed(int baudrate) {
+    for (size_t i = 0; i < sizeof(baud_table) / sizeof(baud_table[0]); i++) {
+        if (baud_table[i].baudrate == baudrate) {
+            return baud_table[i].code;
+        }
+    }
+
+    return B0;
+}
+
 int open_uart(const char *device) {
+    uart_config_t config;
+
+    uart_config_default(&config);
+    return open_uart_config(device, &config);
+}
+
+void uart_config_default(uart_config_t *config) {
+    config->baudrate = 9600;
+    config->data_bits = 8;
+    config->parity = 'N';
+    config->stop_bits = 1;
+    config->read_timeout_ms = 100;
+    config->low_latency = 1;
+    config->rs485 = 0;
+    config->rs485_delay_before_send_ms = 0;
+    config->rs485_delay_after_send_ms = 0;
+}
+
+void uart_load_config(uart_config_t *config) {
+    const char *parity = config_get("PARITY");
+
+    config->baudrate = config_get_int("BAUDRATE", config->baudrate);
+    config->data_bits = config_get_int("DATA_BITS", config->data_bits);
+    config->stop_bits = config_get_int("STOP_BITS", config->stop_bits);
+    config->read_timeout_ms = config_get_int("UART_READ_TIMEOUT_MS", config->read_timeout_ms);
+    config->low_latency = config_get_int("UART_LOW_LATENCY", config->low_latency);
+    config->rs485 = config_get_int("UART_RS485", config->rs485);
+    config->rs485_delay_before_send_ms = config_get_int("UART_RS485_DELAY_BEFORE_MS",
+                                                         config->rs485_delay_before_send_ms);
+    config->rs485_delay_after_send_ms = config_get_int("UART_RS485_DELAY_AFTER_MS",
+                                                        config->rs485_delay_after_send_ms);
+
+    if (parity != NULL && *parity != '\0') {
+        config->parity = (char)toupper((unsigned char)parity[0]);
+    }
+}
+
+static void uart_set_low_latency(int fd) {
+#ifdef ASYNC_LOW_LATENCY
+    struct serial_struct serial;
+
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &serial);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+static void uart_set_rs485(int fd, const uart_config_t *config) {
+#ifdef TIOCSRS485
+    struct serial_rs485 rs485;
+
+    memset(&rs485, 0, sizeof(rs485));
+    rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+    rs485.delay_rts_before_send = config->rs485_delay_before_send_ms;
+    rs485.delay_rts_after_send = config->rs485_delay_after_send_ms;
+
+    if (ioctl(fd, TIOCSRS485, &rs485) != 0) {
+        printf("Aviso: RS485 do kernel indisponível nesta porta\n");
+    }
+#else
+    (void)fd;
+    (void)config;
+#endif
+}
+
+int open_uart_config(const char *device, const uart_config_t *config) {
     int fd = open(device, O_RDWR | O_NOCTTY);
     if (fd == -1) {
         perror("Erro ao abrir a UART");
@@ -18,126 +131,466 @@ int open_uart(const char *device) {
     }
 
     struct termios options;
-    tcgetattr(fd, &options);
+    if (tcgetattr(fd, &options) != 0) {
+        perror("Erro ao ler atributos da UART");
+        close(fd);
+        return -1;
+    }
 
-    cfsetispeed(&options, B9600);
-    cfsetospeed(&options, B9600);
+    // Taxas fora da tabela são aplicadas via termios2 depois do tcsetattr
+    speed_t speed = baud_to_speed(config->baudrate);
+    cfsetispeed(&options, speed != B0 ? speed : B9600);
+    cfsetospeed(&options, speed != B0 ? speed : B9600);
+
+    options.c_cflag &= ~(PARENB | PARODD);
+    if (config->parity == 'E') {
+        options.c_cflag |= PARENB;
+    } else if (config->parity == 'O') {
+        options.c_cflag |= PARENB | PARODD;
+    }
+
+    if (config->stop_bits == 2) {
+        options.c_cflag |= CSTOPB;
+    } else {
+        options.c_cflag &= ~CSTOPB;
+    }
 
-    options.c_cflag &= ~PARENB;
-    options.c_cflag &= ~CSTOPB;
     options.c_cflag &= ~CSIZE;
-    options.c_cflag |= CS8;
+    switch (config->data_bits) {
+        case 5: options.c_cflag |= CS5; break;
+        case 6: options.c_cflag |= CS6; break;
+        case 7: options.c_cflag |= CS7; break;
+        default: options.c_cflag |= CS8; break;
+    }
     options.c_cflag |= CREAD | CLOCAL;
 
-    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
-    options.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // Modo binário: sem eco, sem sinais e sem tradução de CR/LF
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    options.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL | INLCR | IGNCR | ISTRIP | BRKINT | PARMRK);
     options.c_oflag &= ~OPOST;
-    
+
+    int vtime = (config->read_timeout_ms + 99) / 100;
     options.c_cc[VMIN]  = 0;
-    options.c_cc[VTIME] = 1;
+    options.c_cc[VTIME] = vtime > 255 ? 255 : vtime;
 
     tcflush(fd, TCIFLUSH);
-    tcsetattr(fd, TCSANOW, &options);
+    if (tcsetattr(fd, TCSANOW, &options) != 0) {
+        perror("Erro ao configurar a UART");
+        close(fd);
+        return -1;
+    }
+
+    if (speed == B0 && uart_set_custom_baudrate(fd, config->baudrate) != 0) {
+        fprintf(stderr, "Baudrate %d não suportado\n", config->baudrate);
+        close(fd);
+        return -1;
+    }
+
+    if (config->low_latency) {
+        uart_set_low_latency(fd);
+    }
+
+    if (config->rs485) {
+        uart_set_rs485(fd, config);
+    }
 
+    uart_refresh_gaps(fd);
     return fd;
 }
 
-void send_uart(int fd, const uint8_t *buffer, int len) {
-    int total_written = 0;
-    int bytes_written = 0;
+// Grava o quadro enviado num registro só, juntando os blocos
+static void capture_iov(int fd, const struct iovec *iov, int iovcnt) {
+    uint8_t frame[512];
+    int len = 0;
+
+    if (iovcnt == 1) {
+        bus_capture_frame(fd, BUS_CAPTURE_TX, iov->iov_base, (int)iov->iov_len);
+        return;
+    }
+    for (int i = 0; i < iovcnt && len + iov[i].iov_len <= sizeof(frame); i++) {
+        memcpy(frame + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    bus_capture_frame(fd, BUS_CAPTURE_TX, frame, len);
+}
+
+int send_uart_iov(int fd, const struct iovec *iov, int iovcnt) {
+    struct iovec pending[8];
     
-    tcflush(fd, TCIFLUSH);
+    if (iovcnt <= 0 || iovcnt > 8) {
+        return -1;
+    }
     
-    while (total_written < len) {
-        bytes_written = write(fd, buffer + total_written, len - total_written);
+    if (bus_capture_active()) {
+        capture_iov(fd, iov, iovcnt);
+    }
+
+    // Caso comum: o quadro inteiro sai numa única chamada (write para um bloco só)
+    memcpy(pending, iov, iovcnt * sizeof(struct iovec));
+    struct iovec *cur = pending;
+    
+    while (iovcnt > 0) {
+        ssize_t bytes_written = iovcnt == 1 ? write(fd, cur->iov_base, cur->iov_len)
+                                            : writev(fd, cur, iovcnt);
         
         if (bytes_written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             perror("Erro ao escrever na UART");
-            return;
+            return -1;
         }
         
-        total_written += bytes_written;
+        // Escrita parcial: avança sobre os blocos já enviados
+        while (iovcnt > 0 && (size_t)bytes_written >= cur->iov_len) {
+            bytes_written -= cur->iov_len;
+            cur++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            cur->iov_base = (uint8_t *)cur->iov_base + bytes_written;
+            cur->iov_len -= bytes_written;
+        }
     }
     
     tcdrain(fd);
+    return 0;
+}
+
+void send_uart(int fd, const uint8_t *buffer, int len) {
+    struct iovec iov = { .iov_base = (void *)buffer, .iov_len = len };
+    
+    send_uart_iov(fd, &iov, 1);
 }
 
 int receive_uart(int fd, uint8_t *buffer, int max_len) {
+    return receive_uart_rtu(fd, buffer, max_len, UART_RECEIVE_TIMEOUT_MS, 0, 0);
+}
+
+// Um caractere RTU ocupa 11 bits na linha (start + 8 dados + paridade/stop + stop)
+#define RTU_BITS_PER_CHAR 11
+
+int uart_get_baudrate(int fd) {
+    struct termios options;
+
+    // termios2 informa também taxas configuradas com BOTHER
+    int custom = uart_get_custom_baudrate(fd);
+    if (custom > 0) {
+        return custom;
+    }
+
+    if (tcgetattr(fd, &options) != 0) {
+        return -1;
+    }
+
+    speed_t speed = cfgetospeed(&options);
+    for (size_t i = 0; i < sizeof(baud_table) / sizeof(baud_table[0]); i++) {
+        if (baud_table[i].code == speed) {
+            return baud_table[i].baudrate;
+        }
+    }
+
+    return -1;
+}
+
+int uart_char_gap_us(int baudrate) {
+    // Acima de 19200 bps a especificação fixa t1.5 em 750 µs
+    if (baudrate <= 0 || baudrate > 19200) {
+        return 750;
+    }
+    return (int)(1500000LL * RTU_BITS_PER_CHAR / baudrate);
+}
+
+int uart_frame_gap_us(int baudrate) {
+    // Acima de 19200 bps a especificação fixa t3.5 em 1750 µs
+    if (baudrate <= 0 || baudrate > 19200) {
+        return 1750;
+    }
+    return (int)(3500000LL * RTU_BITS_PER_CHAR / baudrate);
+}
+
+/*
+ * t1.5 e t3.5 de cada porta, para a recepção não consultar o baudrate (uma ou
+ * duas ioctls) a cada quadro. Slot = fd % UART_GAP_SLOTS, com fd + 1 nos 24
+ * bits altos e os dois intervalos em 20 bits cada (0 = vazio). Um fd de outro
+ * slot ou fora da faixa é recalculado na hora.
+ */
+#define UART_GAP_SLOTS 256
+#define UART_GAP_BITS 20
+#define UART_GAP_MASK ((1ULL << UART_GAP_BITS) - 1)
+#define UART_GAP_MAX_FD ((1 << 24) - 2)
+
+static _Atomic uint64_t port_gaps[UART_GAP_SLOTS];
+
+static void store_gaps(int fd, int baudrate) {
+    if (fd < 0 || fd > UART_GAP_MAX_FD) {
+        return;
+    }
+
+    uint64_t t15 = (uint64_t)uart_char_gap_us(baudrate) & UART_GAP_MASK;
+    uint64_t t35 = (uint64_t)uart_frame_gap_us(baudrate) & UART_GAP_MASK;
+    atomic_store_explicit(&port_gaps[fd % UART_GAP_SLOTS],
+                          ((uint64_t)(fd + 1) << (2 * UART_GAP_BITS)) | (t15 << UART_GAP_BITS) | t35,
+                          memory_order_relaxed);
+}
+
+static void port_gaps_of(int fd, int *t15, int *t35) {
+    if (fd >= 0 && fd <= UART_GAP_MAX_FD) {
+        uint64_t slot = atomic_load_explicit(&port_gaps[fd % UART_GAP_SLOTS], memory_order_relaxed);
+        if ((slot >> (2 * UART_GAP_BITS)) == (uint64_t)fd + 1) {
+            *t15 = (int)((slot >> UART_GAP_BITS) & UART_GAP_MASK);
+            *t35 = (int)(slot & UART_GAP_MASK);
+            return;
+        }
+    }
+
+    int baudrate = uart_get_baudrate(fd);
+    *t15 = uart_char_gap_us(baudrate);
+    *t35 = uart_frame_gap_us(baudrate);
+    store_gaps(fd, baudrate);
+}
+
+void uart_refresh_gaps(int fd) {
+    store_gaps(fd, uart_get_baudrate(fd));
+}
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Espera por dados com resolução de microssegundos (reinicia em EINTR)
+static int poll_us(int fd, int64_t timeout_us) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int64_t deadline = monotonic_us() + timeout_us;
+
+    for (;;) {
+        int64_t remaining = deadline - monotonic_us();
+        if (remaining < 0) {
+            remaining = 0;
+        }
+
+        struct timespec ts = {
+            .tv_sec = remaining / 1000000,
+            .tv_nsec = (remaining % 1000000) * 1000,
+        };
+
+        int ret = ppoll(&pfd, 1, &ts, NULL);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        return ret;
+    }
+}
+
+// Verifica pelo cabeçalho se o quadro já tem o tamanho esperado
+int uart_rtu_frame_complete(const uint8_t *buffer, int len, int trailer) {
+    int expected = modbus_rx_predict_length(buffer, len, trailer);
+
+    // Função sem tamanho previsível: só o CRC e o silêncio delimitam
+    return expected > 0 && len >= expected;
+}
+
+int receive_uart_rtu(int fd, uint8_t *buffer, int max_len, int timeout_ms, int gap_us, int trailer) {
+    int t15, t35;
     int total_received = 0;
-    int bytes_read = 0;
-    fd_set read_fds;
-    struct timeval timeout;
-    int no_data_count = 0;
-    const int MAX_NO_DATA = 3; 
-    
+
+    port_gaps_of(fd, &t15, &t35);
+    if (gap_us > 0) {
+        t35 = gap_us;
+    }
+
+    if (t15 > t35) {
+        t15 = t35;
+    }
+
+    int activity = poll_us(fd, (int64_t)timeout_ms * 1000);
+    if (activity < 0) {
+        perror("Erro no poll");
+        return -1;
+    }
+    if (activity == 0) {
+        return 0;
+    }
+
     while (total_received < max_len) {
-        FD_ZERO(&read_fds);
-        FD_SET(fd, &read_fds);
-        
-        if (total_received == 0) {
-            timeout.tv_sec = 1;      
-            timeout.tv_usec = 500000; 
-        } else {
-            timeout.tv_sec = 0;      
-            timeout.tv_usec = 200000;
+        int bytes_read = uart_read(fd, buffer + total_received, max_len - total_received);
+
+        if (bytes_read < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            perror("Erro ao ler da UART");
+            return -1;
         }
-        
-        int activity = select(fd + 1, &read_fds, NULL, NULL, &timeout);
-        
+
+        if (bytes_read == 0) {
+            break;
+        }
+
+        total_received += bytes_read;
+
+        if (uart_rtu_frame_complete(buffer, total_received, trailer)) {
+            break;
+        }
+
+        // Silêncio de t1.5: se o CRC já fecha, o quadro terminou
+        activity = poll_us(fd, t15);
+        if (activity == 0) {
+            if (total_received >= 4 && crc16_modbus(buffer, total_received) == 0) {
+                break;
+            }
+
+            // Silêncio de t3.5: fim de quadro
+            activity = poll_us(fd, t35 - t15);
+            if (activity == 0) {
+                break;
+            }
+        }
+
         if (activity < 0) {
-            perror("Erro no select");
+            perror("Erro no poll");
+            return -1;
+        }
+    }
+
+    return total_received;
+}
+
+// Descarta bytes até a linha ficar em silêncio por gap_us (no máximo até deadline)
+static int discard_until_silence(int fd, int gap_us, int64_t deadline) {
+    uint8_t scratch[64];
+
+    while (monotonic_us() < deadline) {
+        int activity = poll_us(fd, gap_us);
+        if (activity <= 0) {
+            return activity;
+        }
+        if (uart_read(fd, scratch, sizeof(scratch)) < 0 && errno != EINTR && errno != EAGAIN) {
+            perror("Erro ao ler da UART");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int receive_uart_frame(int fd, modbus_rx_t *rx, int timeout_ms, int gap_us) {
+    int t15, t35;
+    int64_t deadline = monotonic_us() + (int64_t)timeout_ms * 1000;
+
+    port_gaps_of(fd, &t15, &t35);
+    if (gap_us > 0) {
+        t35 = gap_us;
+    }
+
+    while (rx->avail < rx->max) {
+        // Sem bytes pendentes espera a resposta até o timeout; no meio de um quadro, só t3.5.
+        // O timeout vale nos dois casos: ruído contínuo na linha não prende o receptor.
+        int64_t wait_us = deadline - monotonic_us();
+        if (rx->avail > 0 && wait_us > t35) {
+            wait_us = t35;
+        }
+        if (wait_us <= 0) {
+            break;
+        }
+
+        int activity = poll_us(fd, wait_us);
+        if (activity < 0) {
+            perror("Erro no poll");
             return -1;
         }
-        
         if (activity == 0) {
-            // Timeout
-            if (total_received == 0) {
-                return 0;
-            } else {
-                no_data_count++;
-                if (no_data_count >= MAX_NO_DATA) {
-                    break;
-                }
+            if (rx->avail == 0 || modbus_rx_finish(rx) != MODBUS_RX_MORE || rx->req == NULL) {
+                break;
+            }
+            // Silêncio no meio de um quadro (ruído, resposta atrasada cortada): continua ouvindo
+            modbus_rx_discard(rx);
+            continue;
+        }
+
+        int bytes_read = uart_read(fd, rx->buf + rx->avail, rx->max - rx->avail);
+        if (bytes_read < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
                 continue;
             }
+            perror("Erro ao ler da UART");
+            return -1;
         }
-        
-        if (FD_ISSET(fd, &read_fds)) {
-            bytes_read = read(fd, buffer + total_received, max_len - total_received);
-            
-            if (bytes_read < 0) {
-                perror("Erro ao ler da UART");
+        if (bytes_read == 0) {
+            break;
+        }
+
+        modbus_rx_push(rx, bytes_read);
+
+        // Quadro válido: termina no byte que fecha o CRC
+        if (rx->status == MODBUS_RX_OK || rx->status == MODBUS_RX_EXCEPTION) {
+            return rx->len;
+        }
+
+        // Rejeitado nos primeiros bytes: só espera a linha liberar
+        if (modbus_rx_done(rx)) {
+            if (modbus_rx_rejected(rx) && discard_until_silence(fd, t35, deadline) < 0) {
                 return -1;
             }
-            
-            if (bytes_read == 0) {
-                break;
+            return rx->avail;
+        }
+    }
+
+    modbus_rx_finish(rx);
+    return rx->status == MODBUS_RX_OK ? rx->len : rx->avail;
+}
+
+int uart_discard_input(int fd) {
+    uint8_t scratch[64];
+    int total = 0;
+
+    while (poll_us(fd, 0) > 0) {
+        int bytes_read = uart_read(fd, scratch, sizeof(scratch));
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            
-            total_received += bytes_read;
-            no_data_count = 0;
-            
-            // Para MODBUS, verificar se recebemos uma mensagem completa
-            if (total_received >= 5) {
-                // Mensagem MODBUS mínima: [addr][func][data][crc_lo][crc_hi]
-                // Se é uma resposta de read holding registers, verificar byte count
-                if (total_received >= 3 && buffer[1] == 0x03) {
-                    int expected_length = buffer[2] + 5; // byte_count + addr + func + byte_count + 2 CRC
-                    if (total_received >= expected_length) {
-                        break; // Mensagem completa recebida
-                    }
-                }
-                // Para outras funções MODBUS (write), geralmente 8 bytes
-                else if (total_received >= 8) {
-                    break; // Mensagem padrão recebida
-                }
+            if (errno == EAGAIN) {
+                break;
             }
+            perror("Erro ao ler da UART");
+            return -1;
         }
+        if (bytes_read == 0) {
+            break;
+        }
+        total += bytes_read;
     }
-    
-    return total_received;
+    return total;
+}
+
+static _Atomic(uart_close_hook_t) close_hooks[UART_MAX_CLOSE_HOOKS];
+
+int uart_register_close_hook(uart_close_hook_t hook) {
+    for (int i = 0; i < UART_MAX_CLOSE_HOOKS; i++) {
+        uart_close_hook_t expected = NULL;
+        if (atomic_load(&close_hooks[i]) == hook ||
+            atomic_compare_exchange_strong(&close_hooks[i], &expected, hook)) {
+            return 0;
+        }
+    }
+    return -1;
 }
 
 void close_uart(int fd) {
+    for (int i = 0; i < UART_MAX_CLOSE_HOOKS; i++) {
+        uart_close_hook_t hook = atomic_load(&close_hooks[i]);
+        if (hook != NULL) {
+            hook(fd);
+        }
+    }
+    bus_capture_port_closed(fd);
+    if (fd >= 0 && fd <= UART_GAP_MAX_FD) {
+        uint64_t slot = atomic_load(&port_gaps[fd % UART_GAP_SLOTS]);
+        if ((slot >> (2 * UART_GAP_BITS)) == (uint64_t)fd + 1) {
+            atomic_compare_exchange_strong(&port_gaps[fd % UART_GAP_SLOTS], &slot, 0);
+        }
+    }
     close(fd);
 }
\ No newline at end of file
@@ -2,14 +2,75 @@
 #define UART_H
 
 #include <stdint.h>
+#include <sys/uio.h>
+#include "modbus_rx.h"
+
+#define UART_MAX_CLOSE_HOOKS 8
+
+// Parâmetros da linha serial
+typedef struct {
+    int baudrate;         // bps (taxas fora da tabela padrão usam termios2/BOTHER)
+    int data_bits;        // 5 a 8
+    char parity;          // 'N', 'E' ou 'O'
+    int stop_bits;        // 1 ou 2
+    int read_timeout_ms;  // VTIME das leituras bloqueantes (múltiplos de 100 ms)
+    int low_latency;      // Ativa ASYNC_LOW_LATENCY no driver, se disponível
+    int rs485;            // Ativa controle de direção via TIOCSRS485, se disponível
+    int rs485_delay_before_send_ms;
+    int rs485_delay_after_send_ms;
+} uart_config_t;
 
 /**
- * @brief Abre a porta UART para comunicação RS485-MODBUS
+ * @brief Abre a porta UART para comunicação RS485-MODBUS (9600 8N1)
  * @param device Caminho do dispositivo (ex: "/dev/ttyUSB0")
  * @return File descriptor da UART ou -1 em caso de erro
  */
 int open_uart(const char *device);
 
+/**
+ * @brief Preenche a configuração padrão (9600 8N1, low latency, sem RS485)
+ * @param config Configuração a preencher
+ */
+void uart_config_default(uart_config_t *config);
+
+/**
+ * @brief Sobrescreve a configuração com as chaves carregadas por config_load
+ *
+ * Chaves: BAUDRATE, DATA_BITS, PARITY, STOP_BITS, UART_READ_TIMEOUT_MS,
+ * UART_LOW_LATENCY, UART_RS485, UART_RS485_DELAY_BEFORE_MS e
+ * UART_RS485_DELAY_AFTER_MS.
+ *
+ * @param config Configuração a atualizar
+ */
+void uart_load_config(uart_config_t *config);
+
+/**
+ * @brief Abre a porta UART com os parâmetros informados
+ *
+ * O modo de baixa latência e o RS485 do kernel são opcionais: se o driver
+ * não os suportar, a porta é aberta normalmente sem eles.
+ *
+ * @param device Caminho do dispositivo (ex: "/dev/ttyUSB0")
+ * @param config Parâmetros da linha
+ * @return File descriptor da UART ou -1 em caso de erro
+ */
+int open_uart_config(const char *device, const uart_config_t *config);
+
+/**
+ * @brief Configura um baudrate arbitrário via termios2/BOTHER (Linux)
+ * @param fd File descriptor da UART
+ * @param baudrate Baudrate em bps
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int uart_set_custom_baudrate(int fd, int baudrate);
+
+/**
+ * @brief Lê o baudrate efetivo via termios2 (Linux)
+ * @param fd File descriptor da UART
+ * @return Baudrate em bps ou -1 se indisponível
+ */
+int uart_get_custom_baudrate(int fd);
+
 /**
  * @brief Envia dados pela UART
  * @param fd File descriptor da UART
@@ -18,15 +79,135 @@ int open_uart(const char *device);
  */
 void send_uart(int fd, const uint8_t *buffer, int len);
 
+/**
+ * @brief Envia um quadro formado por vários blocos com uma única chamada writev()
+ * @param fd File descriptor da UART
+ * @param iov Blocos a enviar, em ordem
+ * @param iovcnt Número de blocos
+ * @return 0 em caso de sucesso, -1 em caso de erro
+ */
+int send_uart_iov(int fd, const struct iovec *iov, int iovcnt);
+
 /**
  * @brief Recebe dados pela UART
+ *
+ * Igual a receive_uart_rtu() com 1,5 s de espera pelo primeiro byte, t3.5
+ * calculado pelo baudrate e sem trailer: dispositivos com trailer devem usar
+ * receive_uart_rtu() ou receive_uart_frame().
+ *
  * @param fd File descriptor da UART
  * @param buffer Buffer para armazenar os dados recebidos
  * @param max_len Tamanho máximo do buffer
- * @return Número de bytes lidos
+ * @return Número de bytes lidos, 0 em timeout ou -1 em caso de erro
  */
 int receive_uart(int fd, uint8_t *buffer, int max_len);
 
+/**
+ * @brief Recebe um quadro MODBUS RTU delimitado pelo silêncio de linha
+ *
+ * Aguarda o primeiro byte por até timeout_ms. A partir daí o quadro termina
+ * assim que o comprimento esperado é atingido, quando a linha fica em
+ * silêncio por t1.5 com um CRC válido no buffer, ou após t3.5 de silêncio.
+ *
+ * @param fd File descriptor da UART
+ * @param buffer Buffer para armazenar o quadro recebido
+ * @param max_len Tamanho máximo do buffer
+ * @param timeout_ms Tempo máximo de espera pelo primeiro byte
+ * @param gap_us Silêncio de fim de quadro em µs (0 = t3.5 calculado pelo baudrate)
+ * @param trailer Bytes do dispositivo entre a resposta e o CRC (modbus_timing_t.response_trailer)
+ * @return Número de bytes lidos, 0 em timeout ou -1 em caso de erro
+ */
+int receive_uart_rtu(int fd, uint8_t *buffer, int max_len, int timeout_ms, int gap_us, int trailer);
+
+/**
+ * @brief Recebe a resposta a uma requisição validando cada byte ao chegar
+ *
+ * Retorna em no máximo timeout_ms, mesmo com bytes chegando sem parar
+ * (ruído, tráfego de outro mestre). O quadro termina no byte que
+ * fecha um CRC válido (modbus_rx.h). Um quadro de outro escravo ou com função
+ * inesperada é rejeitado nos primeiros bytes: o resto é descartado até t3.5
+ * de silêncio, sem esperar o tamanho completo. Sem tamanho conhecido pelo
+ * cabeçalho, o quadro termina após t3.5 de silêncio.
+ *
+ * Com a requisição informada (modbus_rx_set_request), eco, ruído e respostas
+ * atrasadas são descartados no próprio fluxo e a espera pela resposta continua
+ * até timeout_ms, sem falhar a tentativa.
+ *
+ * @param fd File descriptor da UART
+ * @param rx Estado preparado com modbus_rx_init (rx->status traz o resultado)
+ * @param timeout_ms Tempo máximo da recepção
+ * @param gap_us Silêncio de fim de quadro em µs (0 = t3.5 calculado pelo baudrate)
+ * @return Tamanho do quadro válido, bytes pendentes de um quadro inválido,
+ *         0 sem resposta ou -1 em caso de erro
+ */
+int receive_uart_frame(int fd, modbus_rx_t *rx, int timeout_ms, int gap_us);
+
+/**
+ * @brief Descarta os bytes já recebidos e ainda não lidos
+ *
+ * Antes de uma requisição: o que chegou antes do envio não pode ser a
+ * resposta a ela (ex: resposta atrasada de uma requisição que expirou).
+ *
+ * @param fd File descriptor da UART
+ * @return Número de bytes descartados ou -1 em caso de erro
+ */
+int uart_discard_input(int fd);
+
+/**
+ * @brief Indica pelo cabeçalho se uma resposta RTU já tem o tamanho esperado
+ * @param buffer Bytes recebidos
+ * @param len Quantidade de bytes recebidos
+ * @param trailer Bytes do dispositivo entre a resposta e o CRC
+ * @return 1 se o quadro está completo, 0 caso contrário
+ */
+int uart_rtu_frame_complete(const uint8_t *buffer, int len, int trailer);
+
+/**
+ * @brief Retorna o baudrate configurado na UART
+ * @param fd File descriptor da UART
+ * @return Baudrate em bps ou -1 em caso de erro
+ */
+int uart_get_baudrate(int fd);
+
+/**
+ * @brief Intervalo t1.5 (silêncio máximo entre caracteres de um quadro RTU)
+ * @param baudrate Baudrate em bps
+ * @return Intervalo em microssegundos
+ */
+int uart_char_gap_us(int baudrate);
+
+/**
+ * @brief Intervalo t3.5 (silêncio mínimo entre quadros RTU)
+ * @param baudrate Baudrate em bps
+ * @return Intervalo em microssegundos
+ */
+int uart_frame_gap_us(int baudrate);
+
+/**
+ * @brief Recalcula t1.5 e t3.5 guardados para a porta
+ *
+ * As funções de recepção usam os intervalos guardados por fd, calculados em
+ * open_uart_config(), uart_set_custom_baudrate() ou na primeira recepção.
+ * Quem muda a taxa por fora da biblioteca (tcsetattr) chama esta função.
+ *
+ * @param fd File descriptor da UART
+ */
+void uart_refresh_gaps(int fd);
+
+// Chamada por close_uart() antes de fechar o fd (estado que módulos guardam por porta)
+typedef void (*uart_close_hook_t)(int fd);
+
+/**
+ * @brief Registra uma função chamada a cada close_uart()
+ *
+ * Módulos que guardam estado por fd (cópias do placar, cache de capturas,
+ * estimativas) o descartam aqui: o número do fd pode ser reaproveitado por
+ * outra porta, com outros dispositivos.
+ *
+ * @return 0 em caso de sucesso, -1 se não há mais lugar (UART_MAX_CLOSE_HOOKS)
+ */
+int uart_register_close_hook(uart_close_hook_t hook);
+
 /**
  * @brief Fecha a porta UART
  * @param fd File descriptor da UART
@@ -0,0 +1,54 @@
+#include <sys/ioctl.h>
+#include "uart.h"
+
+/*
+ * Taxas arbitrárias via termios2/BOTHER. Fica numa unidade de compilação
+ * separada porque <asm/termbits.h> conflita com o <termios.h> da glibc.
+ */
+#if defined(__linux__) && defined(TCGETS2)
+#include <asm/termbits.h>
+
+int uart_set_custom_baudrate(int fd, int baudrate) {
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        return -1;
+    }
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baudrate;
+    tio.c_ospeed = baudrate;
+
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        return -1;
+    }
+
+    uart_refresh_gaps(fd);
+    return 0;
+}
+
+int uart_get_custom_baudrate(int fd) {
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        return -1;
+    }
+
+    return (int)tio.c_ospeed;
+}
+
+#else
+
+int uart_set_custom_baudrate(int fd, int baudrate) {
+    (void)fd;
+    (void)baudrate;
+    return -1;
+}
+
+int uart_get_custom_baudrate(int fd) {
+    (void)fd;
+    return -1;
+}
+
+#endif